@@ -12,7 +12,10 @@ Process::Process( const double maximum_rate, const double s_brownian_motion_rate
     _gaussian( maximum_rate, bins * 128 ),
     _brownian_motion_rate( s_brownian_motion_rate ),
     _outage_escape_rate( s_outage_escape_rate ),
-    _normalized( false )
+    _normalized( false ),
+    _kernel(),
+    _evolved( _probability_mass_function.size(), 0.0 ),
+    _poisson( _probability_mass_function )
 {
   normalize();
 }
@@ -21,12 +24,65 @@ void Process::observe( const double time, const int counts )
 {
   _normalized = false;
 
-  /* multiply by likelihood function */
-  _probability_mass_function.for_each( [&]
-				       ( const double midpoint, double & value, const unsigned int index __attribute((unused)) )
-				       {
-					 value *= poissonpdf( midpoint * time, counts );
-				       } );
+  assert( counts >= 0 );
+  const std::vector< double > & log_likelihood = _poisson.log_likelihood( time, counts );
+  const std::vector< double > & old_pmf = _probability_mass_function.values();
+
+  /* Multiply by the likelihood function. Only the shape matters until
+     normalize(), so scale it so the likeliest bin that is still
+     possible has a likelihood of 1. That keeps the pmf from
+     underflowing over ticks of unlikely counts without normalizing. */
+  double most_likely = -INFINITY;
+  for ( unsigned int i = 0; i < old_pmf.size(); i++ ) {
+    if ( old_pmf[ i ] > 0 && log_likelihood[ i ] > most_likely ) {
+      most_likely = log_likelihood[ i ];
+    }
+  }
+
+  if ( most_likely == -INFINITY ) {
+    most_likely = 0; /* impossible everywhere */
+  }
+
+  for ( unsigned int i = 0; i < old_pmf.size(); i++ ) {
+    _evolved[ i ] = old_pmf[ i ] * exp( log_likelihood[ i ] - most_likely );
+  }
+
+  _probability_mass_function.swap_values( _evolved );
+}
+
+Process::PoissonTable::PoissonTable( const SampledFunction & pmf )
+  : _rates(),
+    _time( -1 ),
+    _log_likelihood()
+{
+  pmf.for_each( [&] ( const double midpoint, const double &, const unsigned int ) { _rates.push_back( midpoint ); } );
+}
+
+const std::vector< double > & Process::PoissonTable::log_likelihood( const double time, const unsigned int count )
+{
+  if ( time != _time ) {
+    _time = time;
+    _log_likelihood.clear();
+  }
+
+  while ( _log_likelihood.size() <= count ) {
+    const unsigned int k = _log_likelihood.size();
+    const double log_k_factorial = lgamma( k + 1.0 );
+
+    std::vector< double > row;
+    for ( auto it = _rates.begin(); it != _rates.end(); it++ ) {
+      const double mean = *it * time;
+      if ( mean == 0 ) {
+	row.push_back( k == 0 ? 0 : -INFINITY );
+      } else {
+	row.push_back( k * log( mean ) - mean - log_k_factorial );
+      }
+    }
+
+    _log_likelihood.push_back( row );
+  }
+
+  return _log_likelihood[ count ];
 }
 
 void Process::normalize( void )
@@ -54,55 +110,96 @@ void Process::normalize( void )
   _normalized = true;
 }
 
-void Process::evolve( const double time )
+void Process::build_kernel( const double time )
 {
-  _normalized = false;
-
   /* initialize brownian motion */
   double stddev = _brownian_motion_rate * sqrt( time );
   _gaussian.calculate( stddev );
 
-  /* initialize new pmf */
-  SampledFunction new_pmf( _probability_mass_function );
-  new_pmf.for_each( [] ( const double, double & value, const unsigned int ) { value = 0; } );
-
-  const double zero_escape_probability = 1 - poissonpdf( time * _outage_escape_rate, 0 );
-  assert( zero_escape_probability >= 0 );
-  assert( zero_escape_probability <= 1.0 );
+  std::shared_ptr< EvolutionKernel > kernel( std::make_shared< EvolutionKernel >() );
+  kernel->time = time;
+  kernel->zero_escape_probability = 1 - poissonpdf( time * _outage_escape_rate, 0 );
+  assert( kernel->zero_escape_probability >= 0 );
+  assert( kernel->zero_escape_probability <= 1.0 );
 
+  /* the same bins and weights as applying the Gaussian pair by pair
+     (using only the layout of the pmf's bins, not its values) */
   _probability_mass_function.for_each( [&]
-				       ( const double old_rate, const double & old_prob, const unsigned int old_index )
+				       ( const double old_rate, const double &, const unsigned int old_index )
 				       {
-					 new_pmf.for_range( old_rate - 5 * stddev,
-							    old_rate + 5 * stddev,
-							    [&]
-							    ( const double new_rate, double & new_prob, const unsigned int new_index )
-							    {
-							      double zfactor = 1.0;
-							      
-							      if ( old_index == 0 ) {
-								zfactor = ( new_index != 0 ) ? zero_escape_probability : (1 - zero_escape_probability);
-							      }
-							      
-							      double contribution = zfactor * old_prob
-								* ( _gaussian.cdf( new_pmf.sample_ceil( new_rate ) - old_rate )
-								    - _gaussian.cdf( new_pmf.sample_floor( new_rate ) - old_rate ) );
-
-							      assert( !isnan( zfactor ) );
-							      assert( !isnan( old_prob ) );
-							      assert( !isnan( new_rate ) );
-							      assert( !isnan( old_rate ) );
-							      assert( !isnan( _gaussian.cdf( new_pmf.sample_ceil( new_rate ) - old_rate ) ) );
-							      assert( !isnan( _gaussian.cdf( new_pmf.sample_floor( new_rate ) - old_rate ) ) );
-
-							      assert( contribution >= 0.0 );
-							      assert( contribution <= 1.0 );
-
-							      new_prob += contribution;
-							    } );
+					 EvolutionKernel::Band band = { 0, 0, (unsigned int)kernel->weights.size() };
+
+					 _probability_mass_function.for_range( old_rate - 5 * stddev,
+							  old_rate + 5 * stddev,
+							  [&]
+							  ( const double new_rate, double &, const unsigned int new_index )
+							  {
+							    if ( band.count == 0 ) {
+							      band.first = new_index;
+							    }
+							    assert( new_index == band.first + band.count );
+							    band.count++;
+
+							    const double weight = _gaussian.cdf( _probability_mass_function.sample_ceil( new_rate ) - old_rate )
+							      - _gaussian.cdf( _probability_mass_function.sample_floor( new_rate ) - old_rate );
+
+							    assert( !isnan( weight ) );
+							    assert( weight >= 0.0 );
+							    assert( weight <= 1.0 );
+
+							    kernel->weights.push_back( weight );
+							  } );
+
+					 assert( old_index == kernel->bands.size() );
+					 kernel->bands.push_back( band );
 				       } );
-  
-  _probability_mass_function = new_pmf;
+
+  _kernel = kernel;
+}
+
+void Process::evolve( const double time )
+{
+  _normalized = false;
+
+  if ( !_kernel || time != _kernel->time ) {
+    build_kernel( time );
+  }
+  const EvolutionKernel & kernel = *_kernel;
+
+  const std::vector< double > & old_pmf = _probability_mass_function.values();
+  std::fill( _evolved.begin(), _evolved.end(), 0.0 );
+
+  for ( unsigned int old_index = 0; old_index < old_pmf.size(); old_index++ ) {
+    const double old_prob = old_pmf[ old_index ];
+    if ( old_prob == 0 ) {
+      continue;
+    }
+
+    const EvolutionKernel::Band & band = kernel.bands[ old_index ];
+    const double * weight = &kernel.weights[ band.offset ];
+    double * new_prob = &_evolved[ band.first ];
+    unsigned int count = band.count;
+
+    if ( old_index == 0 ) {
+      /* an outage is escaped only at the zero-escape rate */
+      if ( band.first == 0 ) {
+	*new_prob++ += (1 - kernel.zero_escape_probability) * old_prob * *weight++;
+	count--;
+      }
+
+      const double escaping = kernel.zero_escape_probability * old_prob;
+      for ( unsigned int i = 0; i < count; i++ ) {
+	new_prob[ i ] += escaping * weight[ i ];
+      }
+    } else {
+      /* a contiguous multiply-add, which the compiler vectorizes */
+      for ( unsigned int i = 0; i < count; i++ ) {
+	new_prob[ i ] += old_prob * weight[ i ];
+      }
+    }
+  }
+
+  _probability_mass_function.swap_values( _evolved );
 }
 
 Process::GaussianCache::GaussianCache( const double maximum_rate, const int bins )
@@ -151,19 +248,26 @@ Process & Process::operator=( const Process & other )
   _normalized = other._normalized;
   *( const_cast< double * >( &_brownian_motion_rate ) ) = other._brownian_motion_rate;
 
+  /* rebuilt for this process's rates on the next evolve() */
+  _kernel.reset();
+
+  /* the rest follows the new bins */
+  _evolved.assign( _probability_mass_function.size(), 0.0 );
+  _poisson = other._poisson;
+
   return *this;
 }
 
 double Process::count_probability( const double time, const int counts )
 {
-  double ret = 0.0;
+  assert( counts >= 0 );
+  const std::vector< double > & log_likelihood = _poisson.log_likelihood( time, counts );
+  const std::vector< double > & pmf = _probability_mass_function.values();
 
-  _probability_mass_function.for_each( [&] ( const double rate,
-					     const double & rate_probability,
-					     const unsigned int )
-				       {
-					 ret += rate_probability * poissonpdf( rate * time, counts );
-				       } );
+  double ret = 0.0;
+  for ( unsigned int i = 0; i < pmf.size(); i++ ) {
+    ret += pmf[ i ] * exp( log_likelihood[ i ] );
+  }
 
   return ret;
 }
@@ -1,6 +1,9 @@
 #ifndef PROCESS_HPP
 #define PROCESS_HPP
 
+#include <vector>
+#include <memory>
+
 #include "sampledfunction.hh"
 
 class Process
@@ -17,6 +20,37 @@ private:
     double cdf( const double x ) const { return _cdf[ x ]; }
   };
 
+  /* log Poisson likelihood of each count at each bin's rate, over one
+     tick length at a time, with rows made as counts are seen */
+  class PoissonTable {
+  private:
+    std::vector< double > _rates; /* bin midpoints */
+    double _time;
+    std::vector< std::vector< double > > _log_likelihood;
+
+  public:
+    PoissonTable( const SampledFunction & pmf );
+    const std::vector< double > & log_likelihood( const double time, const unsigned int count );
+  };
+
+  /* The Brownian motion over one tick, as a banded transition matrix:
+     old bin i spreads its probability over new bins
+     first..first+count-1 in the proportions kernel[offset..]. Built
+     once per tick length, so evolve() is only multiply-adds. */
+  class EvolutionKernel {
+  public:
+    struct Band {
+      unsigned int first, count, offset;
+    };
+
+    double time;
+    double zero_escape_probability;
+    std::vector< Band > bands;
+    std::vector< double > weights;
+
+    EvolutionKernel() : time( -1 ), zero_escape_probability( 0 ), bands(), weights() {}
+  };
+
   SampledFunction _probability_mass_function;
   GaussianCache _gaussian;
 
@@ -25,6 +59,13 @@ private:
 
   bool _normalized;
 
+  std::shared_ptr< const EvolutionKernel > _kernel; /* shared by copies, until one evolves over another time */
+  std::vector< double > _evolved; /* the other half of the double-buffered pmf */
+
+  PoissonTable _poisson; /* each copy has its own, so copies can be used on different threads */
+
+  void build_kernel( const double time );
+
 public:
   Process( const double maximum_rate, const double s_brownian_motion_rate, const double s_outage_escape_rate, const int bins );
 
@@ -1,8 +1,19 @@
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "processforecaster.hh"
+#include "swrite.h"
 
 std::vector< Process > ProcessForecastTick::make_components( const Process & example )
 {
@@ -79,96 +90,363 @@ std::vector< double > ProcessForecastInterval::convolve( const std::vector< doub
   return ret;
 }
 
-ProcessForecastInterval::ProcessForecastInterval( const double tick_time,
-						  const Process & example,
-						  const unsigned int tick_upper_limit,
-						  const unsigned int num_ticks )
-  : _count_probability()
+ProcessForecastInterval::ProcessForecastInterval( const std::shared_ptr< const double > & cumulative_probability,
+						  const unsigned int components,
+						  const unsigned int counts )
+  : _cumulative_probability( cumulative_probability ),
+    _components( components ),
+    _counts( counts )
+{}
+
+std::vector< ProcessForecastInterval > ProcessForecastInterval::make_intervals( const double tick_time,
+										const Process & example,
+										const unsigned int tick_upper_limit,
+										const unsigned int num_ticks )
 {
-  /* step 1: make the component processes */
-  std::vector< Process > components( ProcessForecastTick::make_components( example ) );
- 
-  /* step 2: make the tick forecast */
-  ProcessForecastTick tick_forecast( tick_time, example, tick_upper_limit );
+  assert( num_ticks > 0 );
 
-  /* step 3: for each component, integrate and evolve forward */
-  for ( auto it = components.begin(); it != components.end(); it++ ) {
-    std::vector< double > this_component_count_probability( 1, 1.0 );
-    for ( unsigned int tick = 0; tick < num_ticks; tick++ ) {
-      /* collect tick forecast */
-      std::vector< double > this_tick;
-      for ( unsigned int i = 0; i < tick_upper_limit; i++ ) {
-	it->normalize();
-	this_tick.push_back( tick_forecast.probability( *it, i ) );
-      }
+  /* step 1: make the component processes, sharing one evolution kernel
+     (which only depends on the bins and the tick length) */
+  Process prototype( example );
+  prototype.evolve( tick_time );
+  std::vector< Process > components( ProcessForecastTick::make_components( prototype ) );
+
+  /* step 2: make the tick forecast (which only needs reading from now on) */
+  ProcessForecastTick tick_forecast( tick_time, prototype, tick_upper_limit );
+
+  /* the tables, one per interval: the counts grow by tick_upper_limit - 1 each tick */
+  std::vector< std::shared_ptr< double > > tables;
+  for ( unsigned int tick = 0; tick < num_ticks; tick++ ) {
+    const unsigned int counts = 1 + (tick + 1) * (tick_upper_limit - 1);
+    tables.push_back( std::shared_ptr< double >( new double[ components.size() * counts ],
+						 std::default_delete< double[] >() ) );
+  }
+
+  /* step 3: for each component, integrate and evolve forward. The
+     components are independent, so threads take them in turn. */
+  std::atomic< unsigned int > next_component( 0 );
+
+  auto work = [&] ( void ) {
+    for ( unsigned int component = next_component++;
+	  component < components.size();
+	  component = next_component++ ) {
+      Process & it = components[ component ];
+      std::vector< double > this_component_count_probability( 1, 1.0 );
+      std::vector< double > this_tick( tick_upper_limit );
+
+      for ( unsigned int tick = 0; tick < num_ticks; tick++ ) {
+	/* collect tick forecast */
+	it.normalize();
+	for ( unsigned int i = 0; i < tick_upper_limit; i++ ) {
+	  this_tick[ i ] = tick_forecast.probability( it, i );
+	}
+
+	/* add to previous forecast, which is the forecast over this many ticks */
+	this_component_count_probability = convolve( this_component_count_probability,
+						     this_tick );
 
-      /* add to previous forecast */
-      this_component_count_probability = convolve( this_component_count_probability,
-						   this_tick );
+	/* store as this component's column of the cumulative table */
+	double cumulative = 0.0;
+	double * column = tables[ tick ].get() + component;
+	for ( unsigned int i = 0; i < this_component_count_probability.size(); i++ ) {
+	  cumulative += this_component_count_probability[ i ];
+	  column[ i * components.size() ] = cumulative;
+	}
 
-      /* evolve forward */
-      it->evolve( tick_time );
+	/* evolve forward */
+	it.evolve( tick_time );
+      }
     }
+  };
+
+  const unsigned int num_threads = std::max( 1u, std::min( std::thread::hardware_concurrency(),
+							   (unsigned int)components.size() ) );
+  std::vector< std::thread > threads;
+  for ( unsigned int i = 1; i < num_threads; i++ ) {
+    threads.emplace_back( work );
+  }
+  work();
+  for ( auto & thread : threads ) {
+    thread.join();
+  }
+
+  std::vector< ProcessForecastInterval > ret;
+  for ( unsigned int tick = 0; tick < num_ticks; tick++ ) {
+    ret.emplace_back( tables[ tick ], components.size(), 1 + (tick + 1) * (tick_upper_limit - 1) );
+  }
+
+  return ret;
+}
+
+/* the ensemble's probability of at most count arrivals: a dot product
+   with one contiguous row of the table, in four independent sums so
+   the compiler can vectorize it (and keep the multiply-adds in flight) */
+double ProcessForecastInterval::cumulative_probability( const std::vector< double > & pmf, const unsigned int count ) const
+{
+  const double * row = _cumulative_probability.get() + count * _components;
+  double sum[ 4 ] = { 0.0, 0.0, 0.0, 0.0 };
 
-    _count_probability.push_back( this_component_count_probability );
+  unsigned int i = 0;
+  for ( ; i + 4 <= _components; i += 4 ) {
+    sum[ 0 ] += pmf[ i ] * row[ i ];
+    sum[ 1 ] += pmf[ i + 1 ] * row[ i + 1 ];
+    sum[ 2 ] += pmf[ i + 2 ] * row[ i + 2 ];
+    sum[ 3 ] += pmf[ i + 3 ] * row[ i + 3 ];
   }
+  for ( ; i < _components; i++ ) {
+    sum[ 0 ] += pmf[ i ] * row[ i ];
+  }
+
+  return (sum[ 0 ] + sum[ 1 ]) + (sum[ 2 ] + sum[ 3 ]);
 }
 
-/* exact same routine as for ProcessForecastTick! */
 double ProcessForecastInterval::probability( const Process & ensemble, unsigned int count ) const
 {
   assert( ensemble.is_normalized() );
-  assert( ensemble.pmf().size() == _count_probability.size() );
-  assert( _count_probability.size() > 0 );
+  assert( ensemble.pmf().size() == _components );
+  assert( _components > 0 );
 
-  assert( count < _count_probability[ 0 ].size() );
+  assert( count < _counts );
 
-  double ret = ensemble.pmf().summation( _count_probability, count );
+  const std::vector< double > & pmf = ensemble.pmf().values();
+  double ret = cumulative_probability( pmf, count );
+  if ( count > 0 ) {
+    ret -= cumulative_probability( pmf, count - 1 );
+  }
 
   if ( ret > 1.0 ) {
     fprintf( stderr, "Error, prob = %f\n", ret );
     ret = 1.0;
   }
 
-  return ret;
+  return std::max( ret, 0.0 );
 }
 
-unsigned int ProcessForecastInterval::lower_quantile( const Process & ensemble, const double x ) const
+unsigned int ProcessForecastInterval::lower_quantile( const Process & ensemble, const double x, const unsigned int hint ) const
 {
-  double sum = 0.0;
+  assert( ensemble.is_normalized() );
+  assert( ensemble.pmf().size() == _components );
 
-  for ( unsigned int i = 0; i < _count_probability[ 0 ].size(); i++ ) {
-    sum += probability( ensemble, i );
+  const std::vector< double > & pmf = ensemble.pmf().values();
 
-    if ( sum >= x ) {
-      return i;
+  if ( _counts == 0 || cumulative_probability( pmf, _counts - 1 ) < x ) {
+    return _counts + 1;
+  }
+
+  /* the quantile is the first count whose cumulative probability
+     reaches x. Gallop out from the hint until it is bracketed, so a
+     quantile that hasn't moved costs two rows. */
+  unsigned int low, high; /* cumulative probability at low < x <= at high */
+  const unsigned int start = std::min( hint, _counts - 1 );
+  if ( cumulative_probability( pmf, start ) >= x ) {
+    high = start;
+    unsigned int step = 1;
+    while ( true ) {
+      if ( high < step ) {
+	if ( cumulative_probability( pmf, 0 ) >= x ) {
+	  return 0;
+	}
+	low = 0;
+	break;
+      }
+      low = high - step;
+      if ( cumulative_probability( pmf, low ) < x ) {
+	break;
+      }
+      high = low;
+      step *= 2;
+    }
+  } else {
+    low = start;
+    unsigned int step = 1;
+    while ( true ) {
+      high = std::min( low + step, _counts - 1 );
+      if ( cumulative_probability( pmf, high ) >= x ) {
+	break;
+      }
+      low = high;
+      step *= 2;
+    }
+  }
+
+  /* then bisect */
+  while ( high - low > 1 ) {
+    const unsigned int middle = low + (high - low) / 2;
+    if ( cumulative_probability( pmf, middle ) >= x ) {
+      high = middle;
+    } else {
+      low = middle;
     }
   }
 
-  return _count_probability[ 0 ].size() + 1;
+  return high;
 }
 
 /* construct from saved protobuf */
 ProcessForecastInterval::ProcessForecastInterval( const Sprout::ProcessForecastInterval &storedmodel )
-  : _count_probability()
+  : _cumulative_probability(),
+    _components( storedmodel.count_probabilities_size() ),
+    _counts( _components ? storedmodel.count_probabilities( 0 ).count_probability_size() : 0 )
 {
-  for ( int i = 0; i < storedmodel.count_probabilities_size(); i++ ) {
-    std::vector< double > this_component_count_probability;
-    for ( int j = 0; j < storedmodel.count_probabilities( i ).count_probability_size(); j++ ) {
-      this_component_count_probability.push_back( storedmodel.count_probabilities( i ).count_probability( j ) );
+  double * table = new double[ _components * _counts ];
+  _cumulative_probability.reset( table, std::default_delete< double[] >() );
+
+  for ( unsigned int i = 0; i < _components; i++ ) {
+    assert( storedmodel.count_probabilities( i ).count_probability_size() == int( _counts ) );
+    double cumulative = 0.0;
+    for ( unsigned int j = 0; j < _counts; j++ ) {
+      cumulative += storedmodel.count_probabilities( i ).count_probability( j );
+      table[ j * _components + i ] = cumulative;
     }
-    _count_probability.push_back( this_component_count_probability );
   }
 }
 
 Sprout::ProcessForecastInterval ProcessForecastInterval::to_protobuf( void ) const
 {
   Sprout::ProcessForecastInterval ret;
-  for ( unsigned int i = 0; i < _count_probability.size(); i++ ) {
+  for ( unsigned int i = 0; i < _components; i++ ) {
     auto *this_component = ret.add_count_probabilities();
-    for ( unsigned int j = 0; j < _count_probability.at( i ).size(); j++ ) {
-      this_component->add_count_probability( _count_probability.at( i ).at( j ) );
+    const double * column = _cumulative_probability.get() + i;
+    for ( unsigned int j = 0; j < _counts; j++ ) {
+      this_component->add_count_probability( column[ j * _components ] - (j ? column[ (j - 1) * _components ] : 0.0) );
     }
   }
   return ret;
 }
+
+static const char BINARY_MODEL_MAGIC[ 8 ] = { 'S', 'P', 'R', 'T', 'M', 'O', 'D', 'L' };
+static const uint32_t BINARY_MODEL_VERSION = 2;
+
+bool is_binary_model( const std::string & filename )
+{
+  int fd = open( filename.c_str(), O_RDONLY );
+  if ( fd < 0 ) {
+    return false;
+  }
+
+  char magic[ sizeof( BINARY_MODEL_MAGIC ) ];
+  const bool ret = ( read( fd, magic, sizeof( magic ) ) == sizeof( magic ) )
+    && !memcmp( magic, BINARY_MODEL_MAGIC, sizeof( magic ) );
+
+  close( fd );
+  return ret;
+}
+
+/* the mapping, unmapped when the last interval using it goes */
+class MappedModel
+{
+private:
+  void *_data;
+  size_t _size;
+
+public:
+  MappedModel( void *data, const size_t size ) : _data( data ), _size( size ) {}
+  ~MappedModel() { munmap( _data, _size ); }
+
+  const char *data( void ) const { return static_cast< const char * >( _data ); }
+
+  MappedModel( const MappedModel & ) = delete;
+  MappedModel & operator=( const MappedModel & ) = delete;
+};
+
+std::vector< ProcessForecastInterval > read_binary_model( const std::string & filename )
+{
+  int fd = open( filename.c_str(), O_RDONLY );
+  if ( fd < 0 ) {
+    fprintf( stderr, "Could not open %s.\n", filename.c_str() );
+    perror( "open" );
+    exit( 1 );
+  }
+
+  struct stat info;
+  if ( fstat( fd, &info ) < 0 ) {
+    perror( "fstat" );
+    exit( 1 );
+  }
+
+  const size_t size = info.st_size;
+  void *data = size ? mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+  if ( data == MAP_FAILED ) {
+    fprintf( stderr, "Could not map %s.\n", filename.c_str() );
+    perror( "mmap" );
+    exit( 1 );
+  }
+
+  if ( close( fd ) < 0 ) {
+    perror( "close" );
+    exit( 1 );
+  }
+
+  std::shared_ptr< MappedModel > mapping( new MappedModel( data, size ) );
+  const char *bytes = mapping->data();
+
+  uint32_t version, num_intervals;
+  if ( size < 16 ) {
+    fprintf( stderr, "%s: truncated model.\n", filename.c_str() );
+    exit( 1 );
+  }
+  memcpy( &version, bytes + 8, sizeof( version ) );
+  memcpy( &num_intervals, bytes + 12, sizeof( num_intervals ) );
+
+  if ( memcmp( bytes, BINARY_MODEL_MAGIC, sizeof( BINARY_MODEL_MAGIC ) ) || version != BINARY_MODEL_VERSION ) {
+    fprintf( stderr, "%s: not a binary model (or from a machine of the other byte order).\n", filename.c_str() );
+    exit( 1 );
+  }
+
+  size_t offset = 16 + 8 * size_t( num_intervals );
+  if ( offset > size ) {
+    fprintf( stderr, "%s: truncated model.\n", filename.c_str() );
+    exit( 1 );
+  }
+
+  std::vector< ProcessForecastInterval > ret;
+  for ( uint32_t i = 0; i < num_intervals; i++ ) {
+    uint32_t components, counts;
+    memcpy( &components, bytes + 16 + 8 * i, sizeof( components ) );
+    memcpy( &counts, bytes + 16 + 8 * i + 4, sizeof( counts ) );
+
+    const size_t table_size = sizeof( double ) * components * counts;
+    if ( table_size > size - offset ) {
+      fprintf( stderr, "%s: truncated model.\n", filename.c_str() );
+      exit( 1 );
+    }
+
+    /* shares ownership of the mapping */
+    const std::shared_ptr< const double > table( mapping, reinterpret_cast< const double * >( bytes + offset ) );
+    ret.emplace_back( table, components, counts );
+    offset += table_size;
+  }
+
+  return ret;
+}
+
+void write_binary_model( const std::string & filename, const std::vector< ProcessForecastInterval > & intervals )
+{
+  std::string header( BINARY_MODEL_MAGIC, sizeof( BINARY_MODEL_MAGIC ) );
+  const uint32_t version = BINARY_MODEL_VERSION, num_intervals = intervals.size();
+  header.append( reinterpret_cast< const char * >( &version ), sizeof( version ) );
+  header.append( reinterpret_cast< const char * >( &num_intervals ), sizeof( num_intervals ) );
+
+  for ( auto it = intervals.begin(); it != intervals.end(); it++ ) {
+    const uint32_t components = it->components(), counts = it->counts();
+    header.append( reinterpret_cast< const char * >( &components ), sizeof( components ) );
+    header.append( reinterpret_cast< const char * >( &counts ), sizeof( counts ) );
+  }
+
+  int fd = open( filename.c_str(), O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+  if ( fd < 0 ) {
+    fprintf( stderr, "Could not open %s.\n", filename.c_str() );
+    perror( "open" );
+    exit( 1 );
+  }
+
+  swrite( fd, header.data(), header.size() );
+  for ( auto it = intervals.begin(); it != intervals.end(); it++ ) {
+    swrite( fd, reinterpret_cast< const char * >( it->data() ), sizeof( double ) * it->components() * it->counts() );
+  }
+
+  if ( close( fd ) < 0 ) {
+    perror( "close" );
+    exit( 1 );
+  }
+}
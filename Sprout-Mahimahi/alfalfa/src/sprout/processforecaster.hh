@@ -5,6 +5,8 @@
 #include "sproutmath.pb.h"
 
 #include <vector>
+#include <memory>
+#include <string>
 
 class ProcessForecastTick
 {
@@ -23,24 +25,60 @@ public:
 class ProcessForecastInterval
 {
 private:
-  std::vector< std::vector< double > > _count_probability;
+  /* probability of at most each count, for each component: a row of
+     _components per count, so the ensemble's cumulative probability
+     at a count is one contiguous dot product */
+  std::shared_ptr< const double > _cumulative_probability;
+  unsigned int _components, _counts;
 
   static std::vector< double > convolve( const std::vector< double > & old_count_probabilities,
 					 const std::vector< double > & this_tick );
 
+  double cumulative_probability( const std::vector< double > & pmf, const unsigned int count ) const;
+
 public:
-  ProcessForecastInterval( const double tick_time,
-			   const Process & example,
-			   const unsigned int tick_upper_limit,
-			   const unsigned int num_ticks );
+  /* a table (e.g. in a mapped model file) that the owner keeps alive */
+  ProcessForecastInterval( const std::shared_ptr< const double > & cumulative_probability,
+			   const unsigned int components,
+			   const unsigned int counts );
 
   ProcessForecastInterval( const Sprout::ProcessForecastInterval &storedmodel );
 
+  /* the forecasts over 1, 2, ..., num_ticks ticks, made together (each
+     is the last one plus a tick), with the components split among
+     threads */
+  static std::vector< ProcessForecastInterval > make_intervals( const double tick_time,
+								const Process & example,
+								const unsigned int tick_upper_limit,
+								const unsigned int num_ticks );
+
   Sprout::ProcessForecastInterval to_protobuf( void ) const;
 
+  unsigned int components( void ) const { return _components; }
+  unsigned int counts( void ) const { return _counts; }
+  const double * data( void ) const { return _cumulative_probability.get(); }
+
   double probability( const Process & ensemble, unsigned int count ) const;
 
-  unsigned int lower_quantile( const Process & ensemble, const double x ) const;
+  /* searches out from hint (e.g. the last forecast's answer), so a
+     quantile that moves little is cheap to find */
+  unsigned int lower_quantile( const Process & ensemble, const double x, const unsigned int hint = 0 ) const;
 };
 
+/* A model (the forecasts for each interval) as one flat file that is
+   mapped, not parsed, so loading is immediate and every receiver on
+   the machine shares one copy of it in the page cache:
+
+   a 16-byte header ("SPRTMODL", u32 version, u32 number of intervals),
+   then, for each interval, u32 components and u32 counts, then each
+   interval's table of cumulative probabilities (doubles, counts x
+   components, row by row).
+   Everything is in the byte order of the machine that wrote it. */
+
+bool is_binary_model( const std::string & filename );
+
+/* exits with an error message if the model can't be read or written */
+std::vector< ProcessForecastInterval > read_binary_model( const std::string & filename );
+void write_binary_model( const std::string & filename, const std::vector< ProcessForecastInterval > & intervals );
+
 #endif
@@ -22,7 +22,12 @@ Receiver::Receiver()
     _recv_queue()
 {
   char *filename_in = getenv( "SPROUT_MODEL_IN" );
-  if ( filename_in ) {
+  if ( filename_in && is_binary_model( filename_in ) ) {
+    fprintf( stderr, "Mapping model from %s...", filename_in );
+    _forecastr = read_binary_model( filename_in );
+    assert( int( _forecastr.size() ) == NUM_TICKS );
+    fprintf( stderr, " done.\n" );
+  } else if ( filename_in ) {
     /* try to open */
     int fd = open( filename_in, O_RDONLY );
     if ( fd < 0 ) {
@@ -55,15 +60,10 @@ Receiver::Receiver()
     }
   } else {
     fprintf( stderr, "Starting statistical calculations..." );
-    for ( int i = 0; i < NUM_TICKS; i++ ) {
-      fprintf( stderr, "[tick %d", i );
-      ProcessForecastInterval one_forecast( .001 * TICK_LENGTH,
-					    _process,
-					    MAX_ARRIVALS_PER_TICK,
-					    i + 1 );
-      _forecastr.push_back( one_forecast );
-      fprintf( stderr, "] " );
-    }
+    _forecastr = ProcessForecastInterval::make_intervals( .001 * TICK_LENGTH,
+							  _process,
+							  MAX_ARRIVALS_PER_TICK,
+							  NUM_TICKS );
     fprintf( stderr, " done.\n" );
   }
 
@@ -97,6 +97,15 @@ Receiver::Receiver()
 
     fprintf( stderr, "done.\n" );
   }
+
+  /* the same model in the binary format, which SPROUT_MODEL_IN maps
+     instead of parsing, so every receiver that reads it shares one copy */
+  char *binary_filename_out = getenv( "SPROUT_BINARY_MODEL_OUT" );
+  if ( binary_filename_out ) {
+    fprintf( stderr, "Writing binary model to %s...", binary_filename_out );
+    write_binary_model( binary_filename_out, _forecastr );
+    fprintf( stderr, "done.\n" );
+  }
 }
 
 void Receiver::advance_to( const uint64_t time )
@@ -132,16 +141,21 @@ Sprout::DeliveryForecast Receiver::forecast( void )
   if ( _cached_forecast.time() == _time ) {
     return _cached_forecast;
   } else {
-    std::vector< int > counts;
-
     _process.normalize();
 
     _cached_forecast.set_received_or_lost_count( _recv_queue.packet_count() );
     _cached_forecast.set_time( _time );
-    _cached_forecast.clear_counts();
 
-    for ( auto it = _forecastr.begin(); it != _forecastr.end(); it++ ) {
-      _cached_forecast.add_counts( it->lower_quantile( _process, 0.05 ) );
+    /* the rate moves little from tick to tick, so start each search
+       from the last forecast's count */
+    for ( unsigned int i = 0; i < _forecastr.size(); i++ ) {
+      const unsigned int hint = ( int( i ) < _cached_forecast.counts_size() ) ? _cached_forecast.counts( i ) : 0;
+      const unsigned int count = _forecastr[ i ].lower_quantile( _process, 0.05, hint );
+      if ( int( i ) < _cached_forecast.counts_size() ) {
+	_cached_forecast.set_counts( i, count );
+      } else {
+	_cached_forecast.add_counts( count );
+      }
     }
 
     return _cached_forecast;
@@ -150,28 +164,24 @@ Sprout::DeliveryForecast Receiver::forecast( void )
 
 void Receiver::RecvQueue::recv( const uint64_t seq, const uint16_t throwaway_window, const int len )
 {
-  received_sequence_numbers.push( PacketLen( seq, len ) );
   throwaway_before = std::max( throwaway_before, seq - throwaway_window );
-}
 
-uint64_t Receiver::RecvQueue::packet_count( void )
-{
-  /* returns cumulative count of bytes received or lost */
-  while ( !received_sequence_numbers.empty() ) {
-    if ( received_sequence_numbers.top().seq < throwaway_before ) {
-      received_sequence_numbers.pop();
-    } else {
-      break;
-    }
+  /* evict what the sender no longer counts on */
+  while ( !received_sequence_numbers.empty()
+	  && received_sequence_numbers.front().seq < throwaway_before ) {
+    buffer_sum -= received_sequence_numbers.front().len;
+    received_sequence_numbers.pop_front();
   }
 
-  std::priority_queue< PacketLen, std::deque<PacketLen>, PacketLen > copy( received_sequence_numbers );
-
-  int buffer_sum = 0;
-  while ( !copy.empty() ) {
-    buffer_sum += copy.top().len;
-    copy.pop();
+  if ( seq < throwaway_before ) {
+    return;
   }
 
-  return throwaway_before + buffer_sum;
+  /* insert in order, looking from the back (where in-order packets go) */
+  auto it = received_sequence_numbers.end();
+  while ( it != received_sequence_numbers.begin() && (it - 1)->seq > seq ) {
+    it--;
+  }
+  received_sequence_numbers.insert( it, PacketLen( seq, len ) );
+  buffer_sum += len;
 }
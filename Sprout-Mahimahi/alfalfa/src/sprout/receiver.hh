@@ -2,7 +2,7 @@
 #define RECEIVER_HH
 
 #include <stdint.h>
-#include <queue>
+#include <deque>
 
 #include "process.hh"
 #include "processforecaster.hh"
@@ -20,30 +20,41 @@ private:
   static const int MAX_ARRIVALS_PER_TICK = 30;
   static const int NUM_TICKS = 8;
 
+public:
+  /* The packets received at or after throwaway_before, in order of
+     sequence number, with the sum of their lengths. The throwaway
+     window is 16 bits, so throwaway_before is never more than 64 KiB
+     of sequence space behind the highest sequence number seen, and
+     the queue holds at most an entry for each packet (and duplicate)
+     in that span. An in-order packet goes on the back in constant
+     time, but one that arrives late walks back over the n packets
+     queued after it, and one far enough ahead of the window evicts
+     the whole queue: both O(n).
+
+     (Public so the tests can check it against the priority queue it
+     replaced.) */
   class RecvQueue {
   private:
     class PacketLen {
     public:
       uint64_t seq;
       int len;
-      bool operator()( const PacketLen & a, const PacketLen & b ) const
-      {
-	return a.seq > b.seq;
-      }
       PacketLen( const uint64_t s_seq, const int s_len ) : seq( s_seq ), len( s_len ) {}
       PacketLen( void ) : seq( -1 ), len( 0 ) {}
     };
 
-    std::priority_queue< PacketLen, std::deque<PacketLen>, PacketLen > received_sequence_numbers;
+    std::deque< PacketLen > received_sequence_numbers;
     uint64_t throwaway_before;
+    uint64_t buffer_sum;
 
   public:
-    RecvQueue() : received_sequence_numbers(), throwaway_before( 0 ) {}
+    RecvQueue() : received_sequence_numbers(), throwaway_before( 0 ), buffer_sum( 0 ) {}
 
     void recv( const uint64_t seq, const uint16_t throwaway_window, int len );
-    uint64_t packet_count( void );
+    uint64_t packet_count( void ) const { return throwaway_before + buffer_sum; }
   };
 
+private:
   Process _process;
 
   std::vector< ProcessForecastInterval > _forecastr;
@@ -4,6 +4,7 @@
 #include <vector>
 #include <functional>
 #include <limits.h>
+#include <assert.h>
 
 static double BIG = 1.e6;
 
@@ -43,6 +44,10 @@ public:
 
   const SampledFunction & operator=( const SampledFunction & other );
 
+  /* raw samples, for kernels that work on the whole function at once */
+  const std::vector< double > & values( void ) const { return _function; }
+  void swap_values( std::vector< double > & other ) { assert( other.size() == _function.size() ); _function.swap( other ); }
+
   double lower_quantile( const double x ) const;
 
   double summation( const std::vector< std::vector< double > > & count_probability,
@@ -0,0 +1,328 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+/* Tests Sprout's forecast model: the intervals made in parallel match
+   ones made component by component, as the model used to be built,
+   a model written in the binary format reads back unchanged, and a
+   forecast's quantile doesn't depend on where its search starts. Also
+   checks that the receiver counts bytes received or lost as it did
+   with a priority queue, through reordering, loss and duplicates. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <random>
+#include <algorithm>
+
+#include "processforecaster.hh"
+#include "receiver.hh"
+#include "fatal_assert.h"
+
+/* as the receiver makes its model, but with fewer ticks */
+const double MAX_ARRIVAL_RATE = 1000;
+const double BROWNIAN_MOTION_RATE = 200;
+const double OUTAGE_ESCAPE_RATE = 1;
+const int NUM_BINS = 256;
+const double TICK_TIME = .02;
+const unsigned int MAX_ARRIVALS_PER_TICK = 30;
+const unsigned int NUM_TICKS = 4;
+
+bool verbose = true;
+
+/* the distribution of arrivals over 1, 2, ..., NUM_TICKS ticks, for each
+   component: the serial build the parallel one replaced */
+std::vector< std::vector< std::vector< double > > > serial_forecasts( const Process & example )
+{
+  std::vector< Process > components( ProcessForecastTick::make_components( example ) );
+  ProcessForecastTick tick_forecast( TICK_TIME, example, MAX_ARRIVALS_PER_TICK );
+
+  /* by interval, then component, then count */
+  std::vector< std::vector< std::vector< double > > > ret( NUM_TICKS );
+
+  for ( auto it = components.begin(); it != components.end(); it++ ) {
+    std::vector< double > count_probability( 1, 1.0 );
+    for ( unsigned int tick = 0; tick < NUM_TICKS; tick++ ) {
+      std::vector< double > this_tick;
+      for ( unsigned int i = 0; i < MAX_ARRIVALS_PER_TICK; i++ ) {
+	it->normalize();
+	this_tick.push_back( tick_forecast.probability( *it, i ) );
+      }
+
+      /* convolve with the forecast over the ticks so far */
+      std::vector< double > sum( count_probability.size() + this_tick.size() - 1 );
+      for ( unsigned int old_count = 0; old_count < count_probability.size(); old_count++ ) {
+	for ( unsigned int new_count = 0; new_count < this_tick.size(); new_count++ ) {
+	  sum[ old_count + new_count ] += count_probability[ old_count ] * this_tick[ new_count ];
+	}
+      }
+      count_probability = sum;
+
+      ret[ tick ].push_back( count_probability );
+
+      it->evolve( TICK_TIME );
+    }
+  }
+
+  return ret;
+}
+
+void test_parallel_build( const Process & example, const std::vector< ProcessForecastInterval > & intervals )
+{
+  const std::vector< std::vector< std::vector< double > > > serial = serial_forecasts( example );
+
+  fatal_assert( intervals.size() == NUM_TICKS );
+
+  for ( unsigned int tick = 0; tick < NUM_TICKS; tick++ ) {
+    const ProcessForecastInterval & interval = intervals[ tick ];
+    fatal_assert( interval.components() == serial[ tick ].size() );
+    fatal_assert( interval.counts() == serial[ tick ][ 0 ].size() );
+
+    /* the table holds each component's cumulative probabilities */
+    for ( unsigned int component = 0; component < interval.components(); component++ ) {
+      double cumulative = 0.0;
+      for ( unsigned int count = 0; count < interval.counts(); count++ ) {
+	cumulative += serial[ tick ][ component ][ count ];
+	fatal_assert( fabs( interval.data()[ count * interval.components() + component ] - cumulative ) < 1e-12 );
+      }
+    }
+  }
+
+  if ( verbose ) {
+    printf( "parallel build matches serial build: %u intervals of %u components\n",
+	    NUM_TICKS, intervals[ 0 ].components() );
+  }
+}
+
+void test_binary_model( const std::vector< ProcessForecastInterval > & intervals )
+{
+  char filename[] = "/tmp/sprout-forecast.XXXXXX";
+  int fd = mkstemp( filename );
+  fatal_assert( fd >= 0 );
+  fatal_assert( close( fd ) == 0 );
+
+  write_binary_model( filename, intervals );
+  fatal_assert( is_binary_model( filename ) );
+
+  const std::vector< ProcessForecastInterval > read_back = read_binary_model( filename );
+  fatal_assert( unlink( filename ) == 0 ); /* the mapping outlives the name */
+
+  fatal_assert( read_back.size() == intervals.size() );
+  for ( unsigned int i = 0; i < intervals.size(); i++ ) {
+    fatal_assert( read_back[ i ].components() == intervals[ i ].components() );
+    fatal_assert( read_back[ i ].counts() == intervals[ i ].counts() );
+    fatal_assert( !memcmp( read_back[ i ].data(), intervals[ i ].data(),
+			   sizeof( double ) * intervals[ i ].components() * intervals[ i ].counts() ) );
+  }
+
+  if ( verbose ) {
+    printf( "binary model round-trips\n" );
+  }
+}
+
+/* the ensemble's probability of at most count arrivals, straight from the table */
+double cumulative( const ProcessForecastInterval & interval, const Process & ensemble, const unsigned int count )
+{
+  double ret = 0.0;
+  for ( unsigned int component = 0; component < interval.components(); component++ ) {
+    ret += ensemble.pmf().values()[ component ] * interval.data()[ count * interval.components() + component ];
+  }
+  return ret;
+}
+
+void test_quantile_hints( const std::vector< ProcessForecastInterval > & intervals )
+{
+  /* arrivals per tick: bursts, lulls and outages, as the receiver sees them */
+  const int arrivals[] = { 0, 3, 10, 25, 8, 0, 0, 1, 14, 30, 30, 30, 28, 29, 30, 2, 0, 0, 0, 0, 0 };
+  const unsigned int num_arrivals = sizeof( arrivals ) / sizeof( arrivals[ 0 ] );
+
+  Process ensemble( MAX_ARRIVAL_RATE, BROWNIAN_MOTION_RATE, OUTAGE_ESCAPE_RATE, NUM_BINS );
+  std::vector< unsigned int > last( intervals.size(), 0 );
+  unsigned int checks = 0;
+
+  for ( unsigned int tick = 0; tick < 500; tick++ ) {
+    ensemble.evolve( TICK_TIME );
+    ensemble.observe( TICK_TIME, arrivals[ (tick / 3) % num_arrivals ] );
+    ensemble.normalize();
+
+    for ( unsigned int i = 0; i < intervals.size(); i++ ) {
+      const ProcessForecastInterval & interval = intervals[ i ];
+      const unsigned int quantile = interval.lower_quantile( ensemble, 0.05 );
+
+      /* the first count whose cumulative probability reaches 5% (or past the end) */
+      if ( quantile < interval.counts() ) {
+	fatal_assert( cumulative( interval, ensemble, quantile ) >= 0.05 - 1e-12 );
+	fatal_assert( quantile == 0 || cumulative( interval, ensemble, quantile - 1 ) < 0.05 + 1e-12 );
+      } else {
+	fatal_assert( quantile == interval.counts() + 1 );
+      }
+
+      /* any hint gives the same answer: the receiver's (the last answer),
+	 ones nearby, the ends of the table, and past it */
+      const unsigned int hints[] = { last[ i ], quantile, quantile + 1, quantile > 0 ? quantile - 1 : 0,
+				     interval.counts() / 2, interval.counts() - 1, interval.counts() + 10 };
+      for ( unsigned int h = 0; h < sizeof( hints ) / sizeof( hints[ 0 ] ); h++ ) {
+	fatal_assert( interval.lower_quantile( ensemble, 0.05, hints[ h ] ) == quantile );
+	checks++;
+      }
+
+      last[ i ] = quantile;
+    }
+  }
+
+  if ( verbose ) {
+    printf( "quantiles agree for every hint (%u searches)\n", checks );
+  }
+}
+
+/* the receive queue as it was: every packet goes in a priority queue,
+   and counting pops the ones thrown away and sums a copy of the rest */
+class PriorityRecvQueue {
+private:
+  class PacketLen {
+  public:
+    uint64_t seq;
+    int len;
+    bool operator()( const PacketLen & a, const PacketLen & b ) const
+    {
+      return a.seq > b.seq;
+    }
+    PacketLen( const uint64_t s_seq, const int s_len ) : seq( s_seq ), len( s_len ) {}
+    PacketLen( void ) : seq( -1 ), len( 0 ) {}
+  };
+
+  std::priority_queue< PacketLen, std::deque<PacketLen>, PacketLen > received_sequence_numbers;
+  uint64_t throwaway_before;
+
+public:
+  PriorityRecvQueue() : received_sequence_numbers(), throwaway_before( 0 ) {}
+
+  void recv( const uint64_t seq, const uint16_t throwaway_window, int len )
+  {
+    received_sequence_numbers.push( PacketLen( seq, len ) );
+    throwaway_before = std::max( throwaway_before, seq - throwaway_window );
+  }
+
+  uint64_t packet_count( void )
+  {
+    while ( !received_sequence_numbers.empty()
+	    && received_sequence_numbers.top().seq < throwaway_before ) {
+      received_sequence_numbers.pop();
+    }
+
+    std::priority_queue< PacketLen, std::deque<PacketLen>, PacketLen > copy( received_sequence_numbers );
+
+    int buffer_sum = 0;
+    while ( !copy.empty() ) {
+      buffer_sum += copy.top().len;
+      copy.pop();
+    }
+
+    return throwaway_before + buffer_sum;
+  }
+};
+
+void test_recv_queue( void )
+{
+  std::mt19937 prng( 7 );
+
+  /* packets as the sender numbers them: by the bytes sent before */
+  std::vector< std::pair< uint64_t, int > > sent;
+  uint64_t next_seq = 0;
+  for ( unsigned int i = 0; i < 50000; i++ ) {
+    const int len = 50 + prng() % 1400;
+    sent.push_back( std::make_pair( next_seq, len ) );
+    next_seq += len;
+
+    /* now and then, a gap (as from packets lost before the bottleneck) */
+    if ( prng() % 1000 == 0 ) {
+      next_seq += 100000;
+    }
+  }
+
+  /* reorder locally, now and then by more than a window's worth */
+  for ( size_t i = 0; i + 16 < sent.size(); i += 8 ) {
+    std::shuffle( sent.begin() + i, sent.begin() + i + 8 + prng() % 8, prng );
+  }
+  for ( unsigned int i = 0; i < 50; i++ ) {
+    const size_t from = prng() % (sent.size() - 200);
+    std::swap( sent[ from ], sent[ from + 100 + prng() % 100 ] );
+  }
+
+  Receiver::RecvQueue queue;
+  PriorityRecvQueue reference;
+  unsigned int received = 0;
+
+  for ( size_t i = 0; i < sent.size(); i++ ) {
+    /* lose some, and duplicate some */
+    if ( prng() % 20 == 0 ) {
+      continue;
+    }
+
+    const unsigned int copies = prng() % 10 == 0 ? 2 : 1;
+    for ( unsigned int copy = 0; copy < copies; copy++ ) {
+      const uint64_t seq = sent[ i ].first;
+      const uint16_t window = std::min< uint64_t >( seq, 20000 + prng() % 45536 );
+
+      queue.recv( seq, window, sent[ i ].second );
+      reference.recv( seq, window, sent[ i ].second );
+      fatal_assert( queue.packet_count() == reference.packet_count() );
+      received++;
+    }
+  }
+
+  if ( verbose ) {
+    printf( "receive queue matches priority queue (%u packets)\n", received );
+  }
+}
+
+int main( int argc, char *argv[] ) {
+  if ( ( argc >= 2 ) && !strcmp( argv[ 1 ], "-q" ) ) {
+    verbose = false;
+  }
+
+  Process example( MAX_ARRIVAL_RATE, BROWNIAN_MOTION_RATE, OUTAGE_ESCAPE_RATE, NUM_BINS );
+
+  const std::vector< ProcessForecastInterval > intervals
+    = ProcessForecastInterval::make_intervals( TICK_TIME, example, MAX_ARRIVALS_PER_TICK, NUM_TICKS );
+
+  test_parallel_build( example, intervals );
+  test_binary_model( intervals );
+  test_quantile_hints( intervals );
+  test_recv_queue();
+
+  return 0;
+}
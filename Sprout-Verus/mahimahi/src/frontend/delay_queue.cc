@@ -1,37 +1,132 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <limits>
+#include <fstream>
+#include <cmath>
 
 #include "delay_queue.hh"
 #include "timestamp.hh"
+#include "ezio.hh"
+#include "util.hh"
 
 using namespace std;
 
-void DelayQueue::read_packet( const string & contents )
+DelayQueue::DelayQueue( const uint64_t & s_delay_ns,
+                        const uint64_t & s_jitter_ns,
+                        const string & jitter_distribution,
+                        const string & delay_trace_filename )
+    : delay_ns_( s_delay_ns ),
+      jitter_ns_( s_jitter_ns ),
+      jitter_is_normal_( false ),
+      prng_( random_device()() ),
+      uniform_jitter_( -1.0, 1.0 ),
+      normal_jitter_( 0.0, 1.0 ),
+      delay_trace_(),
+      next_trace_entry_( 0 ),
+      wheel_( timestamp_ns() ),
+      output_queue_()
 {
-    packet_queue_.emplace( timestamp() + delay_ms_, contents );
+    if ( jitter_distribution == "normal" ) {
+        jitter_is_normal_ = true;
+    } else if ( jitter_distribution != "uniform" ) {
+        throw runtime_error( "unknown jitter distribution: " + jitter_distribution );
+    }
+
+    if ( not delay_trace_filename.empty() ) {
+        assert_not_root();
+
+        /* one delay per line, in (possibly fractional) milliseconds */
+        ifstream trace_file( delay_trace_filename );
+        if ( not trace_file.good() ) {
+            throw runtime_error( delay_trace_filename + ": error opening for reading" );
+        }
+
+        string line;
+        while ( trace_file.good() and getline( trace_file, line ) ) {
+            const double ms = myatof( line );
+            if ( not (ms >= 0) ) {
+                throw runtime_error( delay_trace_filename + ": delays must be non-negative" );
+            }
+            delay_trace_.push_back( llround( ms * NS_PER_MS ) );
+        }
+
+        if ( delay_trace_.empty() ) {
+            throw runtime_error( delay_trace_filename + ": no delays found" );
+        }
+    }
+}
+
+uint64_t DelayQueue::packet_delay( void )
+{
+    int64_t delay = delay_ns_;
+
+    if ( not delay_trace_.empty() ) {
+        delay += delay_trace_[ next_trace_entry_ ];
+        next_trace_entry_ = (next_trace_entry_ + 1) % delay_trace_.size();
+    }
+
+    if ( jitter_ns_ ) {
+        const double sample = jitter_is_normal_ ? normal_jitter_( prng_ ) : uniform_jitter_( prng_ );
+        delay += llround( sample * jitter_ns_ );
+    }
+
+    return max( delay, int64_t( 0 ) );
+}
+
+/* release everything that is due by now into the output queue */
+void DelayQueue::rationalize( const uint64_t now )
+{
+    PacketBuffer packet;
+
+    while ( wheel_.pop_due( now, packet ) ) {
+        output_queue_.push( move( packet ) );
+    }
+}
+
+void DelayQueue::read_packet( PacketBuffer && contents )
+{
+    const uint64_t now = timestamp_ns();
+
+    rationalize( now );
+
+    wheel_.insert( now + packet_delay(), move( contents ) );
 }
 
 void DelayQueue::write_packets( FileDescriptor & fd )
 {
-    while ( (!packet_queue_.empty())
-            && (packet_queue_.front().first <= timestamp()) ) {
-        fd.write( packet_queue_.front().second );
-        packet_queue_.pop();
+    while ( not output_queue_.empty() ) {
+        fd.write( output_queue_.front().data(), output_queue_.front().size() );
+        output_queue_.pop();
     }
 }
 
-unsigned int DelayQueue::wait_time( void ) const
+bool DelayQueue::pop_output( PacketBuffer & packet )
 {
-    if ( packet_queue_.empty() ) {
-        return numeric_limits<uint16_t>::max();
+    if ( output_queue_.empty() ) {
+        return false;
     }
 
-    const auto now = timestamp();
+    packet = move( output_queue_.front() );
+    output_queue_.pop();
+    return true;
+}
+
+uint64_t DelayQueue::wait_time( void )
+{
+    const uint64_t now = timestamp_ns();
+
+    rationalize( now );
 
-    if ( packet_queue_.front().first <= now ) {
+    if ( not output_queue_.empty() ) {
         return 0;
-    } else {
-        return packet_queue_.front().first - now;
     }
+
+    if ( wheel_.empty() ) {
+        return numeric_limits<uint64_t>::max();
+    }
+
+    /* a lower bound: we may wake to find a packet has only moved down the wheel */
+    const uint64_t next = wheel_.next_release_bound();
+
+    return next > now ? next - now : 0;
 }
@@ -4,28 +4,58 @@
 #define DELAY_QUEUE_HH
 
 #include <queue>
+#include <vector>
 #include <cstdint>
 #include <string>
+#include <random>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
+#include "timing_wheel.hh"
+
+/* Delays each packet by a fixed delay, plus (optionally) random jitter
+   and an offset taken in turn from a trace. Packets are released when
+   their own delay has elapsed, so with jitter they may be reordered. */
 
 class DelayQueue
 {
 private:
-    uint64_t delay_ms_;
-    std::queue< std::pair<uint64_t, std::string> > packet_queue_;
-    /* release timestamp, contents */
+    uint64_t delay_ns_;
+
+    /* jitter */
+    uint64_t jitter_ns_;
+    bool jitter_is_normal_; /* otherwise uniform over +/- jitter */
+    std::default_random_engine prng_;
+    std::uniform_real_distribution<> uniform_jitter_;
+    std::normal_distribution<> normal_jitter_;
+
+    /* per-packet delays from a trace (ns), used cyclically */
+    std::vector<uint64_t> delay_trace_;
+    size_t next_trace_entry_;
+
+    TimingWheel wheel_;
+    std::queue<PacketBuffer> output_queue_;
+
+    uint64_t packet_delay( void );
+    void rationalize( const uint64_t now );
 
 public:
-    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_() {}
+    DelayQueue( const uint64_t & s_delay_ns,
+                const uint64_t & s_jitter_ns = 0,
+                const std::string & jitter_distribution = "uniform",
+                const std::string & delay_trace_filename = "" );
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void ) const;
+    /* take the next packet that is ready to leave, if any (instead of
+       writing it to a device, e.g. in a SimulatedPath) */
+    bool pop_output( PacketBuffer & packet );
+
+    uint64_t wait_time( void ); /* ns */
 
-    bool pending_output( void ) const { return wait_time() <= 0; }
+    bool pending_output( void ) const { return not output_queue_.empty(); }
 
     static bool finished( void ) { return false; }
 };
@@ -2,14 +2,42 @@
 
 #include <vector>
 #include <string>
+#include <cmath>
+
+#include <getopt.h>
 
 #include "delay_queue.hh"
 #include "util.hh"
 #include "ezio.hh"
+#include "timestamp.hh"
 #include "packetshell.cc"
 
 using namespace std;
 
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]... DELAY [COMMAND...]" << endl;
+    cerr << endl;
+    cerr << "Options = --jitter=MILLISECONDS" << endl;
+    cerr << "          --jitter-distribution=uniform|normal" << endl;
+    cerr << "          --delay-trace=FILENAME" << endl;
+    cerr << endl;
+    cerr << "          DELAY and jitter are in milliseconds and may be fractional." << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* parse a nonnegative, possibly fractional, number of milliseconds */
+uint64_t parse_ms( const string & str )
+{
+    const double ms = myatof( str );
+    if ( not (ms >= 0) ) {
+        throw runtime_error( "delay must be non-negative: " + str );
+    }
+
+    return llround( ms * NS_PER_MS );
+}
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -19,28 +47,74 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " delay-milliseconds [command...]" );
+        const option command_line_options[] = {
+            { "jitter",               required_argument, nullptr, 'j' },
+            { "jitter-distribution",  required_argument, nullptr, 'r' },
+            { "delay-trace",          required_argument, nullptr, 't' },
+            { 0,                                      0, nullptr, 0 }
+        };
+
+        uint64_t jitter_ns = 0;
+        string jitter_distribution = "uniform", delay_trace;
+        string jitter_description;
+
+        while ( true ) {
+            /* stop at the first non-option (the delay), so the command can have options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'j':
+                jitter_ns = parse_ms( optarg );
+                jitter_description = optarg;
+                break;
+            case 'r':
+                jitter_distribution = optarg;
+                break;
+            case 't':
+                delay_trace = optarg;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
         }
 
-        const uint64_t delay_ms = myatoi( argv[ 1 ] );
+        if ( optind >= argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const uint64_t delay_ns = parse_ms( argv[ optind ] );
 
         vector< string > command;
 
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
+        string prefix = "[delay " + string( argv[ optind ] );
+        if ( jitter_ns ) {
+            prefix += " +/- " + jitter_description;
+        }
+        if ( not delay_trace.empty() ) {
+            prefix += " + trace";
+        }
+        prefix += " ms] ";
+
         PacketShell<DelayQueue> delay_shell_app( "delay", user_environment );
 
-        delay_shell_app.start_uplink( "[delay " + to_string( delay_ms ) + " ms] ",
+        delay_shell_app.start_uplink( prefix,
                                       command,
-                                      delay_ms );
-        delay_shell_app.start_downlink( delay_ms );
+                                      delay_ns, jitter_ns, jitter_distribution, delay_trace );
+        delay_shell_app.start_downlink( delay_ns, jitter_ns, jitter_distribution, delay_trace );
         return delay_shell_app.wait_for_exit();
     } catch ( const exception & e ) {
         print_exception( e );
@@ -0,0 +1,285 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <endian.h>
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include "link_log.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const char BINARY_LOG_MAGIC[ 8 ] = { 'M', 'M', 'L', 'I', 'N', 'K', 'L', 'G' };
+static const uint32_t BINARY_LOG_VERSION = 1;
+static const size_t BINARY_LOG_HEADER_SIZE = 16;
+static const size_t BINARY_LOG_EVENT_SIZE = 24;
+
+static const size_t RING_CAPACITY = 1 << 16; /* events */
+static const size_t WRITE_SIZE = 1 << 20;    /* bytes */
+
+template <typename T>
+static void append_field( string & buffer, const T & field )
+{
+    buffer.append( reinterpret_cast<const char *>( &field ), sizeof( field ) );
+}
+
+template <typename T>
+static T read_field( const char * data, const size_t offset )
+{
+    T ret;
+    memcpy( &ret, data + offset, sizeof( ret ) );
+    return ret;
+}
+
+LinkLog::LinkLog( const string & filename, const bool binary, const string & comments )
+    : fd_( SystemCall( "open " + filename, open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) ),
+      binary_( binary ),
+      ring_( RING_CAPACITY ),
+      has_events_(),
+      has_room_(),
+      finishing_( false ),
+      failed_( false ),
+      writer_()
+{
+    if ( binary_ ) {
+        string header( BINARY_LOG_MAGIC, sizeof( BINARY_LOG_MAGIC ) );
+        append_field( header, htole32( BINARY_LOG_VERSION ) );
+        append_field( header, htole32( comments.size() ) );
+        fd_.write( header + comments );
+    } else if ( not comments.empty() ) {
+        fd_.write( comments );
+    }
+
+    writer_ = thread( [&] () { write_events(); } );
+}
+
+LinkLog::~LinkLog()
+{
+    try {
+        finishing_ = true;
+        has_events_.ring();
+        writer_.join();
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
+
+void LinkLog::add( const LinkLogEvent & event )
+{
+    bool pushed = ring_.push( event );
+
+    /* the ring only fills if the disk can't keep up */
+    if ( not pushed ) {
+        has_room_.wait_until( [&] () { return failed_ or (pushed = ring_.push( event )); } );
+
+        if ( not pushed ) {
+            throw runtime_error( "LinkLog: writer thread has stopped" );
+        }
+    }
+
+    has_events_.ring_if_waiting();
+}
+
+void LinkLog::opportunity( const uint64_t time, uint64_t bytes )
+{
+    /* a run of opportunities can be more than an event holds */
+    while ( bytes > UINT32_MAX ) {
+        add( { time, 0, UINT32_MAX, '#' } );
+        bytes -= UINT32_MAX;
+    }
+
+    add( { time, 0, uint32_t( bytes ), '#' } );
+}
+
+string format_link_log_event( const LinkLogEvent & event )
+{
+    string line = to_string( event.time / NS_PER_MS ) + " " + event.type + " " + to_string( event.bytes );
+
+    if ( event.type == '-' ) {
+        line += " " + to_string( event.delay / NS_PER_MS );
+    }
+
+    return line + "\n";
+}
+
+/* parse the digits at p (advancing it), or throw */
+static uint64_t parse_number( const char * & p, const char * const end, const char * const what )
+{
+    if ( p == end or *p < '0' or *p > '9' ) {
+        throw runtime_error( string( "invalid " ) + what );
+    }
+
+    uint64_t ret = 0;
+    while ( p != end and *p >= '0' and *p <= '9' ) {
+        ret = ret * 10 + (*p - '0');
+        p++;
+    }
+
+    return ret;
+}
+
+static void skip_spaces( const char * & p, const char * const end )
+{
+    while ( p != end and (*p == ' ' or *p == '\t') ) {
+        p++;
+    }
+}
+
+LinkLogEvent parse_link_log_line( const char * p, const char * const end )
+{
+    LinkLogEvent event { parse_number( p, end, "timestamp" ) * NS_PER_MS, 0, 0, 0 };
+    skip_spaces( p, end );
+    if ( p == end ) {
+        throw runtime_error( "Format: timestamp event_type num_bytes [delay]" );
+    }
+    event.type = *p++;
+    skip_spaces( p, end );
+    event.bytes = parse_number( p, end, "byte count" );
+    skip_spaces( p, end );
+    if ( event.type == '-' ) {
+        event.delay = parse_number( p, end, "delay" ) * NS_PER_MS;
+    }
+
+    return event;
+}
+
+uint64_t link_log_base_timestamp( const char * p, const char * const end )
+{
+    static const char BASE_TIMESTAMP[] = "# base timestamp: ";
+
+    while ( p != end and *p == '#' ) {
+        const char * const eol = find( p, end, '\n' );
+        if ( size_t( eol - p ) > strlen( BASE_TIMESTAMP )
+             and not memcmp( p, BASE_TIMESTAMP, strlen( BASE_TIMESTAMP ) ) ) {
+            p += strlen( BASE_TIMESTAMP );
+            return parse_number( p, eol, "base timestamp" );
+        }
+        p = eol == end ? end : eol + 1;
+    }
+
+    throw runtime_error( "logfile is missing base timestamp" );
+}
+
+/* the writer thread */
+void LinkLog::write_events( void )
+{
+    try {
+        string buffer;
+        LinkLogEvent event;
+
+        while ( true ) {
+            has_events_.wait_until( [&] () { return finishing_ or ring_.front(); } );
+
+            const bool finishing = finishing_;
+
+            while ( ring_.pop( event ) ) {
+                has_room_.ring_if_waiting();
+
+                if ( binary_ ) {
+                    append_field( buffer, htole64( event.time ) );
+                    append_field( buffer, htole64( event.delay ) );
+                    append_field( buffer, htole32( event.bytes ) );
+                    buffer.append( 1, event.type );
+                    buffer.append( 3, 0 );
+                } else {
+                    buffer += format_link_log_event( event );
+                }
+
+                if ( buffer.size() >= WRITE_SIZE ) {
+                    fd_.write( buffer );
+                    buffer.clear();
+                }
+            }
+
+            if ( not buffer.empty() ) {
+                fd_.write( buffer );
+                buffer.clear();
+            }
+
+            if ( finishing ) {
+                return;
+            }
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        failed_ = true;
+        has_room_.ring();
+    }
+}
+
+BinaryLinkLogReader::BinaryLinkLogReader( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      comments_(),
+      events_offset_( 0 ),
+      offset_( 0 )
+{
+    if ( file_.size() < BINARY_LOG_HEADER_SIZE
+         or memcmp( file_.data(), BINARY_LOG_MAGIC, sizeof( BINARY_LOG_MAGIC ) ) ) {
+        throw runtime_error( filename_ + ": not a binary mm-link log" );
+    }
+
+    if ( le32toh( read_field<uint32_t>( file_.data(), 8 ) ) != BINARY_LOG_VERSION ) {
+        throw runtime_error( filename_ + ": unsupported binary log version" );
+    }
+
+    const uint32_t comments_length = le32toh( read_field<uint32_t>( file_.data(), 12 ) );
+    if ( comments_length > file_.size() - BINARY_LOG_HEADER_SIZE ) {
+        throw runtime_error( filename_ + ": truncated binary log header" );
+    }
+
+    comments_.assign( file_.data() + BINARY_LOG_HEADER_SIZE, comments_length );
+    events_offset_ = offset_ = BINARY_LOG_HEADER_SIZE + comments_length;
+}
+
+size_t BinaryLinkLogReader::size( void ) const
+{
+    return (file_.size() - events_offset_) / BINARY_LOG_EVENT_SIZE;
+}
+
+void BinaryLinkLogReader::seek( const size_t index )
+{
+    if ( index > size() ) {
+        throw runtime_error( filename_ + ": seek past end of log" );
+    }
+
+    offset_ = events_offset_ + index * BINARY_LOG_EVENT_SIZE;
+}
+
+bool BinaryLinkLogReader::next( LinkLogEvent & event )
+{
+    if ( file_.size() - offset_ < BINARY_LOG_EVENT_SIZE ) {
+        return false;
+    }
+
+    const char * const data = file_.data() + offset_;
+    event.time = le64toh( read_field<uint64_t>( data, 0 ) );
+    event.delay = le64toh( read_field<uint64_t>( data, 8 ) );
+    event.bytes = le32toh( read_field<uint32_t>( data, 16 ) );
+    event.type = data[ 20 ];
+
+    if ( event.type != '+' and event.type != '-' and event.type != '#' ) {
+        throw runtime_error( filename_ + ": invalid event at offset " + to_string( offset_ ) );
+    }
+
+    offset_ += BINARY_LOG_EVENT_SIZE;
+    return true;
+}
+
+bool is_binary_link_log( const string & filename )
+{
+    ifstream log_file( filename, ios::binary );
+
+    char magic[ sizeof( BINARY_LOG_MAGIC ) ];
+    if ( not log_file.read( magic, sizeof( magic ) ) ) {
+        return false;
+    }
+
+    return not memcmp( magic, BINARY_LOG_MAGIC, sizeof( magic ) );
+}
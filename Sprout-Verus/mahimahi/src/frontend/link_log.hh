@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_LOG_HH
+#define LINK_LOG_HH
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <thread>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+#include "spsc_ring.hh"
+#include "doorbell.hh"
+
+/* An mm-link log: a few comment lines describing the link, then one
+   event per arrival ("+"), departure ("-") or run of delivery
+   opportunities ("#"). Logs come in two formats:
+
+   text:   "# comment" lines, then "T + BYTES", "T - BYTES DELAY" or
+           "T # BYTES" lines, with times in integer milliseconds.
+
+   binary: a 16-byte header ("MMLINKLG", u32 version, u32 length of
+           the comments), the comment lines as in the text format, then
+           24-byte events: u64 time in ns, u64 queueing delay in ns
+           (departures only), u32 bytes, u8 type ('+', '-' or '#') and
+           three bytes of padding. Everything is little-endian.
+
+   LinkLog keeps the formatting and the writing off the packet path:
+   events go into a lock-free ring, and a background thread drains the
+   ring into the file (in either format) in large writes. The thread
+   sleeps while the ring is empty, and if the ring fills (the disk
+   can't keep up), the packet path waits for room rather than losing
+   events. */
+
+struct LinkLogEvent
+{
+    uint64_t time;  /* ns */
+    uint64_t delay; /* ns */
+    uint32_t bytes;
+    char type;
+};
+
+class LinkLog
+{
+private:
+    FileDescriptor fd_;
+    bool binary_;
+
+    SPSCRing<LinkLogEvent> ring_;
+    Doorbell has_events_, has_room_; /* wake the writer, and a producer waiting on it */
+    std::atomic<bool> finishing_, failed_;
+    std::thread writer_;
+
+    void add( const LinkLogEvent & event );
+    void write_events( void );
+
+public:
+    /* comments are the "# ..." lines, each ending in a newline */
+    LinkLog( const std::string & filename, const bool binary, const std::string & comments );
+    ~LinkLog();
+
+    /* times in ns */
+    void arrival( const uint64_t time, const uint32_t bytes ) { add( { time, 0, bytes, '+' } ); }
+    void departure( const uint64_t time, const uint32_t bytes, const uint64_t delay ) { add( { time, delay, bytes, '-' } ); }
+    void opportunity( const uint64_t time, uint64_t bytes );
+
+    /* forbid copying or assigning */
+    LinkLog( const LinkLog & other ) = delete;
+    LinkLog & operator=( const LinkLog & other ) = delete;
+};
+
+/* format an event as a line of the text format */
+std::string format_link_log_event( const LinkLogEvent & event );
+
+/* parse a (non-comment) line of the text format, without its newline */
+LinkLogEvent parse_link_log_line( const char * p, const char * const end );
+
+/* the base timestamp (ms) from the comment lines at the start of a log */
+uint64_t link_log_base_timestamp( const char * p, const char * const end );
+
+/* reads a binary log */
+class BinaryLinkLogReader
+{
+private:
+    std::string filename_;
+    MMapRegion file_;
+    std::string comments_;
+    size_t events_offset_, offset_;
+
+public:
+    BinaryLinkLogReader( const std::string & filename );
+
+    const std::string & comments( void ) const { return comments_; }
+
+    /* returns false at the end of the log (ignoring a torn final event) */
+    bool next( LinkLogEvent & event );
+
+    /* number of events, and skipping to one (for reading in parallel) */
+    size_t size( void ) const;
+    void seek( const size_t index );
+
+    /* forbid copying or assigning */
+    BinaryLinkLogReader( const BinaryLinkLogReader & other ) = delete;
+    BinaryLinkLogReader & operator=( const BinaryLinkLogReader & other ) = delete;
+};
+
+/* is this a binary log? */
+bool is_binary_link_log( const std::string & filename );
+
+#endif /* LINK_LOG_HH */
@@ -6,78 +6,46 @@
 #include "link_queue.hh"
 #include "timestamp.hh"
 #include "util.hh"
-#include "ezio.hh"
 #include "abstract_packet_queue.hh"
 
 using namespace std;
 
 LinkQueue::LinkQueue( const string & link_name, const string & filename, const string & logfile,
-                      const bool repeat, const bool graph_throughput, const bool graph_delay,
+                      const bool binary_log, const bool repeat, const bool graph_throughput, const bool graph_delay,
+                      const string & export_file, const string & capture_file,
                       unique_ptr<AbstractPacketQueue> && packet_queue,
                       const string & command_line )
-    : next_delivery_( 0 ),
-      schedule_(),
-      base_timestamp_( timestamp() ),
+    : trace_(),
+      base_timestamp_( timestamp() * NS_PER_MS ), /* whole ms, as logged */
       packet_queue_( move( packet_queue ) ),
-      packet_in_transit_( "", 0 ),
+      packet_in_transit_( PacketBuffer(), 0 ),
       packet_in_transit_bytes_left_( 0 ),
       output_queue_(),
       log_(),
       throughput_graph_( nullptr ),
       delay_graph_( nullptr ),
+      export_(),
+      capture_(),
       repeat_( repeat ),
       finished_( false )
 {
     assert_not_root();
 
-    /* open filename and load schedule */
-    ifstream trace_file( filename );
-
-    if ( not trace_file.good() ) {
-        throw runtime_error( filename + ": error opening for reading" );
-    }
-
-    string line;
-
-    while ( trace_file.good() and getline( trace_file, line ) ) {
-        if ( line.empty() ) {
-            throw runtime_error( filename + ": invalid empty line" );
-        }
-
-        const uint64_t ms = myatoi( line );
-
-        if ( not schedule_.empty() ) {
-            if ( ms < schedule_.back() ) {
-                throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
-            }
-        }
-
-        schedule_.emplace_back( ms );
-    }
-
-    if ( schedule_.empty() ) {
-        throw runtime_error( filename + ": no valid timestamps found" );
-    }
-
-    if ( schedule_.back() == 0 ) {
-        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
-    }
+    /* open the delivery schedule (text or binary format) */
+    trace_ = load_link_trace( filename );
 
     /* open logfile if called for */
     if ( not logfile.empty() ) {
-        log_.reset( new ofstream( logfile ) );
-        if ( not log_->good() ) {
-            throw runtime_error( logfile + ": error opening for writing" );
-        }
-
-        *log_ << "# mahimahi mm-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
-        *log_ << "# command line: " << command_line << endl;
-        *log_ << "# queue: " << packet_queue_->to_string() << endl;
-        *log_ << "# base timestamp: " << base_timestamp_ << endl;
+        string comments = "# mahimahi mm-link (" + link_name + ") [" + filename + "] > " + logfile + "\n";
+        comments += "# command line: " + command_line + "\n";
+        comments += "# queue: " + packet_queue_->to_string() + "\n";
+        comments += "# base timestamp: " + to_string( base_timestamp_ / NS_PER_MS ) + "\n";
         const char * prefix = getenv( "MAHIMAHI_SHELL_PREFIX" );
         if ( prefix ) {
-            *log_ << "# mahimahi config: " << prefix << endl;
+            comments += "# mahimahi config: " + string( prefix ) + "\n";
         }
+
+        log_.reset( new LinkLog( logfile, binary_log, comments ) );
     }
 
     /* create graphs if called for */
@@ -100,40 +68,76 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
                                                  1, false, 250,
                                                  [] ( int, int & x ) { x = -1; } ) );
     }
+
+    /* export the same series, without a display, if called for */
+    if ( not export_file.empty() ) {
+        export_.reset( new BinnedLiveExport( export_file, link_name + " [" + filename + "]",
+                                             { { "capacity (Mbps)", 8.0 / 1000000.0, true, false },
+                                               { "arrivals (Mbps)", 8.0 / 1000000.0, true, false },
+                                               { "departures (Mbps)", 8.0 / 1000000.0, true, false },
+                                               { "max queueing delay (ms)", 1, false, true } },
+                                             500 ) );
+    }
+
+    /* capture the packets it delivers and drops, if called for */
+    if ( not capture_file.empty() ) {
+        /* sized for the link's busiest stretch (one packet per opportunity) */
+        capture_.reset( new PacketCapture( capture_file, link_name,
+                                           peak_opportunities( *load_link_trace( filename ),
+                                                               PacketCapture::WRITER_STALL ) ) );
+
+        /* the LinkQueue may move, but the capture stays put */
+        PacketCapture * const capture = capture_.get();
+        packet_queue_->set_drop_observer( [capture] ( const QueuedPacket & packet, const char * const reason,
+                                                      const uint64_t time ) {
+                capture->dropped( time, packet, reason );
+            } );
+    }
 }
 
 void LinkQueue::record_arrival( const uint64_t arrival_time, const size_t pkt_size )
 {
     /* log it */
     if ( log_ ) {
-        *log_ << arrival_time << " + " << pkt_size << endl;
+        log_->arrival( arrival_time, pkt_size );
     }
 
     /* meter it */
     if ( throughput_graph_ ) {
         throughput_graph_->add_value_now( 1, pkt_size );
     }
+
+    if ( export_ ) {
+        export_->add_value_now( 1, pkt_size );
+    }
 }
 
 void LinkQueue::record_departure_opportunity( void )
 {
-    /* log the delivery opportunity */
+    const uint64_t bytes = trace_->count() * PACKET_SIZE;
+
+    /* log the delivery opportunities (one line for the whole run) */
     if ( log_ ) {
-        *log_ << next_delivery_time() << " # " << PACKET_SIZE << endl;
+        log_->opportunity( next_delivery_time(), bytes );
     }
 
-    /* meter the delivery opportunity */
+    /* meter the delivery opportunities */
     if ( throughput_graph_ ) {
-        throughput_graph_->add_value_now( 0, PACKET_SIZE );
-    }    
+        throughput_graph_->add_value_now( 0, bytes );
+    }
+
+    if ( export_ ) {
+        export_->add_value_now( 0, bytes );
+    }
 }
 
 void LinkQueue::record_departure( const uint64_t departure_time, const QueuedPacket & packet )
 {
     /* log the delivery */
+    const uint64_t delay = departure_time - packet.arrival_time;
+
     if ( log_ ) {
-        *log_ << departure_time << " - " << packet.contents.size()
-              << " " << departure_time - packet.arrival_time << endl;
+        log_->departure( departure_time, packet.contents.size(), delay );
     }
 
     /* meter the delivery */
@@ -142,13 +146,22 @@ void LinkQueue::record_departure( const uint64_t departure_time, const QueuedPac
     }
 
     if ( delay_graph_ ) {
-        delay_graph_->set_max_value_now( 0, departure_time - packet.arrival_time );
-    }    
+        delay_graph_->set_max_value_now( 0, delay / NS_PER_MS );
+    }
+
+    if ( export_ ) {
+        export_->add_value_now( 2, packet.contents.size() );
+        export_->set_max_value_now( 3, delay / NS_PER_MS );
+    }
+
+    if ( capture_ ) {
+        capture_->delivered( departure_time, packet );
+    }
 }
 
-void LinkQueue::read_packet( const string & contents )
+void LinkQueue::read_packet( PacketBuffer && contents )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_ns();
 
     if ( contents.size() > PACKET_SIZE ) {
         throw runtime_error( "packet size is greater than maximum" );
@@ -157,7 +170,7 @@ void LinkQueue::read_packet( const string & contents )
     rationalize( now );
 
     record_arrival( now, contents.size());
-    packet_queue_->enqueue( QueuedPacket( contents, now ) );
+    packet_queue_->enqueue( QueuedPacket( move( contents ), now ) );
 }
 
 uint64_t LinkQueue::next_delivery_time( void ) const
@@ -165,20 +178,18 @@ uint64_t LinkQueue::next_delivery_time( void ) const
     if ( finished_ ) {
         return -1;
     } else {
-        return schedule_.at( next_delivery_ ) + base_timestamp_;
+        return trace_->current() + base_timestamp_;
     }
 }
 
-void LinkQueue::use_a_delivery_opportunity( void )
+void LinkQueue::use_a_delivery_run( void )
 {
     record_departure_opportunity();
 
-    next_delivery_ = (next_delivery_ + 1) % schedule_.size();
-
     /* wraparound */
-    if ( next_delivery_ == 0 ) {
+    if ( not trace_->advance() ) {
         if ( repeat_ ) {
-            base_timestamp_ += schedule_.back();
+            base_timestamp_ += trace_->duration();
         } else {
             finished_ = true;
         }
@@ -193,16 +204,20 @@ void LinkQueue::rationalize( const uint64_t now )
     while ( next_delivery_time() <= now ) {
         const uint64_t this_delivery_time = next_delivery_time();
 
-        /* burn a delivery opportunity */
-        unsigned int bytes_left_in_this_delivery = PACKET_SIZE;
-        use_a_delivery_opportunity();
+        /* burn a run of delivery opportunities. They all happen at the same
+           instant, so their bytes can be pooled: nothing can arrive between them. */
+        uint64_t bytes_left_in_this_delivery = trace_->count() * PACKET_SIZE;
+        use_a_delivery_run();
 
         while ( bytes_left_in_this_delivery > 0 ) {
             if ( not packet_in_transit_bytes_left_ ) {
                 if ( packet_queue_->empty() ) {
                     break;
                 }
-                packet_in_transit_ = packet_queue_->dequeue();
+                packet_in_transit_ = packet_queue_->dequeue( this_delivery_time );
+                if ( packet_in_transit_.contents.empty() ) {
+                    break; /* the queue dropped everything it had */
+                }
                 packet_in_transit_bytes_left_ = packet_in_transit_.contents.size();
             }
 
@@ -211,9 +226,9 @@ void LinkQueue::rationalize( const uint64_t now )
             assert( packet_in_transit_bytes_left_ > 0 );
             assert( packet_in_transit_bytes_left_ <= packet_in_transit_.contents.size() );
 
-            /* how many bytes of the delivery opportunity can we use? */
+            /* how many bytes of the delivery opportunities can we use? */
             const unsigned int amount_to_send = min( bytes_left_in_this_delivery,
-                                                     packet_in_transit_bytes_left_ );
+                                                     uint64_t( packet_in_transit_bytes_left_ ) );
 
             /* send that many bytes */
             packet_in_transit_bytes_left_ -= amount_to_send;
@@ -233,17 +248,32 @@ void LinkQueue::rationalize( const uint64_t now )
 void LinkQueue::write_packets( FileDescriptor & fd )
 {
     while ( not output_queue_.empty() ) {
-        fd.write( output_queue_.front() );
+        fd.write( output_queue_.front().data(), output_queue_.front().size() );
         output_queue_.pop();
     }
 }
 
-unsigned int LinkQueue::wait_time( void )
+bool LinkQueue::pop_output( PacketBuffer & packet )
 {
-    const auto now = timestamp();
+    if ( output_queue_.empty() ) {
+        return false;
+    }
+
+    packet = move( output_queue_.front() );
+    output_queue_.pop();
+    return true;
+}
+
+uint64_t LinkQueue::wait_time( void )
+{
+    const auto now = timestamp_ns();
 
     rationalize( now );
 
+    if ( finished_ ) {
+        return numeric_limits<uint64_t>::max();
+    }
+
     if ( next_delivery_time() <= now ) {
         return 0;
     } else {
@@ -6,56 +6,66 @@
 #include <queue>
 #include <cstdint>
 #include <string>
-#include <fstream>
 #include <memory>
 
 #include "file_descriptor.hh"
 #include "binned_livegraph.hh"
+#include "binned_live_export.hh"
 #include "abstract_packet_queue.hh"
+#include "link_trace.hh"
+#include "link_log.hh"
+#include "packet_capture.hh"
 
 class LinkQueue
 {
 private:
     const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
 
-    unsigned int next_delivery_;
-    std::vector<uint64_t> schedule_;
-    uint64_t base_timestamp_;
+    std::unique_ptr<LinkTrace> trace_;
+    uint64_t base_timestamp_; /* ns */
 
     std::unique_ptr<AbstractPacketQueue> packet_queue_;
     QueuedPacket packet_in_transit_;
     unsigned int packet_in_transit_bytes_left_;
-    std::queue<std::string> output_queue_;
+    std::queue<PacketBuffer> output_queue_;
 
-    std::unique_ptr<std::ofstream> log_;
+    std::unique_ptr<LinkLog> log_;
     std::unique_ptr<BinnedLiveGraph> throughput_graph_;
     std::unique_ptr<BinnedLiveGraph> delay_graph_;
+    std::unique_ptr<BinnedLiveExport> export_;
+    std::unique_ptr<PacketCapture> capture_;
 
     bool repeat_;
     bool finished_;
 
-    uint64_t next_delivery_time( void ) const;
+    uint64_t next_delivery_time( void ) const; /* ns */
 
-    void use_a_delivery_opportunity( void );
+    void use_a_delivery_run( void );
 
+    /* times in ns */
     void record_arrival( const uint64_t arrival_time, const size_t pkt_size );
     void record_departure_opportunity( void );
     void record_departure( const uint64_t departure_time, const QueuedPacket & packet );
 
-    void rationalize( const uint64_t now );
+    void rationalize( const uint64_t now ); /* ns */
     void dequeue_packet( void );
 
 public:
     LinkQueue( const std::string & link_name, const std::string & filename, const std::string & logfile,
-               const bool repeat, const bool graph_throughput, const bool graph_delay,
+               const bool binary_log, const bool repeat, const bool graph_throughput, const bool graph_delay,
+               const std::string & export_file, const std::string & capture_file,
                std::unique_ptr<AbstractPacketQueue> && packet_queue,
                const std::string & command_line );
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void );
+    /* take the next packet that is ready to leave, if any (instead of
+       writing it to a device, e.g. in a SimulatedPath) */
+    bool pop_output( PacketBuffer & packet );
+
+    uint64_t wait_time( void ); /* ns */
 
     bool pending_output( void ) const;
 
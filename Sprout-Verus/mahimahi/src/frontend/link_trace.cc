@@ -0,0 +1,546 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "link_trace.hh"
+#include "exception.hh"
+#include "ezio.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+static const char BINARY_TRACE_MAGIC[ 8 ] = { 'M', 'M', 'T', 'R', 'A', 'C', 'E', 0 };
+static const uint32_t BINARY_TRACE_VERSION = 2;
+static const size_t BINARY_TRACE_HEADER_SIZE = 32;
+
+/* flush the writer's buffer in chunks of this size */
+static const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+static const unsigned int NS_DIGITS_PER_MS = 6;
+
+/* parse "T[.FRACTION] [N]" into a time in ns and an opportunity count */
+static void parse_trace_line( const string & raw_line, uint64_t & time_ns, uint64_t & count )
+{
+    /* skip leading blanks, as the one-number-per-line format always did */
+    const auto start = raw_line.find_first_not_of( " \t" );
+    const string line = start == string::npos ? string() : raw_line.substr( start );
+
+    const auto space = line.find_first_of( " \t" );
+    const string time_string = line.substr( 0, space );
+
+    /* the count, if any, is the next word; only whitespace may follow it */
+    count = 1;
+    const auto count_start = line.find_first_not_of( " \t", space );
+    if ( space != string::npos and count_start != string::npos ) {
+        const auto count_end = line.find_first_of( " \t", count_start );
+        const string count_string = line.substr( count_start, count_end - count_start );
+        if ( count_string.find_first_not_of( "0123456789" ) != string::npos
+             or ( count_end != string::npos
+                  and line.find_first_not_of( " \t", count_end ) != string::npos ) ) {
+            throw runtime_error( "invalid opportunity count: " + line );
+        }
+
+        const long int n = myatoi( count_string );
+        if ( n < 0 ) {
+            throw runtime_error( "opportunity count must be non-negative: " + line );
+        }
+        count = n;
+    }
+
+    const auto point = time_string.find( '.' );
+    const long int ms = myatoi( time_string.substr( 0, point ) );
+    if ( ms < 0 ) {
+        throw runtime_error( "negative timestamp: " + line );
+    }
+    time_ns = uint64_t( ms ) * NS_PER_MS;
+
+    if ( point != string::npos ) {
+        string fraction = time_string.substr( point + 1 );
+        if ( fraction.empty() or fraction.size() > NS_DIGITS_PER_MS
+             or fraction.find_first_not_of( "0123456789" ) != string::npos ) {
+            throw runtime_error( "invalid fractional timestamp: " + line );
+        }
+        fraction.resize( NS_DIGITS_PER_MS, '0' );
+        time_ns += myatoi( fraction );
+    }
+}
+
+void read_text_trace( const string & filename,
+                      const function<void(const uint64_t, const uint64_t)> & callback )
+{
+    ifstream trace_file( filename );
+
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    string line;
+    bool first = true, ended = false, any_opportunities = false;
+    uint64_t last_ns = 0;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename + ": invalid empty line" );
+        }
+
+        if ( ended ) {
+            throw runtime_error( filename + ": a count of zero may only end the trace" );
+        }
+
+        uint64_t ns, count;
+        try {
+            parse_trace_line( line, ns, count );
+        } catch ( const exception & e ) {
+            throw runtime_error( filename + ": " + e.what() );
+        }
+
+        if ( (not first) and ns < last_ns ) {
+            throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
+        }
+
+        callback( ns, count );
+
+        first = false;
+        ended = count == 0;
+        any_opportunities = any_opportunities or count > 0;
+        last_ns = ns;
+    }
+
+    if ( not any_opportunities ) {
+        throw runtime_error( filename + ": no valid timestamps found" );
+    }
+
+    if ( last_ns == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+}
+
+string format_trace_time( const uint64_t time_ns )
+{
+    string ret = to_string( time_ns / NS_PER_MS );
+
+    const uint64_t fraction = time_ns % NS_PER_MS;
+    if ( fraction ) {
+        string digits = to_string( fraction );
+        digits.insert( 0, NS_DIGITS_PER_MS - digits.size(), '0' );
+        ret += "." + digits.substr( 0, digits.find_last_not_of( '0' ) + 1 );
+    }
+
+    return ret;
+}
+
+TextLinkTrace::TextLinkTrace( const string & filename )
+    : schedule_(),
+      next_delivery_( 0 ),
+      duration_( 0 )
+{
+    read_text_trace( filename, [&] ( const uint64_t ns, const uint64_t count ) {
+            duration_ = ns;
+
+            /* merge opportunities at the same instant into one run */
+            if ( count == 0 ) {
+                return; /* the end of the trace */
+            } else if ( (not schedule_.empty()) and schedule_.back().time_ns == ns ) {
+                schedule_.back().count += count;
+            } else {
+                schedule_.push_back( { ns, count } );
+            }
+        } );
+}
+
+bool TextLinkTrace::advance( void )
+{
+    next_delivery_ = (next_delivery_ + 1) % schedule_.size();
+
+    return next_delivery_ != 0;
+}
+
+static uint64_t read_varint( const uint8_t * & cursor, const uint8_t * const end )
+{
+    uint64_t value = 0;
+
+    for ( unsigned int shift = 0; shift < 64; shift += 7 ) {
+        if ( cursor == end ) {
+            throw runtime_error( "truncated varint" );
+        }
+
+        const uint8_t byte = *cursor++;
+        value |= uint64_t( byte & 0x7f ) << shift;
+
+        if ( not (byte & 0x80) ) {
+            return value;
+        }
+    }
+
+    throw runtime_error( "varint too long" );
+}
+
+static void write_varint( string & output, uint64_t value )
+{
+    while ( value >= 0x80 ) {
+        output.push_back( char( (value & 0x7f) | 0x80 ) );
+        value >>= 7;
+    }
+
+    output.push_back( char( value ) );
+}
+
+template <typename T> static T read_field( const char * const header, const size_t offset )
+{
+    T ret;
+    memcpy( &ret, header + offset, sizeof( ret ) );
+    return ret;
+}
+
+BinaryLinkTrace::BinaryLinkTrace( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      begin_( nullptr ),
+      end_( nullptr ),
+      cursor_( nullptr ),
+      time_unit_ns_( 0 ),
+      run_count_( 0 ),
+      duration_( 0 ),
+      index_( 0 ),
+      current_( 0 ),
+      current_count_( 0 )
+{
+    if ( file_.size() < BINARY_TRACE_HEADER_SIZE
+         or memcmp( file_.data(), BINARY_TRACE_MAGIC, sizeof( BINARY_TRACE_MAGIC ) ) ) {
+        throw runtime_error( filename_ + ": not a binary trace" );
+    }
+
+    if ( le32toh( read_field<uint32_t>( file_.data(), 8 ) ) != BINARY_TRACE_VERSION ) {
+        throw runtime_error( filename_ + ": unsupported binary trace version" );
+    }
+
+    time_unit_ns_ = le32toh( read_field<uint32_t>( file_.data(), 12 ) );
+    run_count_ = le64toh( read_field<uint64_t>( file_.data(), 16 ) );
+    duration_ = le64toh( read_field<uint64_t>( file_.data(), 24 ) );
+
+    if ( time_unit_ns_ == 0 ) {
+        throw runtime_error( filename_ + ": corrupt binary trace (zero time unit)" );
+    }
+
+    if ( run_count_ == 0 ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    if ( duration_ == 0 ) {
+        throw runtime_error( filename_ + ": trace must last for a nonzero amount of time" );
+    }
+
+    begin_ = reinterpret_cast<const uint8_t *>( file_.data() ) + BINARY_TRACE_HEADER_SIZE;
+    end_ = reinterpret_cast<const uint8_t *>( file_.data() ) + file_.size();
+
+    /* we stream through the trace once per pass; let the kernel read ahead */
+    file_.advise( MADV_SEQUENTIAL );
+
+    rewind();
+}
+
+void BinaryLinkTrace::read_run( void )
+{
+    try {
+        current_ += read_varint( cursor_, end_ ) * time_unit_ns_;
+        current_count_ = read_varint( cursor_, end_ );
+    } catch ( const exception & e ) {
+        throw runtime_error( filename_ + ": corrupt binary trace (" + e.what() + ")" );
+    }
+
+    if ( current_ > duration_ ) {
+        throw runtime_error( filename_ + ": corrupt binary trace (timestamp past end)" );
+    }
+
+    if ( current_count_ == 0 ) {
+        throw runtime_error( filename_ + ": corrupt binary trace (empty run)" );
+    }
+}
+
+void BinaryLinkTrace::rewind( void )
+{
+    cursor_ = begin_;
+    index_ = 0;
+    current_ = 0;
+
+    read_run();
+}
+
+bool BinaryLinkTrace::advance( void )
+{
+    index_++;
+
+    if ( index_ == run_count_ ) {
+        /* the decoded runs must fill the file exactly (the last may be
+           before the end of the trace, if it ends in silence) */
+        if ( cursor_ != end_ ) {
+            throw runtime_error( filename_ + ": corrupt binary trace (length mismatch)" );
+        }
+
+        rewind();
+        return false;
+    }
+
+    read_run();
+
+    return true;
+}
+
+BinaryTraceWriter::BinaryTraceWriter( const string & filename, const uint32_t time_unit_ns )
+    : filename_( filename ),
+      fd_( SystemCall( "open " + filename,
+                       open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) ),
+      buffer_( BINARY_TRACE_HEADER_SIZE, 0 ), /* placeholder for header */
+      time_unit_ns_( time_unit_ns ),
+      run_count_( 0 ),
+      last_time_ns_( 0 ),
+      pending_time_ns_( 0 ),
+      pending_count_( 0 ),
+      end_time_ns_( 0 )
+{
+    if ( time_unit_ns_ == 0 ) {
+        throw runtime_error( filename_ + ": time unit must be nonzero" );
+    }
+}
+
+void BinaryTraceWriter::flush( void )
+{
+    if ( not buffer_.empty() ) {
+        fd_.write( buffer_ );
+        buffer_.clear();
+    }
+}
+
+void BinaryTraceWriter::emit_pending_run( void )
+{
+    if ( pending_count_ == 0 ) {
+        return;
+    }
+
+    write_varint( buffer_, (pending_time_ns_ - last_time_ns_) / time_unit_ns_ );
+    write_varint( buffer_, pending_count_ );
+    last_time_ns_ = pending_time_ns_;
+    pending_count_ = 0;
+    run_count_++;
+
+    if ( buffer_.size() >= WRITE_BUFFER_SIZE ) {
+        flush();
+    }
+}
+
+void BinaryTraceWriter::add( const uint64_t time_ns, const uint64_t count )
+{
+    if ( time_ns < max( last_time_ns_, pending_time_ns_ ) ) {
+        throw runtime_error( filename_ + ": timestamps must be monotonically nondecreasing" );
+    }
+
+    if ( time_ns % time_unit_ns_ ) {
+        throw runtime_error( filename_ + ": timestamp is not a multiple of the time unit" );
+    }
+
+    end_time_ns_ = time_ns;
+
+    if ( count == 0 ) {
+        return;
+    }
+
+    if ( pending_count_ and time_ns != pending_time_ns_ ) {
+        emit_pending_run();
+    }
+
+    pending_time_ns_ = time_ns;
+    pending_count_ += count;
+}
+
+void BinaryTraceWriter::finish( void )
+{
+    emit_pending_run();
+
+    if ( run_count_ == 0 ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    if ( end_time_ns_ == 0 ) {
+        throw runtime_error( filename_ + ": trace must last for a nonzero amount of time" );
+    }
+
+    flush();
+
+    const uint32_t version = htole32( BINARY_TRACE_VERSION ), time_unit = htole32( time_unit_ns_ );
+    const uint64_t count = htole64( run_count_ ), duration = htole64( end_time_ns_ );
+
+    string header( BINARY_TRACE_MAGIC, sizeof( BINARY_TRACE_MAGIC ) );
+    header.append( reinterpret_cast<const char *>( &version ), sizeof( version ) );
+    header.append( reinterpret_cast<const char *>( &time_unit ), sizeof( time_unit ) );
+    header.append( reinterpret_cast<const char *>( &count ), sizeof( count ) );
+    header.append( reinterpret_cast<const char *>( &duration ), sizeof( duration ) );
+
+    SystemCall( "lseek", lseek( fd_.fd_num(), 0, SEEK_SET ) );
+    fd_.write( header );
+}
+
+/* append n in decimal, without the allocations of to_string() */
+static void append_decimal( string & buffer, uint64_t n )
+{
+    char digits[ 20 ];
+    char * p = digits + sizeof( digits );
+
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while ( n );
+
+    buffer.append( p, digits + sizeof( digits ) - p );
+}
+
+TextTraceWriter::TextTraceWriter( const string & filename )
+    : filename_( filename ),
+      fd_( SystemCall( "open " + filename,
+                       open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) ),
+      buffer_(),
+      any_( false ),
+      last_time_ns_( 0 ),
+      pending_time_ns_( 0 ),
+      pending_count_( 0 ),
+      end_time_ns_( 0 )
+{}
+
+void TextTraceWriter::emit_pending_run( void )
+{
+    if ( pending_count_ == 0 ) {
+        return;
+    }
+
+    if ( pending_time_ns_ % NS_PER_MS ) {
+        buffer_ += format_trace_time( pending_time_ns_ );
+    } else {
+        append_decimal( buffer_, pending_time_ns_ / NS_PER_MS );
+    }
+
+    if ( pending_count_ > 1 ) {
+        buffer_ += ' ';
+        append_decimal( buffer_, pending_count_ );
+    }
+
+    buffer_ += '\n';
+
+    any_ = true;
+    last_time_ns_ = pending_time_ns_;
+    pending_count_ = 0;
+
+    if ( buffer_.size() >= WRITE_BUFFER_SIZE ) {
+        fd_.write( buffer_ );
+        buffer_.clear();
+    }
+}
+
+void TextTraceWriter::add( const uint64_t time_ns, const uint64_t count )
+{
+    if ( time_ns < max( last_time_ns_, pending_time_ns_ ) ) {
+        throw runtime_error( filename_ + ": timestamps must be monotonically nondecreasing" );
+    }
+
+    end_time_ns_ = time_ns;
+
+    if ( count == 0 ) {
+        return;
+    }
+
+    if ( pending_count_ and time_ns != pending_time_ns_ ) {
+        emit_pending_run();
+    }
+
+    pending_time_ns_ = time_ns;
+    pending_count_ += count;
+}
+
+void TextTraceWriter::finish( void )
+{
+    emit_pending_run();
+
+    if ( not any_ ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    if ( end_time_ns_ == 0 ) {
+        throw runtime_error( filename_ + ": trace must last for a nonzero amount of time" );
+    }
+
+    /* mark the end of a trailing silence */
+    if ( end_time_ns_ > last_time_ns_ ) {
+        if ( end_time_ns_ % NS_PER_MS ) {
+            buffer_ += format_trace_time( end_time_ns_ );
+        } else {
+            append_decimal( buffer_, end_time_ns_ / NS_PER_MS );
+        }
+        buffer_ += " 0\n";
+    }
+
+    fd_.write( buffer_ );
+    buffer_.clear();
+}
+
+bool is_binary_trace( const string & filename )
+{
+    ifstream trace_file( filename, ios::binary );
+
+    char magic[ sizeof( BINARY_TRACE_MAGIC ) ];
+    if ( not trace_file.read( magic, sizeof( magic ) ) ) {
+        return false;
+    }
+
+    return not memcmp( magic, BINARY_TRACE_MAGIC, sizeof( magic ) );
+}
+
+unique_ptr<LinkTrace> load_link_trace( const string & filename )
+{
+    if ( is_binary_trace( filename ) ) {
+        return unique_ptr<LinkTrace>( new BinaryLinkTrace( filename ) );
+    } else {
+        return unique_ptr<LinkTrace>( new TextLinkTrace( filename ) );
+    }
+}
+
+uint64_t peak_opportunities( LinkTrace & trace, const uint64_t window_ns )
+{
+    deque<pair<uint64_t, uint64_t>> window; /* runs (time, count) in the window */
+    uint64_t in_window = 0, peak = 0, offset = 0;
+    bool wrapped = false;
+
+    while ( true ) {
+        const uint64_t time = trace.current() + offset;
+
+        /* a window that starts in the first pass ends by here */
+        if ( wrapped and time >= trace.duration() + window_ns ) {
+            break;
+        }
+
+        window.emplace_back( time, trace.count() );
+        in_window += trace.count();
+
+        while ( window.front().first + window_ns <= time ) {
+            in_window -= window.front().second;
+            window.pop_front();
+        }
+
+        peak = max( peak, in_window );
+
+        if ( not trace.advance() ) {
+            if ( trace.duration() == 0 ) {
+                break;
+            }
+            wrapped = true;
+            offset += trace.duration(); /* a window can span many passes of a short trace */
+        }
+    }
+
+    return peak;
+}
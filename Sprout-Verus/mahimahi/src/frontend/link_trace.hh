@@ -0,0 +1,178 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_TRACE_HH
+#define LINK_TRACE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+
+/* A packet-delivery schedule for mm-link: a sequence of runs of N
+   delivery opportunities, all at the same time T. Traces come in two
+   formats:
+
+   text:   one run per line, "T [N]", with T in milliseconds (optionally
+           fractional, down to nanoseconds) and N defaulting to 1. The
+           traditional format (one integer timestamp per opportunity)
+           is a special case, and repeated timestamps are merged into
+           one run as the trace is read. A last line of "T 0" makes the
+           trace last until T, with no opportunities after the last run.
+
+   binary: a 32-byte header ("MMTRACE\0", u32 version, u32 time unit
+           in ns, u64 number of runs, u64 length of the trace in ns, at
+           least the time of the last run),
+           followed by each run as two unsigned LEB128 varints: the
+           time since the previous run (in time units) and the number
+           of opportunities. All header fields are little-endian.
+
+   Binary traces are mmap'd and decoded lazily, so loading is
+   constant-time and the process's memory does not grow with the
+   length of the trace. */
+
+class LinkTrace
+{
+public:
+    /* time (ns since start of trace) of the current run of delivery opportunities */
+    virtual uint64_t current( void ) const = 0;
+
+    /* number of opportunities in the current run */
+    virtual uint64_t count( void ) const = 0;
+
+    /* move on to the next run; returns false (having rewound
+       to the beginning of the trace) when the trace wraps around */
+    virtual bool advance( void ) = 0;
+
+    /* length (ns) of the trace: the time of its last run, or later if
+       it ends in silence. Each pass starts this long after the last. */
+    virtual uint64_t duration( void ) const = 0;
+
+    virtual ~LinkTrace() {}
+};
+
+class TextLinkTrace : public LinkTrace
+{
+private:
+    struct Run
+    {
+        uint64_t time_ns;
+        uint64_t count;
+    };
+
+    std::vector<Run> schedule_;
+    size_t next_delivery_;
+    uint64_t duration_;
+
+public:
+    TextLinkTrace( const std::string & filename );
+
+    uint64_t current( void ) const override { return schedule_[ next_delivery_ ].time_ns; }
+    uint64_t count( void ) const override { return schedule_[ next_delivery_ ].count; }
+    bool advance( void ) override;
+    uint64_t duration( void ) const override { return duration_; }
+};
+
+class BinaryLinkTrace : public LinkTrace
+{
+private:
+    std::string filename_;
+    MMapRegion file_;
+
+    const uint8_t * begin_, * end_, * cursor_;
+
+    uint64_t time_unit_ns_, run_count_, duration_;
+    uint64_t index_, current_, current_count_;
+
+    void read_run( void );
+    void rewind( void );
+
+public:
+    BinaryLinkTrace( const std::string & filename );
+
+    uint64_t current( void ) const override { return current_; }
+    uint64_t count( void ) const override { return current_count_; }
+    bool advance( void ) override;
+    uint64_t duration( void ) const override { return duration_; }
+
+    /* forbid copying or assigning */
+    BinaryLinkTrace( const BinaryLinkTrace & other ) = delete;
+    BinaryLinkTrace & operator=( const BinaryLinkTrace & other ) = delete;
+};
+
+/* writes the binary format, merging opportunities at the same time into runs */
+class BinaryTraceWriter
+{
+private:
+    std::string filename_;
+    FileDescriptor fd_;
+    std::string buffer_;
+
+    uint32_t time_unit_ns_;
+    uint64_t run_count_, last_time_ns_;
+    uint64_t pending_time_ns_, pending_count_;
+    uint64_t end_time_ns_;
+
+    void emit_pending_run( void );
+    void flush( void );
+
+public:
+    /* every time added must be a multiple of the time unit */
+    BinaryTraceWriter( const std::string & filename, const uint32_t time_unit_ns = 1 );
+
+    /* a count of zero adds no opportunities, but the trace lasts until then */
+    void add( const uint64_t time_ns, const uint64_t count = 1 );
+
+    /* write out the header; the trace is unusable until this is called */
+    void finish( void );
+};
+
+/* writes the text format, one line per run, merging opportunities at the same time */
+class TextTraceWriter
+{
+private:
+    std::string filename_;
+    FileDescriptor fd_;
+    std::string buffer_;
+
+    bool any_;
+    uint64_t last_time_ns_;
+    uint64_t pending_time_ns_, pending_count_;
+    uint64_t end_time_ns_;
+
+    void emit_pending_run( void );
+
+public:
+    TextTraceWriter( const std::string & filename );
+
+    /* a count of zero adds no opportunities, but the trace lasts until
+       then (ending it with a "T 0" line if need be) */
+    void add( const uint64_t time_ns, const uint64_t count = 1 );
+
+    /* write out what is left; the trace is incomplete until this is called */
+    void finish( void );
+};
+
+/* call back with each run (time in ns, count) of a text trace, checking
+   it as we go; a final count of zero marks where the trace ends */
+void read_text_trace( const std::string & filename,
+                      const std::function<void(const uint64_t, const uint64_t)> & callback );
+
+/* format a trace time (ns) as milliseconds for the text format */
+std::string format_trace_time( const uint64_t time_ns );
+
+/* is this a binary trace? */
+bool is_binary_trace( const std::string & filename );
+
+/* open a trace in either format */
+std::unique_ptr<LinkTrace> load_link_trace( const std::string & filename );
+
+/* the most delivery opportunities in any window of window_ns starting
+   in the first pass of a freshly loaded trace, as if it repeats (the
+   trace is left partway through) */
+uint64_t peak_opportunities( LinkTrace & trace, const uint64_t window_ns );
+
+#endif /* LINK_TRACE_HH */
@@ -6,6 +6,9 @@
 #include "drop_tail_packet_queue.hh"
 #include "drop_head_packet_queue.hh"
 #include "red_packet_queue.hh"
+#include "codel_packet_queue.hh"
+#include "fq_codel_packet_queue.hh"
+#include "pie_packet_queue.hh"
 #include "link_queue.hh"
 #include "packetshell.cc"
 
@@ -16,16 +19,21 @@ void usage_error( const string & program_name )
     cerr << "Usage: " << program_name << " UPLINK-TRACE DOWNLINK-TRACE [OPTION]... [COMMAND]" << endl;
     cerr << endl;
     cerr << "Options = --once" << endl;
-    cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME" << endl;
+    cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME --binary-log" << endl;
     cerr << "          --meter-uplink --meter-uplink-delay" << endl;
     cerr << "          --meter-downlink --meter-downlink-delay" << endl;
     cerr << "          --meter-all" << endl;
+    cerr << "          --uplink-export=FILENAME --downlink-export=FILENAME" << endl;
+    cerr << "          --uplink-capture=FILENAME --downlink-capture=FILENAME" << endl;
     cerr << "          --uplink-queue=QUEUE_TYPE --downlink-queue=QUEUE_TYPE" << endl;
     cerr << "          --uplink-queue-args=QUEUE_ARGS --downlink-queue-args=QUEUE_ARGS" << endl;
     cerr << endl;
-    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | red" << endl;
+    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | red | codel | fq_codel | pie" << endl;
     cerr << "          QUEUE_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\"" << endl;
-    cerr << "              (with NAME = bytes | packets)" << endl << endl;
+    cerr << "              (with NAME = bytes | packets," << endl;
+    cerr << "               and also for codel: target | interval (ms)," << endl;
+    cerr << "                        fq_codel: target | interval (ms) | flows | quantum (bytes)," << endl;
+    cerr << "                        pie: target | tupdate | max_burst (ms))" << endl << endl;
 
     throw runtime_error( "invalid arguments" );
 }
@@ -40,6 +48,12 @@ unique_ptr<AbstractPacketQueue> get_packet_queue( const string & type, const str
         return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) );
     } else if ( type == "red" ) {
         return unique_ptr<AbstractPacketQueue>( new RedPacketQueue( args ) );
+    } else if ( type == "codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new CoDelPacketQueue( args ) );
+    } else if ( type == "fq_codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new FQCoDelPacketQueue( args ) );
+    } else if ( type == "pie" ) {
+        return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args ) );
     } else {
         cerr << "Unknown queue type: " << type << endl;
     }
@@ -85,12 +99,17 @@ int main( int argc, char *argv[] )
         const option command_line_options[] = {
             { "uplink-log",           required_argument, nullptr, 'u' },
             { "downlink-log",         required_argument, nullptr, 'd' },
+            { "binary-log",                 no_argument, nullptr, 'l' },
             { "once",                       no_argument, nullptr, 'o' },
             { "meter-uplink",               no_argument, nullptr, 'm' },
             { "meter-downlink",             no_argument, nullptr, 'n' },
             { "meter-uplink-delay",         no_argument, nullptr, 'x' },
             { "meter-downlink-delay",       no_argument, nullptr, 'y' },
             { "meter-all",                  no_argument, nullptr, 'z' },
+            { "uplink-export",        required_argument, nullptr, 'e' },
+            { "downlink-export",      required_argument, nullptr, 'f' },
+            { "uplink-capture",       required_argument, nullptr, 'c' },
+            { "downlink-capture",     required_argument, nullptr, 'p' },
             { "uplink-queue",         required_argument, nullptr, 'q' },
             { "downlink-queue",       required_argument, nullptr, 'w' },
             { "uplink-queue-args",    required_argument, nullptr, 'a' },
@@ -99,9 +118,12 @@ int main( int argc, char *argv[] )
         };
 
         string uplink_logfile, downlink_logfile;
+        bool binary_log = false;
         bool repeat = true;
         bool meter_uplink = false, meter_downlink = false;
         bool meter_uplink_delay = false, meter_downlink_delay = false;
+        string uplink_export, downlink_export;
+        string uplink_capture, downlink_capture;
         string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
                uplink_queue_args, downlink_queue_args;
 
@@ -118,6 +140,9 @@ int main( int argc, char *argv[] )
             case 'd':
                 downlink_logfile = optarg;
                 break;
+            case 'l':
+                binary_log = true;
+                break;
             case 'o':
                 repeat = false;
                 break;
@@ -138,6 +163,18 @@ int main( int argc, char *argv[] )
                     = meter_uplink_delay = meter_downlink_delay
                     = true;
                 break;
+            case 'e':
+                uplink_export = optarg;
+                break;
+            case 'f':
+                downlink_export = optarg;
+                break;
+            case 'c':
+                uplink_capture = optarg;
+                break;
+            case 'p':
+                downlink_capture = optarg;
+                break;
             case 'q':
                 uplink_queue_type = optarg; 
                 break;
@@ -178,11 +215,11 @@ int main( int argc, char *argv[] )
         PacketShell<LinkQueue> link_shell_app( "link", user_environment );
 
         link_shell_app.start_uplink( "[link] ", command,
-                                     "Uplink", uplink_filename, uplink_logfile, repeat, meter_uplink, meter_uplink_delay,
+                                     "Uplink", uplink_filename, uplink_logfile, binary_log, repeat, meter_uplink, meter_uplink_delay, uplink_export, uplink_capture,
                                      get_packet_queue( uplink_queue_type, uplink_queue_args, argv[ 0 ] ),
                                      command_line );
 
-        link_shell_app.start_downlink( "Downlink", downlink_filename, downlink_logfile, repeat, meter_downlink, meter_downlink_delay,
+        link_shell_app.start_downlink( "Downlink", downlink_filename, downlink_logfile, binary_log, repeat, meter_downlink, meter_downlink_delay, downlink_export, downlink_capture,
                                        get_packet_queue( downlink_queue_type, downlink_queue_args, argv[ 0 ] ),
                                        command_line );
 
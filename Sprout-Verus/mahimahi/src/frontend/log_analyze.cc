@@ -0,0 +1,363 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <limits>
+#include <functional>
+
+#include "link_log.hh"
+#include "quantile_sketch.hh"
+#include "mmap_region.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Summarizes an mm-link log (text or binary) in one pass: per window,
+   the capacity, ingress and egress rates and the queueing-delay
+   percentiles, then the overall figures that mm-throughput-graph
+   reports. The log is split into chunks that are analyzed in parallel,
+   and the partial results (including the delay sketches) merged. */
+
+static const uint32_t NO_DELAY = numeric_limits<uint32_t>::max();
+
+struct Window
+{
+    uint64_t capacity = 0, arrivals = 0, departures = 0; /* bytes */
+    QuantileSketch delays {}; /* ms */
+};
+
+class Analysis
+{
+private:
+    uint64_t window_ns_;
+
+    /* the signal delay (ms) at each ms: the least delay of any packet sent then */
+    uint64_t first_send_ms_;
+    vector<uint32_t> signal_delay_;
+
+    void add_signal_delay( const uint64_t send_ms, const uint32_t delay_ms );
+
+public:
+    map<uint64_t, Window> windows {};
+    uint64_t first_event = numeric_limits<uint64_t>::max(), last_event = 0; /* ns since base */
+
+    Analysis( const uint64_t window_ns )
+        : window_ns_( window_ns ), first_send_ms_( 0 ), signal_delay_()
+    {}
+
+    /* times in ns since the base timestamp */
+    void add( const uint64_t time, const char type, const uint64_t bytes, const uint64_t delay );
+
+    void merge( const Analysis & other );
+
+    /* fill in the signal delay between packets, and return its distribution */
+    vector<uint32_t> signal_delays( void ) const;
+};
+
+void Analysis::add( const uint64_t time, const char type, const uint64_t bytes, const uint64_t delay )
+{
+    first_event = min( first_event, time );
+    last_event = max( last_event, time );
+
+    Window & window = windows[ time / window_ns_ ];
+
+    switch ( type ) {
+    case '+':
+        window.arrivals += bytes;
+        break;
+    case '#':
+        window.capacity += bytes;
+        break;
+    case '-':
+        if ( delay > time ) {
+            throw runtime_error( "invalid timestamp and delay: ts=" + to_string( time / NS_PER_MS )
+                                 + ", delay=" + to_string( delay / NS_PER_MS ) );
+        }
+        window.departures += bytes;
+        window.delays.add( double( delay ) / NS_PER_MS );
+        add_signal_delay( time / NS_PER_MS - delay / NS_PER_MS, delay / NS_PER_MS );
+        break;
+    default:
+        throw runtime_error( string( "unknown event type: " ) + type );
+    }
+}
+
+void Analysis::add_signal_delay( const uint64_t send_ms, const uint32_t delay_ms )
+{
+    if ( signal_delay_.empty() ) {
+        first_send_ms_ = send_ms;
+    } else if ( send_ms < first_send_ms_ ) {
+        signal_delay_.insert( signal_delay_.begin(), first_send_ms_ - send_ms, NO_DELAY );
+        first_send_ms_ = send_ms;
+    }
+
+    const uint64_t index = send_ms - first_send_ms_;
+    if ( index >= signal_delay_.size() ) {
+        signal_delay_.resize( index + 1, NO_DELAY );
+    }
+
+    signal_delay_[ index ] = min( signal_delay_[ index ], delay_ms );
+}
+
+void Analysis::merge( const Analysis & other )
+{
+    first_event = min( first_event, other.first_event );
+    last_event = max( last_event, other.last_event );
+
+    for ( const auto & x : other.windows ) {
+        Window & window = windows[ x.first ];
+        window.capacity += x.second.capacity;
+        window.arrivals += x.second.arrivals;
+        window.departures += x.second.departures;
+        window.delays.merge( x.second.delays );
+    }
+
+    for ( size_t i = 0; i < other.signal_delay_.size(); i++ ) {
+        if ( other.signal_delay_[ i ] != NO_DELAY ) {
+            add_signal_delay( other.first_send_ms_ + i, other.signal_delay_[ i ] );
+        }
+    }
+}
+
+vector<uint32_t> Analysis::signal_delays( void ) const
+{
+    /* where no packet was sent, the signal delay is a ms more than at the next ms */
+    vector<uint32_t> ret( signal_delay_ );
+    for ( size_t i = ret.size() ? ret.size() - 1 : 0; i-- > 0; ) {
+        if ( ret[ i ] == NO_DELAY ) {
+            ret[ i ] = ret[ i + 1 ] + 1;
+        }
+    }
+
+    return ret;
+}
+
+/* analyze whole lines of a text log */
+static void analyze_text( const char * p, const char * const end, const uint64_t base_ms, Analysis & analysis )
+{
+    while ( p != end ) {
+        const char * const eol = find( p, end, '\n' );
+
+        if ( eol != p and *p != '#' ) {
+            const LinkLogEvent event = parse_link_log_line( p, eol );
+
+            if ( event.time < base_ms * NS_PER_MS ) {
+                throw runtime_error( "timestamp before base timestamp: " + to_string( event.time / NS_PER_MS ) );
+            }
+
+            analysis.add( event.time - base_ms * NS_PER_MS, event.type, event.bytes, event.delay );
+        }
+
+        p = eol == end ? end : eol + 1;
+    }
+}
+
+/* run the analysis on each of the chunks in its own thread, then merge */
+static Analysis analyze_in_parallel( const unsigned int chunks, const uint64_t window_ns,
+                                     const function<void( const unsigned int, Analysis & )> & analyze_chunk )
+{
+    vector<Analysis> results( chunks, Analysis( window_ns ) );
+    vector<exception_ptr> errors( chunks );
+    vector<thread> workers;
+
+    for ( unsigned int i = 0; i < chunks; i++ ) {
+        workers.emplace_back( [&, i] () {
+                try {
+                    analyze_chunk( i, results[ i ] );
+                } catch ( ... ) {
+                    errors[ i ] = current_exception();
+                }
+            } );
+    }
+
+    for ( auto & worker : workers ) {
+        worker.join();
+    }
+
+    for ( const auto & error : errors ) {
+        if ( error ) {
+            rethrow_exception( error );
+        }
+    }
+
+    for ( unsigned int i = 1; i < chunks; i++ ) {
+        results[ 0 ].merge( results[ i ] );
+    }
+
+    return move( results[ 0 ] );
+}
+
+static Analysis analyze_log( const string & filename, const unsigned int chunks, const uint64_t window_ns )
+{
+    if ( is_binary_link_log( filename ) ) {
+        BinaryLinkLogReader header( filename );
+        const uint64_t base_ns = link_log_base_timestamp( header.comments().data(),
+                                                         header.comments().data() + header.comments().size() ) * NS_PER_MS;
+        const size_t events = header.size();
+
+        return analyze_in_parallel( chunks, window_ns, [&] ( const unsigned int i, Analysis & analysis ) {
+                BinaryLinkLogReader log( filename );
+                log.seek( events * i / chunks );
+
+                LinkLogEvent event;
+                for ( size_t n = events * (i + 1) / chunks - events * i / chunks; n > 0; n-- ) {
+                    if ( not log.next( event ) ) {
+                        throw runtime_error( filename + ": truncated log" );
+                    }
+                    if ( event.time < base_ns ) {
+                        throw runtime_error( "timestamp before base timestamp: " + to_string( event.time ) );
+                    }
+                    analysis.add( event.time - base_ns, event.type, event.bytes, event.delay );
+                }
+            } );
+    }
+
+    const MMapRegion log( filename );
+    const char * const begin = log.data(), * const end = begin + log.size();
+    const uint64_t base_ms = link_log_base_timestamp( begin, end );
+
+    /* split at line boundaries */
+    vector<const char *> boundaries { begin };
+    for ( unsigned int i = 1; i < chunks; i++ ) {
+        const char * p = max( boundaries.back(), begin + log.size() * i / chunks );
+        if ( p != begin and p != end and p[ -1 ] != '\n' ) {
+            p = find( p, end, '\n' );
+            p = p == end ? end : p + 1;
+        }
+        boundaries.push_back( p );
+    }
+    boundaries.push_back( end );
+
+    return analyze_in_parallel( chunks, window_ns, [&] ( const unsigned int i, Analysis & analysis ) {
+            analyze_text( boundaries[ i ], boundaries[ i + 1 ], base_ms, analysis );
+        } );
+}
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [--window=MS] [--threads=N] LOGFILE" << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const option command_line_options[] = {
+            { "window",  required_argument, nullptr, 'w' },
+            { "threads", required_argument, nullptr, 't' },
+            { 0,                         0, nullptr, 0 }
+        };
+
+        uint64_t window_ms = 500;
+        unsigned int threads = max( 1u, thread::hardware_concurrency() );
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'w':
+                window_ms = myatoi( optarg );
+                break;
+            case 't':
+                threads = myatoi( optarg );
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 1 != argc or window_ms == 0 or threads == 0 ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const Analysis analysis = analyze_log( argv[ optind ], threads, window_ms * NS_PER_MS );
+
+        if ( analysis.windows.empty() ) {
+            throw runtime_error( "Must have at least one event" );
+        }
+
+        /* per-window rates (Mbits/s) and delays (ms) */
+        const double window_s = window_ms / 1000.0;
+        auto mbps = [&] ( const uint64_t bytes ) { return bytes * 8 / window_s / 1000000.0; };
+
+        printf( "# time (s)\tcapacity\tingress\tegress (Mbits/s)\tutilization (%%)\tdelay p50\tp95\tp99 (ms)\n" );
+
+        QuantileSketch all_delays;
+        uint64_t capacity = 0, departures = 0;
+
+        static const Window empty_window {};
+
+        for ( uint64_t bin = analysis.windows.begin()->first; bin <= analysis.windows.rbegin()->first; bin++ ) {
+            const auto it = analysis.windows.find( bin );
+            const Window & window = it == analysis.windows.end() ? empty_window : it->second;
+
+            printf( "%.3f\t%.3f\t%.3f\t%.3f", bin * window_s,
+                    mbps( window.capacity ), mbps( window.arrivals ), mbps( window.departures ) );
+
+            if ( window.capacity ) {
+                printf( "\t%.1f", 100.0 * window.departures / window.capacity );
+            } else {
+                printf( "\t-" );
+            }
+
+            if ( window.delays.count() ) {
+                printf( "\t%.1f\t%.1f\t%.1f\n", window.delays.quantile( 0.5 ),
+                        window.delays.quantile( 0.95 ), window.delays.quantile( 0.99 ) );
+            } else {
+                printf( "\t-\t-\t-\n" );
+            }
+
+            all_delays.merge( window.delays );
+            capacity += window.capacity;
+            departures += window.departures;
+        }
+
+        /* overall */
+        if ( analysis.last_event == analysis.first_event ) {
+            throw runtime_error( "log must span a nonzero amount of time" );
+        }
+
+        if ( all_delays.count() == 0 ) {
+            throw runtime_error( "Must have at least one departure event" );
+        }
+
+        const double duration_s = double( analysis.last_event - analysis.first_event ) / NS_PER_MS / 1000.0;
+        const double average_capacity = capacity * 8 / duration_s / 1000000.0;
+        const double average_throughput = departures * 8 / duration_s / 1000000.0;
+
+        vector<uint32_t> signal_delays = analysis.signal_delays();
+        nth_element( signal_delays.begin(), signal_delays.begin() + size_t( 0.95 * signal_delays.size() ),
+                     signal_delays.end() );
+
+        fprintf( stderr, "Average capacity: %.2f Mbits/s\n", average_capacity );
+        fprintf( stderr, "Average throughput: %.2f Mbits/s (%.1f%% utilization)\n",
+                 average_throughput, 100.0 * average_throughput / average_capacity );
+        fprintf( stderr, "50th percentile per-packet queueing delay: %.0f ms\n", all_delays.quantile( 0.5 ) );
+        fprintf( stderr, "95th percentile per-packet queueing delay: %.0f ms\n", all_delays.quantile( 0.95 ) );
+        fprintf( stderr, "99th percentile per-packet queueing delay: %.0f ms\n", all_delays.quantile( 0.99 ) );
+        fprintf( stderr, "95th percentile signal delay: %.0f ms\n",
+                 double( signal_delays[ size_t( 0.95 * signal_delays.size() ) ] ) );
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
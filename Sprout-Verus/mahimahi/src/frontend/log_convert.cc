@@ -0,0 +1,49 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "link_log.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* convert a binary mm-link log to the text format */
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 3 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " BINARY-LOG TEXT-LOG" );
+        }
+
+        const string input_filename = argv[ 1 ], output_filename = argv[ 2 ];
+
+        BinaryLinkLogReader log( input_filename );
+
+        FileDescriptor output( SystemCall( "open " + output_filename,
+                                           open( output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) );
+
+        string buffer = log.comments();
+        LinkLogEvent event;
+
+        while ( log.next( event ) ) {
+            buffer += format_link_log_event( event );
+
+            if ( buffer.size() >= 1 << 20 ) {
+                output.write( buffer );
+                buffer.clear();
+            }
+        }
+
+        if ( not buffer.empty() ) {
+            output.write( buffer );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
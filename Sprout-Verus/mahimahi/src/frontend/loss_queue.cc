@@ -1,9 +1,20 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <limits>
+#include <vector>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <endian.h>
 
 #include "loss_queue.hh"
 #include "timestamp.hh"
+#include "exception.hh"
+#include "ezio.hh"
+#include "util.hh"
 
 using namespace std;
 
@@ -11,52 +22,286 @@ LossQueue::LossQueue()
     : prng_( random_device()() )
 {}
 
-void LossQueue::read_packet( const string & contents )
+void LossQueue::read_packet( PacketBuffer && contents )
 {
     if ( not drop_packet( contents ) ) {
-        packet_queue_.emplace( contents );
+        packet_queue_.emplace( move( contents ) );
     }
 }
 
 void LossQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        fd.write( packet_queue_.front().data(), packet_queue_.front().size() );
         packet_queue_.pop();
     }
 }
 
-unsigned int LossQueue::wait_time( void )
+bool LossQueue::pop_output( PacketBuffer & packet )
+{
+    if ( packet_queue_.empty() ) {
+        return false;
+    }
+
+    packet = move( packet_queue_.front() );
+    packet_queue_.pop();
+    return true;
+}
+
+uint64_t LossQueue::wait_time( void )
+{
+    return packet_queue_.empty() ? numeric_limits<uint64_t>::max() : 0;
+}
+
+LossGap::LossGap( const double probability )
+    : probability_( probability ),
+      log_survival_( log1p( -probability ) ),
+      uniform_( 0.0, 1.0 )
+{
+    if ( not (probability >= 0 and probability <= 1) ) {
+        throw runtime_error( "loss probability must be between 0 and 1: " + to_string( probability ) );
+    }
+}
+
+uint64_t LossGap::operator()( default_random_engine & prng )
+{
+    if ( probability_ == 0 ) {
+        return NEVER;
+    } else if ( probability_ == 1 ) {
+        return 0;
+    }
+
+    /* geometrically distributed, by inversion (1 - u is in (0, 1]) */
+    const double gap = floor( log( 1.0 - uniform_( prng ) ) / log_survival_ );
+    return gap < double( NEVER / 2 ) ? gap : NEVER;
+}
+
+IIDLoss::IIDLoss( const double loss_rate )
+    : gap_( loss_rate ),
+      packets_until_drop_( gap_( prng_ ) )
+{}
+
+bool IIDLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
+{
+    if ( packets_until_drop_ == 0 ) {
+        packets_until_drop_ = gap_( prng_ );
+        return true;
+    }
+
+    if ( packets_until_drop_ != LossGap::NEVER ) {
+        packets_until_drop_--;
+    }
+
+    return false;
+}
+
+GilbertElliottParameters parse_gilbert_elliott( const string & str )
+{
+    vector<double> values;
+
+    istringstream fields( str );
+    for ( string field; getline( fields, field, ',' ); ) {
+        values.push_back( myatof( field ) );
+        if ( not (values.back() >= 0 and values.back() <= 1) ) {
+            throw runtime_error( "Gilbert-Elliott probabilities must be between 0 and 1: " + str );
+        }
+    }
+
+    if ( values.size() == 2 ) {
+        values.push_back( 0 );
+        values.push_back( 1 );
+    }
+
+    if ( values.size() != 4 ) {
+        throw runtime_error( "expected P,R[,LOSS-GOOD,LOSS-BAD]: " + str );
+    }
+
+    return { values[ 0 ], values[ 1 ], values[ 2 ], values[ 3 ] };
+}
+
+GilbertElliottLoss::GilbertElliottLoss( const GilbertElliottParameters & parameters )
+    : bad_( false ),
+      leave_good_( parameters.good_to_bad ),
+      leave_bad_( parameters.bad_to_good ),
+      good_loss_gap_( parameters.loss_in_good ),
+      bad_loss_gap_( parameters.loss_in_bad ),
+      packets_left_in_state_( 0 ),
+      packets_until_drop_( 0 )
+{
+    enter_state( false );
+}
+
+void GilbertElliottLoss::enter_state( const bool bad )
+{
+    bad_ = bad;
+
+    /* at least this packet, then until the chain moves on */
+    const uint64_t stay = (bad_ ? leave_bad_ : leave_good_)( prng_ );
+    packets_left_in_state_ = stay == LossGap::NEVER ? stay : stay + 1;
+
+    /* losses are memoryless, so the gap can start afresh */
+    packets_until_drop_ = (bad_ ? bad_loss_gap_ : good_loss_gap_)( prng_ );
+}
+
+bool GilbertElliottLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
+{
+    bool drop = false;
+
+    if ( packets_until_drop_ == 0 ) {
+        packets_until_drop_ = (bad_ ? bad_loss_gap_ : good_loss_gap_)( prng_ );
+        drop = true;
+    } else if ( packets_until_drop_ != LossGap::NEVER ) {
+        packets_until_drop_--;
+    }
+
+    if ( packets_left_in_state_ != LossGap::NEVER and --packets_left_in_state_ == 0 ) {
+        enter_state( not bad_ );
+    }
+
+    return drop;
+}
+
+static const char BINARY_LOSS_MAGIC[ 8 ] = { 'M', 'M', 'L', 'O', 'S', 'S', 0, 0 };
+static const size_t BINARY_LOSS_HEADER_SIZE = 16;
+
+TraceLoss::TraceLoss( const string & filename )
+    : file_(),
+      text_mask_(),
+      length_( 0 ),
+      position_( 0 ),
+      next_drop_( 0 )
+{
+    if ( filename.empty() ) {
+        return;
+    }
+
+    assert_not_root();
+
+    ifstream trace_file( filename );
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    char magic[ sizeof( BINARY_LOSS_MAGIC ) ];
+    if ( trace_file.read( magic, sizeof( magic ) )
+         and not memcmp( magic, BINARY_LOSS_MAGIC, sizeof( magic ) ) ) {
+        file_.reset( new MMapRegion( filename ) );
+
+        if ( file_->size() < BINARY_LOSS_HEADER_SIZE ) {
+            throw runtime_error( filename + ": truncated header" );
+        }
+
+        uint64_t length;
+        memcpy( &length, file_->data() + sizeof( BINARY_LOSS_MAGIC ), sizeof( length ) );
+        length_ = le64toh( length );
+
+        if ( (file_->size() - BINARY_LOSS_HEADER_SIZE) * 8 < length_ ) {
+            throw runtime_error( filename + ": mask is shorter than its header says" );
+        }
+    } else {
+        trace_file.clear();
+        trace_file.seekg( 0 );
+
+        for ( string line; getline( trace_file, line ); ) {
+            if ( not line.empty() and line.front() == '#' ) {
+                continue;
+            }
+
+            for ( const char ch : line ) {
+                if ( ch == '0' or ch == '1' ) {
+                    if ( length_ % 8 == 0 ) {
+                        text_mask_.push_back( 0 );
+                    }
+                    if ( ch == '1' ) {
+                        text_mask_.back() |= 1 << (length_ % 8);
+                    }
+                    length_++;
+                } else if ( not isspace( ch ) ) {
+                    throw runtime_error( filename + ": loss mask must contain only 0s and 1s" );
+                }
+            }
+        }
+    }
+
+    next_drop_ = find_drop( 0 );
+}
+
+const uint8_t * TraceLoss::mask( void ) const
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    return reinterpret_cast<const uint8_t *>( file_ ? file_->data() + BINARY_LOSS_HEADER_SIZE
+                                                    : text_mask_.data() );
+}
+
+/* index of the first lost packet at or after from (length_ if none) */
+uint64_t TraceLoss::find_drop( uint64_t from ) const
+{
+    const uint8_t * const bits = mask();
+
+    while ( from < length_ ) {
+        if ( from % 64 == 0 and from + 64 <= length_ ) {
+            uint64_t word;
+            memcpy( &word, bits + from / 8, sizeof( word ) );
+            word = le64toh( word );
+
+            if ( word == 0 ) {
+                from += 64;
+                continue;
+            }
+
+            return from + __builtin_ctzll( word );
+        }
+
+        if ( bits[ from / 8 ] & (1 << (from % 8)) ) {
+            return from;
+        }
+
+        from++;
+    }
+
+    return length_;
 }
 
-bool IIDLoss::drop_packet( const string & packet __attribute((unused)) )
+bool TraceLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
-    return drop_dist_( prng_ );
+    if ( length_ == 0 ) {
+        return false;
+    }
+
+    const bool drop = position_ == next_drop_;
+
+    position_++;
+
+    if ( position_ == length_ ) { /* wrap around */
+        position_ = 0;
+        next_drop_ = find_drop( 0 );
+    } else if ( drop ) {
+        next_drop_ = find_drop( position_ );
+    }
+
+    return drop;
 }
 
-static const double MS_PER_SECOND = 1000.0;
+static const double NS_PER_SECOND = 1000000000.0;
 
 SwitchingLink::SwitchingLink( const double mean_on_time, const double mean_off_time )
     : link_is_on_( false ),
-      on_process_( 1.0 / (MS_PER_SECOND * mean_off_time) ),
-      off_process_( 1.0 / (MS_PER_SECOND * mean_on_time) ),
-      next_switch_time_( timestamp() )
+      on_process_( 1.0 / (NS_PER_SECOND * mean_off_time) ),
+      off_process_( 1.0 / (NS_PER_SECOND * mean_on_time) ),
+      next_switch_time_( timestamp_ns() )
 {}
 
 uint64_t bound( const double x )
 {
-    if ( x > (1 << 30) ) {
-        return 1 << 30;
+    if ( x > (uint64_t( 1 ) << 60) ) {
+        return uint64_t( 1 ) << 60;
     }
 
     return x;
 }
 
-unsigned int SwitchingLink::wait_time( void )
+uint64_t SwitchingLink::wait_time( void )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_ns();
 
     while ( next_switch_time_ <= now ) {
         /* switch */
@@ -69,14 +314,10 @@ unsigned int SwitchingLink::wait_time( void )
         return 0;
     }
 
-    if ( next_switch_time_ - now > numeric_limits<uint16_t>::max() ) {
-        return numeric_limits<uint16_t>::max();
-    }
-
     return next_switch_time_ - now;
 }
 
-bool SwitchingLink::drop_packet( const string & packet __attribute((unused)) )
+bool SwitchingLink::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
     return !link_is_on_;
 }
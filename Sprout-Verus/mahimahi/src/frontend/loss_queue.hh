@@ -7,15 +7,19 @@
 #include <cstdint>
 #include <string>
 #include <random>
+#include <memory>
+#include <limits>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
+#include "mmap_region.hh"
 
 class LossQueue
 {
 private:
-    std::queue<std::string> packet_queue_ {};
+    std::queue<PacketBuffer> packet_queue_ {};
 
-    virtual bool drop_packet( const std::string & packet ) = 0;
+    virtual bool drop_packet( const PacketBuffer & packet ) = 0;
 
 protected:
     std::default_random_engine prng_;
@@ -24,26 +28,111 @@ public:
     LossQueue();
     virtual ~LossQueue() {}
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void );
+    /* take the next packet that is ready to leave, if any (instead of
+       writing it to a device, e.g. in a SimulatedPath) */
+    bool pop_output( PacketBuffer & packet );
+
+    uint64_t wait_time( void ); /* ns */
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
 
     static bool finished( void ) { return false; }
 };
 
+/* The number of packets that get through before the next loss, when
+   each is lost with the given probability: drawing this once per loss
+   (instead of rolling the dice for every packet) costs one random
+   number per loss, which matters at millions of packets per second. */
+class LossGap
+{
+private:
+    double probability_;
+    double log_survival_; /* log( 1 - probability ) */
+    std::uniform_real_distribution<> uniform_;
+
+public:
+    static const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    LossGap( const double probability );
+
+    uint64_t operator()( std::default_random_engine & prng );
+};
+
+/* each packet is lost independently, with the same probability */
 class IIDLoss : public LossQueue
 {
 private:
-    std::bernoulli_distribution drop_dist_;
+    LossGap gap_;
+    uint64_t packets_until_drop_;
+
+    bool drop_packet( const PacketBuffer & packet ) override;
+
+public:
+    IIDLoss( const double loss_rate );
+};
+
+struct GilbertElliottParameters
+{
+    double good_to_bad, bad_to_good; /* per-packet probabilities of changing state */
+    double loss_in_good, loss_in_bad;
+};
+
+/* parse "P,R[,LOSS-GOOD,LOSS-BAD]" (the losses default to 0 and 1) */
+GilbertElliottParameters parse_gilbert_elliott( const std::string & str );
+
+/* Bursty losses: a two-state Markov chain (Gilbert-Elliott), with a
+   loss rate for each state. The number of packets spent in a state is
+   drawn on entering it, like the gaps between losses, so packets that
+   are neither lost nor the last in their state cost no random numbers. */
+class GilbertElliottLoss : public LossQueue
+{
+private:
+    bool bad_;
+    LossGap leave_good_, leave_bad_;
+    LossGap good_loss_gap_, bad_loss_gap_;
+    uint64_t packets_left_in_state_;
+    uint64_t packets_until_drop_;
+
+    void enter_state( const bool bad );
+
+    bool drop_packet( const PacketBuffer & packet ) override;
+
+public:
+    GilbertElliottLoss( const GilbertElliottParameters & parameters );
+};
+
+/* Replays a loss mask, one bit per packet (1 = lost), over and over.
+   Masks come in two formats:
+
+   text:   a sequence of 0s and 1s, with whitespace ignored and lines
+           starting with '#' skipped.
+
+   binary: a 16-byte header ("MMLOSS\0\0", u64 number of packets,
+           little-endian), followed by the mask, packet i being bit
+           (i % 8) of byte (i / 8). Binary masks are mmap'd.
+
+   The position of the next loss is found by scanning the mask a word
+   at a time, so the cost per packet doesn't depend on the loss rate. */
+class TraceLoss : public LossQueue
+{
+private:
+    std::unique_ptr<MMapRegion> file_; /* binary masks */
+    std::string text_mask_; /* text masks, packed */
+    uint64_t length_; /* packets in the mask */
+    uint64_t position_; /* index of the next packet */
+    uint64_t next_drop_; /* index of the next lost packet (length_ if none) */
+
+    const uint8_t * mask( void ) const;
+    uint64_t find_drop( uint64_t from ) const;
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
-    IIDLoss( const double loss_rate ) : drop_dist_( loss_rate ) {}
+    TraceLoss( const std::string & filename ); /* empty: nothing is lost */
 };
 
 class SwitchingLink : public LossQueue
@@ -53,16 +142,16 @@ private:
     std::exponential_distribution<> on_process_;
     std::exponential_distribution<> off_process_;
 
-    uint64_t next_switch_time_;
+    uint64_t next_switch_time_; /* ns */
 
     void calculate_next_switch_time( void );
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
     SwitchingLink( const double mean_on_time_, const double mean_off_time );
 
-    unsigned int wait_time( void );
+    uint64_t wait_time( void ); /* ns */
 };
 
 #endif /* LOSS_QUEUE_HH */
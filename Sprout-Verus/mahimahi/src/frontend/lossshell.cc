@@ -15,7 +15,24 @@ using namespace std;
 
 void usage( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]\n"
+                         + "       " + program_name + " --gilbert-elliott=P,R[,LOSS-GOOD,LOSS-BAD] uplink|downlink [COMMAND...]\n"
+                         + "       " + program_name + " --loss-trace=FILENAME uplink|downlink [COMMAND...]" );
+}
+
+/* the lossy direction gets one set of arguments, the other direction the other */
+template <class LossType, class Argument>
+int run_loss_shell( char ** const user_environment, const string & link,
+                    const string & shell_prefix, const vector<string> & command,
+                    const Argument & lossy, const Argument & lossless )
+{
+    PacketShell<LossType> loss_app( "loss", user_environment );
+
+    loss_app.start_uplink( shell_prefix,
+                           command,
+                           link == "uplink" ? lossy : lossless );
+    loss_app.start_downlink( link == "downlink" ? lossy : lossless );
+    return loss_app.wait_for_exit();
 }
 
 int main( int argc, char *argv[] )
@@ -27,55 +44,96 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 3 ) {
-            usage( argv[ 0 ] );
+        const option command_line_options[] = {
+            { "gilbert-elliott",  required_argument, nullptr, 'g' },
+            { "loss-trace",       required_argument, nullptr, 't' },
+            { 0,                                  0, nullptr, 0 }
+        };
+
+        string gilbert_elliott, loss_trace;
+
+        while ( true ) {
+            /* stop at the first non-option (the direction), so the command can have options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'g':
+                gilbert_elliott = optarg;
+                break;
+            case 't':
+                loss_trace = optarg;
+                break;
+            case '?':
+                usage( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
         }
 
-        const double loss_rate = myatof( argv[ 2 ] );
-        if ( (0 <= loss_rate) and (loss_rate <= 1) ) {
-            /* do nothing */
-        } else {
-            cerr << "Error: loss rate must be between 0 and 1." << endl;
+        if ( not gilbert_elliott.empty() and not loss_trace.empty() ) {
             usage( argv[ 0 ] );
         }
 
-        double uplink_loss = 0, downlink_loss = 0;
+        /* the loss models given by options take the place of RATE */
+        const bool iid = gilbert_elliott.empty() and loss_trace.empty();
+        const int command_start = optind + (iid ? 2 : 1);
 
-        const string link = argv[ 1 ];
-        if ( link == "uplink" ) {
-            uplink_loss = loss_rate;
-        } else if ( link == "downlink" ) {
-            downlink_loss = loss_rate;
-        } else {
+        if ( argc < command_start ) {
+            usage( argv[ 0 ] );
+        }
+
+        const string link = argv[ optind ];
+        if ( link != "uplink" and link != "downlink" ) {
             usage( argv[ 0 ] );
         }
 
         vector<string> command;
 
-        if ( argc == 3 ) {
+        if ( argc == command_start ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 3; i < argc; i++ ) {
+            for ( int i = command_start; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
-        PacketShell<IIDLoss> loss_app( "loss", user_environment );
-
         string shell_prefix = "[loss ";
         if ( link == "uplink" ) {
             shell_prefix += "up=";
         } else {
             shell_prefix += "down=";
         }
-        shell_prefix += argv[ 2 ];
+
+        if ( not gilbert_elliott.empty() ) {
+            shell_prefix += "ge:" + gilbert_elliott + "] ";
+            return run_loss_shell<GilbertElliottLoss>( user_environment, link, shell_prefix, command,
+                                                       parse_gilbert_elliott( gilbert_elliott ),
+                                                       GilbertElliottParameters { 0, 0, 0, 0 } );
+        }
+
+        if ( not loss_trace.empty() ) {
+            shell_prefix += "trace] ";
+            return run_loss_shell<TraceLoss>( user_environment, link, shell_prefix, command,
+                                              loss_trace, string() );
+        }
+
+        const double loss_rate = myatof( argv[ optind + 1 ] );
+        if ( (0 <= loss_rate) and (loss_rate <= 1) ) {
+            /* do nothing */
+        } else {
+            cerr << "Error: loss rate must be between 0 and 1." << endl;
+            usage( argv[ 0 ] );
+        }
+
+        shell_prefix += argv[ optind + 1 ];
         shell_prefix += "] ";
 
-        loss_app.start_uplink( shell_prefix,
-                               command,
-                               uplink_loss );
-        loss_app.start_downlink( downlink_loss );
-        return loss_app.wait_for_exit();
+        return run_loss_shell<IIDLoss>( user_environment, link, shell_prefix, command,
+                                        loss_rate, 0.0 );
     } catch ( const exception & e ) {
         print_exception( e );
         return EXIT_FAILURE;
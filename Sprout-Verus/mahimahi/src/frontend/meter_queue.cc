@@ -17,25 +17,25 @@ MeterQueue::MeterQueue( const string & name, const bool graph )
     }
 }
 
-void MeterQueue::read_packet( const string & contents )
+void MeterQueue::read_packet( PacketBuffer && contents )
 {
-    packet_queue_.emplace( contents );
-
     /* meter it */
     if ( graph_ ) {
         graph_->add_value_now( 0, contents.size() );
     }
+
+    packet_queue_.emplace( move( contents ) );
 }
 
 void MeterQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        fd.write( packet_queue_.front().data(), packet_queue_.front().size() );
         packet_queue_.pop();
     }
 }
 
-unsigned int MeterQueue::wait_time( void ) const
+uint64_t MeterQueue::wait_time( void ) const
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    return packet_queue_.empty() ? numeric_limits<uint64_t>::max() : 0;
 }
@@ -9,21 +9,22 @@
 
 #include "file_descriptor.hh"
 #include "binned_livegraph.hh"
+#include "packet_buffer.hh"
 
 class MeterQueue
 {
 private:
-    std::queue<std::string> packet_queue_;
+    std::queue<PacketBuffer> packet_queue_;
     std::unique_ptr<BinnedLiveGraph> graph_;
 
 public:
     MeterQueue( const std::string & name, const bool graph );
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void ) const;
+    uint64_t wait_time( void ) const; /* ns */
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
 
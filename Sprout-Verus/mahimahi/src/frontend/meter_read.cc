@@ -0,0 +1,68 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <iostream>
+
+#include "binned_live_export.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* follow a meter export (e.g. from mm-link --uplink-export), printing
+   one tab-separated line per bin until the writer exits */
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 2 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " EXPORT-FILE" );
+        }
+
+        BinnedExportReader meter( argv[ 1 ] );
+
+        cout << "# " << meter.name() << endl;
+        cout << "# time (s)";
+        for ( const auto & label : meter.labels() ) {
+            cout << "\t" << label;
+        }
+        cout << endl;
+
+        uint64_t lost = 0;
+
+        while ( true ) {
+            /* check before reading, so the last bins aren't missed */
+            const bool finished = meter.finished();
+
+            const uint64_t lost_before = lost;
+            for ( const auto & bin : meter.read( lost ) ) {
+                cout << bin.end_ms / 1000.0;
+                for ( const auto & value : bin.values ) {
+                    if ( isnan( value ) ) {
+                        cout << "\t-";
+                    } else {
+                        cout << "\t" << value;
+                    }
+                }
+                cout << "\n";
+            }
+            cout << flush;
+
+            if ( lost != lost_before ) {
+                cerr << argv[ 0 ] << ": skipped " << lost - lost_before << " bins (reader fell behind)" << endl;
+            }
+
+            if ( finished ) {
+                break;
+            }
+
+            this_thread::sleep_for( chrono::milliseconds( meter.bin_width_ms() / 2 + 1 ) );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@ static int deepcgi_handler( request_rec* inpRequest );
 typedef struct {
     const char* working_dir;
     const char* recording_dir;
+    const char* index_file;
 } deepcgi_config;
 
 static deepcgi_config config;
@@ -30,6 +31,11 @@ const char* deepcgi_set_recordingdir(cmd_parms* cmd, void* cfg, const char* arg)
     return NULL;
 }
 
+const char* deepcgi_set_indexfile(cmd_parms* cmd, void* cfg, const char* arg) {
+    config.index_file = arg;
+    return NULL;
+}
+
 // ============================================================================
 // Directives to read configuration parameters
 // ============================================================================
@@ -38,6 +44,7 @@ static const command_rec deepcgi_directives[] =
 {
     AP_INIT_TAKE1( "workingDir", deepcgi_set_workingdir, NULL, RSRC_CONF, "Working directory" ),
     AP_INIT_TAKE1( "recordingDir", deepcgi_set_recordingdir, NULL, RSRC_CONF, "Recording directory" ),
+    AP_INIT_TAKE1( "indexFile", deepcgi_set_indexfile, NULL, RSRC_CONF, "Index of the recording" ),
     { NULL }
 };
 
@@ -75,6 +82,9 @@ int deepcgi_handler( request_rec* inpRequest )
 
     setenv( "MAHIMAHI_CHDIR", config.working_dir, TRUE );
     setenv( "MAHIMAHI_RECORD_PATH", config.recording_dir, TRUE );
+    if ( config.index_file != NULL ) {
+        setenv( "MAHIMAHI_REPLAY_INDEX", config.index_file, TRUE );
+    }
     setenv( "REQUEST_METHOD", request_method, TRUE );
     setenv( "REQUEST_URI", request_uri, TRUE );
     setenv( "SERVER_PROTOCOL", protocol, TRUE );
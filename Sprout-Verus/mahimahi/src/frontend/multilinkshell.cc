@@ -0,0 +1,709 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <net/route.h>
+
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "link_queue.hh"
+#include "delay_queue.hh"
+#include "infinite_packet_queue.hh"
+#include "packet_buffer.hh"
+#include "netdevice.hh"
+#include "nat.hh"
+#include "interfaces.hh"
+#include "socketpair.hh"
+#include "socket.hh"
+#include "epoll.hh"
+#include "timerfd.hh"
+#include "event_loop.hh"
+#include "system_runner.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* Runs many emulated links at once. Each link's copy of the command
+   runs in its own network namespace, as if in
+   "mm-delay DELAY mm-link UPLINK-TRACE DOWNLINK-TRACE COMMAND", but
+   instead of two ferry processes per link, a few worker threads (one
+   per core by default) carry the packets of all the links. */
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]... LINKS-FILE COMMAND..." << endl;
+    cerr << endl;
+    cerr << "Options = --threads=N --delay=MS" << endl;
+    cerr << "          --log-dir=DIRECTORY --binary-log" << endl;
+    cerr << endl;
+    cerr << "Each line of LINKS-FILE is \"UPLINK-TRACE DOWNLINK-TRACE [DELAY-MS]\"." << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* two queues in series, e.g. a link and then a delay */
+template <class FirstQueue, class SecondQueue>
+class SeriesQueue
+{
+private:
+    FirstQueue first_;
+    SecondQueue second_;
+
+    void transfer( void )
+    {
+        first_.wait_time(); /* catch up to now */
+
+        PacketBuffer packet;
+        while ( first_.pop_output( packet ) ) {
+            second_.read_packet( move( packet ) );
+        }
+    }
+
+public:
+    SeriesQueue( FirstQueue && first, SecondQueue && second )
+        : first_( move( first ) ), second_( move( second ) )
+    {}
+
+    void read_packet( PacketBuffer && packet )
+    {
+        first_.read_packet( move( packet ) );
+        transfer(); /* some queues let packets straight through */
+    }
+
+    void write_packets( FileDescriptor & fd )
+    {
+        transfer();
+        second_.write_packets( fd );
+    }
+
+    uint64_t wait_time( void ) /* ns */
+    {
+        transfer();
+        return min( first_.wait_time(), second_.wait_time() );
+    }
+
+    bool pending_output( void ) const { return second_.pending_output(); }
+};
+
+/* one link: the TUN devices on either side of it, and its queues */
+struct Link
+{
+    FileDescriptor ingress_tun; /* in the command's namespace */
+    FileDescriptor egress_tun;  /* in ours */
+
+    /* as if mm-link were inside mm-delay */
+    SeriesQueue<LinkQueue, DelayQueue> uplink;
+    SeriesQueue<DelayQueue, LinkQueue> downlink;
+};
+
+/* carries the packets of some of the links, on one thread */
+class Worker
+{
+private:
+    static const uint64_t STOP_ID = numeric_limits<uint64_t>::max();
+    static const uint64_t TIMER_ID = STOP_ID - 1;
+
+    vector<unique_ptr<Link>> links_;
+    FileDescriptor & stop_;
+    const unsigned int batch_size_; /* most datagrams to read from one TUN device per wakeup */
+    Epoll epoll_;
+    TimerFD timer_;
+
+    /* Each link has two queues: 2 * i is link i's uplink (fed from its
+       ingress device, as is epoll id 2 * i) and 2 * i + 1 its downlink.
+       A wakeup services only the queues that are due or were just fed,
+       so it costs the same however many links the thread has. */
+    typedef pair<uint64_t, uint64_t> Deadline; /* time (ns), queue */
+    priority_queue<Deadline, vector<Deadline>, greater<Deadline>> deadlines_;
+    vector<uint64_t> next_event_; /* by queue; a deadline that differs is stale */
+    vector<uint64_t> to_service_;
+    vector<bool> queued_for_service_;
+
+    uint64_t oversized_; /* datagrams dropped for filling a PacketBuffer */
+
+    void mark_for_service( const uint64_t queue )
+    {
+        if ( not queued_for_service_[ queue ] ) {
+            queued_for_service_[ queue ] = true;
+            to_service_.push_back( queue );
+        }
+    }
+
+    /* service the marked queues, and return the ns until the next is due */
+    uint64_t service_due_queues( void )
+    {
+        const uint64_t now = timestamp_ns();
+
+        while ( not deadlines_.empty() and deadlines_.top().first <= now ) {
+            const Deadline deadline = deadlines_.top();
+            deadlines_.pop();
+
+            if ( deadline.first == next_event_[ deadline.second ] ) {
+                mark_for_service( deadline.second );
+            }
+        }
+
+        for ( const uint64_t queue : to_service_ ) {
+            queued_for_service_[ queue ] = false;
+
+            Link & link = *links_[ queue / 2 ];
+            const uint64_t wait_ns = queue % 2 == 0 ? service( link.uplink, link.egress_tun )
+                                                    : service( link.downlink, link.ingress_tun );
+
+            if ( wait_ns == EventLoop::NO_TIMEOUT ) {
+                next_event_[ queue ] = EventLoop::NO_TIMEOUT;
+            } else {
+                next_event_[ queue ] = timestamp_ns() + wait_ns;
+                deadlines_.emplace( next_event_[ queue ], queue );
+            }
+        }
+        to_service_.clear();
+
+        /* drop the stale deadlines on top */
+        while ( not deadlines_.empty()
+                and deadlines_.top().first != next_event_[ deadlines_.top().second ] ) {
+            deadlines_.pop();
+        }
+
+        if ( deadlines_.empty() ) {
+            return EventLoop::NO_TIMEOUT;
+        }
+
+        const uint64_t after = timestamp_ns();
+        return deadlines_.top().first <= after ? 0 : deadlines_.top().first - after;
+    }
+
+    template <class QueueType>
+    void read_packets( FileDescriptor & tun, QueueType & queue )
+    {
+        for ( unsigned int i = 0; i < batch_size_; i++ ) {
+            PacketBuffer packet = PacketBuffer::allocate();
+            size_t size;
+
+            if ( not tun.read_nonblocking( packet.data(), PacketBuffer::CAPACITY, size ) ) {
+                break;
+            }
+
+            /* a full buffer means the datagram may have been
+               truncated, so drop it (as a too-small MTU would) */
+            if ( size == PacketBuffer::CAPACITY ) {
+                oversized_++;
+                continue;
+            }
+
+            packet.resize( size );
+            queue.read_packet( move( packet ) );
+
+            if ( tun.eof() ) {
+                break;
+            }
+        }
+    }
+
+    /* write whatever is ready, and return the ns until the queue next needs attention */
+    template <class QueueType>
+    static uint64_t service( QueueType & queue, FileDescriptor & tun )
+    {
+        queue.wait_time(); /* catch up to now */
+
+        /* writes to a TUN device never block */
+        if ( queue.pending_output() ) {
+            queue.write_packets( tun );
+        }
+
+        return queue.wait_time();
+    }
+
+public:
+    Worker( FileDescriptor & stop, const unsigned int batch_size )
+        : links_(), stop_( stop ), batch_size_( batch_size ), epoll_(), timer_(),
+          deadlines_(), next_event_(), to_service_(), queued_for_service_(),
+          oversized_( 0 )
+    {}
+
+    void add_link( unique_ptr<Link> && link ) { links_.emplace_back( move( link ) ); }
+
+    /* run until the stop fd becomes readable */
+    void run( void )
+    {
+        for ( uint64_t i = 0; i < links_.size(); i++ ) {
+            links_[ i ]->ingress_tun.set_blocking( false );
+            links_[ i ]->egress_tun.set_blocking( false );
+
+            epoll_.add( links_[ i ]->ingress_tun.fd_num(), EPOLLIN, 2 * i );
+            epoll_.add( links_[ i ]->egress_tun.fd_num(), EPOLLIN, 2 * i + 1 );
+        }
+
+        epoll_.add( stop_.fd_num(), EPOLLIN, STOP_ID );
+        epoll_.add( timer_.fd().fd_num(), EPOLLIN, TIMER_ID );
+
+        /* every queue is serviced once to start */
+        next_event_.assign( 2 * links_.size(), EventLoop::NO_TIMEOUT );
+        queued_for_service_.assign( 2 * links_.size(), false );
+        for ( uint64_t queue = 0; queue < 2 * links_.size(); queue++ ) {
+            mark_for_service( queue );
+        }
+
+        bool timer_armed = false;
+
+        while ( true ) {
+            const uint64_t wait_ns = service_due_queues();
+
+            /* epoll's timeout is in ms, so timeouts go through the timerfd */
+            int timeout_ms = -1;
+            if ( wait_ns == 0 ) {
+                timeout_ms = 0;
+            } else if ( wait_ns != EventLoop::NO_TIMEOUT ) {
+                timer_.arm( wait_ns );
+                timer_armed = true;
+            } else if ( timer_armed ) {
+                timer_.arm( 0 ); /* disarm */
+                timer_armed = false;
+            }
+
+            for ( const auto & event : epoll_.wait( timeout_ms ) ) {
+                const uint64_t id = event.data.u64;
+
+                if ( id == STOP_ID ) {
+                    return;
+                } else if ( id == TIMER_ID ) {
+                    if ( timer_.read_expirations() ) {
+                        timer_armed = false;
+                    }
+                } else if ( id % 2 == 0 ) {
+                    Link & link = *links_[ id / 2 ];
+                    read_packets( link.ingress_tun, link.uplink );
+                    mark_for_service( id );
+                } else {
+                    Link & link = *links_[ id / 2 ];
+                    read_packets( link.egress_tun, link.downlink );
+                    mark_for_service( id );
+                }
+            }
+        }
+    }
+
+    /* the links' packets come from this thread's pool, so they go with it */
+    void clear( void ) { links_.clear(); }
+
+    /* read only once the thread has been joined */
+    uint64_t oversized( void ) const { return oversized_; }
+
+    /* forbid copying or assigning */
+    Worker( const Worker & other ) = delete;
+    Worker & operator=( const Worker & other ) = delete;
+};
+
+/* the workers' threads, each pinned to a CPU (round-robin over the
+   ones we may use). Destroying this stops and joins them. */
+class WorkerThreads
+{
+private:
+    pair<UnixDomainSocket, UnixDomainSocket> stop_pipe_, failure_pipe_;
+    vector<unique_ptr<Worker>> workers_;
+    vector<thread> threads_;
+
+    mutex failure_mutex_;
+    exception_ptr failure_;
+
+    static vector<unsigned int> allowed_cpus( void )
+    {
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        SystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( cpus ), &cpus ) );
+
+        vector<unsigned int> ret;
+        for ( unsigned int i = 0; i < CPU_SETSIZE; i++ ) {
+            if ( CPU_ISSET( i, &cpus ) ) {
+                ret.push_back( i );
+            }
+        }
+
+        return ret;
+    }
+
+public:
+    WorkerThreads( const unsigned int count, const unsigned int batch_size )
+        : stop_pipe_( UnixDomainSocket::make_pair() ),
+          failure_pipe_( UnixDomainSocket::make_pair() ),
+          workers_(), threads_(), failure_mutex_(), failure_()
+    {
+        for ( unsigned int i = 0; i < count; i++ ) {
+            workers_.emplace_back( new Worker( stop_pipe_.second, batch_size ) );
+        }
+    }
+
+    static unsigned int cpu_count( void ) { return allowed_cpus().size(); }
+
+    Worker & worker( const unsigned int i ) { return *workers_.at( i ); }
+    unsigned int size( void ) const { return workers_.size(); }
+
+    void start( void )
+    {
+        const vector<unsigned int> cpus = allowed_cpus();
+
+        for ( unsigned int i = 0; i < workers_.size(); i++ ) {
+            threads_.emplace_back( [this, i] () {
+                    try {
+                        workers_[ i ]->run();
+                    } catch ( ... ) {
+                        {
+                            unique_lock<mutex> lock( failure_mutex_ );
+                            if ( not failure_ ) {
+                                failure_ = current_exception();
+                            }
+                        }
+                        failure_pipe_.first.write( "x" );
+                    }
+                    workers_[ i ]->clear();
+                } );
+
+            cpu_set_t cpu;
+            CPU_ZERO( &cpu );
+            CPU_SET( cpus.at( i % cpus.size() ), &cpu );
+
+            const int error = pthread_setaffinity_np( threads_.back().native_handle(), sizeof( cpu ), &cpu );
+            if ( error ) {
+                throw unix_error( "pthread_setaffinity_np", error );
+            }
+        }
+    }
+
+    /* readable once a worker has failed */
+    FileDescriptor & failure_fd( void ) { return failure_pipe_.second; }
+
+    void rethrow_failure( void )
+    {
+        unique_lock<mutex> lock( failure_mutex_ );
+        if ( failure_ ) {
+            rethrow_exception( failure_ );
+        }
+    }
+
+    ~WorkerThreads()
+    {
+        try {
+            stop_pipe_.first.write( "x" );
+        } catch ( const exception & e ) {
+            print_exception( e );
+            terminate(); /* the threads can't be stopped */
+        }
+
+        for ( auto & x : threads_ ) {
+            x.join();
+        }
+
+        uint64_t oversized = 0;
+        for ( const auto & x : workers_ ) {
+            oversized += x->oversized();
+        }
+
+        if ( oversized ) {
+            cerr << "Dropped " << oversized << " datagrams of "
+                 << PacketBuffer::CAPACITY << " bytes or more." << endl;
+        }
+    }
+
+    /* forbid copying or assigning */
+    WorkerThreads( const WorkerThreads & other ) = delete;
+    WorkerThreads & operator=( const WorkerThreads & other ) = delete;
+};
+
+struct LinkSpec
+{
+    string uplink_trace, downlink_trace;
+    double delay_ms;
+};
+
+vector<LinkSpec> read_links_file( const string & filename, const double default_delay_ms )
+{
+    TemporarilyUnprivileged tu;
+
+    ifstream file( filename );
+    if ( not file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    vector<LinkSpec> ret;
+    string line;
+    for ( unsigned int line_number = 1; getline( file, line ); line_number++ ) {
+        if ( line.empty() or line.front() == '#' ) {
+            continue;
+        }
+
+        istringstream fields( line );
+        LinkSpec link { "", "", default_delay_ms };
+        string delay, extra;
+        fields >> link.uplink_trace >> link.downlink_trace >> delay >> extra;
+
+        if ( link.uplink_trace.empty() ) {
+            continue; /* blank line */
+        }
+
+        if ( link.downlink_trace.empty() or not extra.empty() ) {
+            throw runtime_error( filename + ":" + to_string( line_number )
+                                 + ": expected \"UPLINK-TRACE DOWNLINK-TRACE [DELAY-MS]\"" );
+        }
+
+        if ( not delay.empty() ) {
+            link.delay_ms = myatof( delay );
+        }
+
+        if ( not (link.delay_ms >= 0) ) {
+            throw runtime_error( filename + ":" + to_string( line_number ) + ": delay must be non-negative" );
+        }
+
+        ret.push_back( link );
+    }
+
+    if ( ret.empty() ) {
+        throw runtime_error( filename + ": no links" );
+    }
+
+    return ret;
+}
+
+/* avoid the address of an enclosing shell's egress device */
+Address get_mahimahi_base( char ** const user_environment )
+{
+    /* temporarily break our security rule of not looking
+       at the user's environment before dropping privileges */
+    TemporarilyUnprivileged tu;
+    environ = user_environment;
+
+    const char * const mahimahi_base = getenv( "MAHIMAHI_BASE" );
+    const Address ret = mahimahi_base ? Address( mahimahi_base, 0 ) : Address();
+
+    environ = nullptr;
+    return ret;
+}
+
+/* the same setting as mm-link's ferries */
+unsigned int get_ferry_batch_size( char ** const user_environment )
+{
+    TemporarilyUnprivileged tu;
+    environ = user_environment;
+
+    try {
+        const unsigned int ret = ferry_batch_size();
+        environ = nullptr;
+        return ret;
+    } catch ( ... ) {
+        environ = nullptr;
+        throw;
+    }
+}
+
+/* a TUN device name unique to this process and link (the decimal
+   "ml-PID-LINK" could overflow the 15 characters an interface name may have) */
+string tun_name( const unsigned int link )
+{
+    ostringstream name;
+    name << "ml-" << hex << getpid() << "-" << link;
+
+    if ( name.str().size() >= IFNAMSIZ ) {
+        throw runtime_error( "TUN device name too long: " + name.str() );
+    }
+
+    return name.str();
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment while running as root */
+        char ** const user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        string command_line { argv[ 0 ] }; /* for the log files */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + argv[ i ];
+        }
+
+        const option command_line_options[] = {
+            { "threads",    required_argument, nullptr, 't' },
+            { "delay",      required_argument, nullptr, 'd' },
+            { "log-dir",    required_argument, nullptr, 'g' },
+            { "binary-log",       no_argument, nullptr, 'b' },
+            { 0,                            0, nullptr, 0 }
+        };
+
+        unsigned int thread_count = 0;
+        double default_delay_ms = 0;
+        string log_dir;
+        bool binary_log = false;
+
+        /* "+": the command's own options are left alone */
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 't': {
+                const long int threads = myatoi( optarg );
+                if ( threads <= 0 ) {
+                    throw runtime_error( "number of threads must be positive" );
+                }
+                thread_count = threads;
+                break;
+            }
+            case 'd':
+                default_delay_ms = myatof( optarg );
+                break;
+            case 'g':
+                log_dir = optarg;
+                break;
+            case 'b':
+                binary_log = true;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 1 >= argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const vector<LinkSpec> specs = read_links_file( argv[ optind ], default_delay_ms );
+
+        vector<string> command;
+        for ( int i = optind + 1; i < argc; i++ ) {
+            command.push_back( argv[ i ] );
+        }
+
+        if ( thread_count == 0 ) {
+            thread_count = min( size_t( WorkerThreads::cpu_count() ), specs.size() );
+        }
+
+        const Address mahimahi_base = get_mahimahi_base( user_environment );
+        const unsigned int batch_size = get_ferry_batch_size( user_environment );
+
+        /* blocks the signals it handles, in all the threads to come */
+        EventLoop event_loop;
+
+        /* initialize base timestamp value before any forking */
+        initial_timestamp();
+
+        WorkerThreads workers( thread_count, batch_size );
+
+        /* every link's addresses at once, so no two links share one */
+        const auto addresses = unassigned_address_pairs( specs.size(), mahimahi_base );
+
+        vector<Address> ingress_addrs;
+        for ( const auto & egress_ingress : addresses ) {
+            ingress_addrs.push_back( egress_ingress.second );
+        }
+        NAT nat_rules( ingress_addrs );
+
+        for ( unsigned int i = 0; i < specs.size(); i++ ) {
+            const Address & egress_addr = addresses[ i ].first, & ingress_addr = addresses[ i ].second;
+
+            TunDevice egress_tun( tun_name( i ), egress_addr, ingress_addr );
+
+            auto pipe = UnixDomainSocket::make_pair();
+
+            /* the command, in a new network namespace; the
+               others keep running when one exits successfully */
+            event_loop.add_special_child_process( 0, "link " + to_string( i ), [&] () {
+                    TunDevice ingress_tun( "ingress", ingress_addr, egress_addr );
+
+                    /* bring up localhost */
+                    interface_ioctl( SIOCSIFFLAGS, "lo",
+                                     [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
+
+                    /* create default route */
+                    rtentry route;
+                    zero( route );
+
+                    route.rt_gateway = egress_addr.to_sockaddr();
+                    route.rt_dst = route.rt_genmask = Address().to_sockaddr();
+                    route.rt_flags = RTF_UP | RTF_GATEWAY;
+
+                    SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
+
+                    /* the worker writes to and reads from it directly */
+                    pipe.first.send_fd( ingress_tun );
+
+                    drop_privileges();
+
+                    /* restore environment */
+                    environ = user_environment;
+
+                    /* set MAHIMAHI_BASE if not set already to indicate outermost container */
+                    SystemCall( "setenv", setenv( "MAHIMAHI_BASE",
+                                                  egress_addr.ip().c_str(),
+                                                  false /* don't override */ ) );
+
+                    /* tell the copies of the command apart */
+                    SystemCall( "setenv", setenv( "MAHIMAHI_LINK", to_string( i ).c_str(), true ) );
+
+                    prepend_shell_prefix( "[link " + to_string( i ) + "] " );
+
+                    return ezexec( command, true );
+                }, true ); /* new network namespace */
+
+            FileDescriptor ingress_tun = pipe.second.recv_fd();
+
+            /* the queues open files as the user */
+            TemporarilyUnprivileged tu;
+
+            const LinkSpec & spec = specs[ i ];
+            const uint64_t delay_ns = llround( spec.delay_ms * NS_PER_MS );
+            const string log_prefix = log_dir.empty() ? "" : log_dir + "/";
+            const string uplink_log = log_dir.empty() ? "" : log_prefix + "uplink-" + to_string( i ) + ".log";
+            const string downlink_log = log_dir.empty() ? "" : log_prefix + "downlink-" + to_string( i ) + ".log";
+
+            workers.worker( i % workers.size() ).add_link( unique_ptr<Link>( new Link {
+                        move( ingress_tun ),
+                        move( egress_tun ),
+                        { LinkQueue( "Uplink " + to_string( i ), spec.uplink_trace, uplink_log, binary_log,
+                                     true, false, false, "", "",
+                                     unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( "" ) ),
+                                     command_line ),
+                          DelayQueue( delay_ns ) },
+                        { DelayQueue( delay_ns ),
+                          LinkQueue( "Downlink " + to_string( i ), spec.downlink_trace, downlink_log, binary_log,
+                                     true, false, false, "", "",
+                                     unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( "" ) ),
+                                     command_line ) } } ) );
+        }
+
+        /* all the forking is done */
+        workers.start();
+
+        event_loop.add_simple_input_handler( workers.failure_fd(),
+                                             [&] () {
+                                                 workers.rethrow_failure();
+                                                 return ResultType::Exit;
+                                             } );
+
+        return event_loop.loop();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
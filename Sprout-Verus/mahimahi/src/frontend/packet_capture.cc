@@ -0,0 +1,259 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "packet_capture.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* bounds on the ring (about 6 MB to 100 MB) */
+static const size_t MIN_RING_CAPACITY = 1 << 12; /* packets */
+static const size_t MAX_RING_CAPACITY = 1 << 16; /* packets */
+
+static const size_t WRITE_SIZE = 1 << 20; /* bytes */
+
+/* pcapng block types, option codes and the link type of a TUN device */
+static const uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+static const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+static const uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+static const uint32_t INTERFACE_STATISTICS_BLOCK = 0x00000005;
+static const uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+
+static const uint16_t OPT_ENDOFOPT = 0;
+static const uint16_t OPT_COMMENT = 1;
+static const uint16_t IF_NAME = 2;
+static const uint16_t IF_TSRESOL = 9;
+static const uint16_t ISB_IFDROP = 5;
+
+static const uint16_t LINKTYPE_RAW = 101;
+
+const size_t PacketCapture::SNAPLEN;
+const uint64_t PacketCapture::WRITER_STALL;
+
+/* pcapng is written in the byte order of the machine that writes it
+   (the section header says which), so the fields go in as they are */
+template <typename T>
+static void append_field( string & buffer, const T & field )
+{
+    buffer.append( reinterpret_cast<const char *>( &field ), sizeof( field ) );
+}
+
+static void pad_to_32_bits( string & buffer )
+{
+    buffer.append( (4 - buffer.size() % 4) % 4, 0 );
+}
+
+static void append_option( string & buffer, const uint16_t code, const char * const value, const size_t length )
+{
+    append_field( buffer, code );
+    append_field( buffer, uint16_t( length ) );
+    buffer.append( value, length );
+    pad_to_32_bits( buffer );
+}
+
+/* a block is its type, its total length, the body, and the total length again */
+static void append_block( string & buffer, const uint32_t type, const string & body )
+{
+    const uint32_t total_length = 12 + body.size();
+    append_field( buffer, type );
+    append_field( buffer, total_length );
+    buffer += body;
+    append_field( buffer, total_length );
+}
+
+/* append a number's digits (the comments are formatted for every
+   packet, so into a buffer that is reused rather than from strings) */
+static void append_decimal( string & buffer, uint64_t number )
+{
+    char digits[ 20 ];
+    size_t length = 0;
+    do {
+        digits[ length++ ] = '0' + number % 10;
+        number /= 10;
+    } while ( number );
+
+    while ( length ) {
+        buffer.push_back( digits[ --length ] );
+    }
+}
+
+static void append_ms( string & buffer, const uint64_t ns )
+{
+    append_decimal( buffer, ns / NS_PER_MS );
+    buffer.push_back( '.' );
+    append_decimal( buffer, ns % NS_PER_MS / 100000 );
+    buffer.append( " ms" );
+}
+
+/* room for a delivery and a drop of each packet the link can deliver
+   while the writer is stalled, as a power of two */
+static size_t ring_capacity( const uint64_t peak_packets )
+{
+    size_t capacity = MIN_RING_CAPACITY;
+    while ( capacity < MAX_RING_CAPACITY and capacity < 2 * peak_packets ) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+PacketCapture::PacketCapture( const string & filename, const string & interface_name,
+                              const uint64_t peak_packets )
+    : fd_( SystemCall( "open " + filename, open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) ),
+      start_time_( timestamp_ns() ),
+      epoch_offset_(),
+      ring_( ring_capacity( peak_packets ) ),
+      has_records_(),
+      skipped_( 0 ),
+      finishing_( false ),
+      failed_( false ),
+      writer_()
+{
+    const uint64_t wall_clock = chrono::duration_cast<chrono::nanoseconds>( chrono::system_clock::now().time_since_epoch() ).count();
+    epoch_offset_ = wall_clock - start_time_;
+
+    string header, body;
+
+    /* section header: no length given for the section */
+    append_field( body, BYTE_ORDER_MAGIC );
+    append_field( body, uint16_t( 1 ) ); /* version 1.0 */
+    append_field( body, uint16_t( 0 ) );
+    append_field( body, int64_t( -1 ) );
+    append_option( body, OPT_ENDOFOPT, nullptr, 0 );
+    append_block( header, SECTION_HEADER_BLOCK, body );
+
+    /* the one interface, with timestamps in ns */
+    body.clear();
+    append_field( body, LINKTYPE_RAW );
+    append_field( body, uint16_t( 0 ) );
+    append_field( body, uint32_t( SNAPLEN ) );
+    append_option( body, IF_NAME, interface_name.data(), interface_name.size() );
+    const char resolution = 9; /* 10^-9 s */
+    append_option( body, IF_TSRESOL, &resolution, 1 );
+    append_option( body, OPT_ENDOFOPT, nullptr, 0 );
+    append_block( header, INTERFACE_DESCRIPTION_BLOCK, body );
+
+    fd_.write( header );
+
+    writer_ = thread( [&] () { write_records(); } );
+}
+
+PacketCapture::~PacketCapture()
+{
+    try {
+        finishing_ = true;
+        has_records_.ring();
+        writer_.join();
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
+
+void PacketCapture::add( const uint64_t time, const QueuedPacket & packet, const char * const drop_reason )
+{
+    if ( failed_ ) {
+        throw runtime_error( "PacketCapture: writer thread has stopped" );
+    }
+
+    /* don't wait for the writer: that would change the link's timing */
+    Record * const record = ring_.claim();
+    if ( not record ) {
+        skipped_++;
+        return;
+    }
+
+    record->time = time;
+    record->arrival_time = packet.arrival_time;
+    record->drop_reason = drop_reason;
+    record->length = min( packet.contents.size(), SNAPLEN );
+    memcpy( record->data, packet.contents.data(), record->length );
+    ring_.publish();
+
+    has_records_.ring_if_waiting();
+}
+
+/* the writer thread */
+void PacketCapture::write_records( void )
+{
+    try {
+        string buffer, body, comment;
+
+        /* the link's time, for the statistics at the end */
+        uint64_t last_time = start_time_;
+
+        while ( true ) {
+            has_records_.wait_until( [&] () { return finishing_ or ring_.front(); } );
+
+            const bool finishing = finishing_;
+
+            const Record * record;
+            while ( (record = ring_.front()) ) {
+                last_time = max( last_time, record->time );
+
+                const uint64_t time = record->time + epoch_offset_;
+                comment.clear();
+                if ( record->drop_reason ) {
+                    comment.append( "dropped (" );
+                    comment.append( record->drop_reason );
+                    comment.append( ") after " );
+                } else {
+                    comment.append( "delivered after " );
+                }
+                append_ms( comment, record->time - record->arrival_time );
+                comment.append( ", arrived " );
+                append_decimal( comment, (record->arrival_time + epoch_offset_) / 1000 );
+                comment.append( " us" );
+
+                body.clear();
+                append_field( body, uint32_t( 0 ) ); /* interface */
+                append_field( body, uint32_t( time >> 32 ) );
+                append_field( body, uint32_t( time ) );
+                append_field( body, record->length ); /* captured */
+                append_field( body, record->length ); /* on the wire */
+                body.append( record->data, record->length );
+                ring_.release();
+
+                pad_to_32_bits( body );
+                append_option( body, OPT_COMMENT, comment.data(), comment.size() );
+                append_option( body, OPT_ENDOFOPT, nullptr, 0 );
+                append_block( buffer, ENHANCED_PACKET_BLOCK, body );
+
+                if ( buffer.size() >= WRITE_SIZE ) {
+                    fd_.write( buffer );
+                    buffer.clear();
+                }
+            }
+
+            if ( finishing ) {
+                /* finish with the count of packets left out */
+                const uint64_t time = last_time + epoch_offset_;
+                const uint64_t skipped = skipped_;
+                body.clear();
+                append_field( body, uint32_t( 0 ) );
+                append_field( body, uint32_t( time >> 32 ) );
+                append_field( body, uint32_t( time ) );
+                append_option( body, ISB_IFDROP, reinterpret_cast<const char *>( &skipped ), sizeof( skipped ) );
+                append_option( body, OPT_ENDOFOPT, nullptr, 0 );
+                append_block( buffer, INTERFACE_STATISTICS_BLOCK, body );
+                fd_.write( buffer );
+                return;
+            }
+
+            if ( not buffer.empty() ) {
+                fd_.write( buffer );
+                buffer.clear();
+            }
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        failed_ = true;
+    }
+}
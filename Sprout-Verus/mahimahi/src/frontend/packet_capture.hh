@@ -0,0 +1,77 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_CAPTURE_HH
+#define PACKET_CAPTURE_HH
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <thread>
+
+#include "file_descriptor.hh"
+#include "queued_packet.hh"
+#include "spsc_ring.hh"
+#include "doorbell.hh"
+
+/* A pcapng capture of what a link does to each packet: every packet
+   it delivers or drops, stamped with the time it left the queue and
+   commented with when it arrived, how long it waited and (for a drop)
+   why. The packets are raw IP (the TUN payload).
+
+   As with LinkLog, nothing on the packet path touches the file: the
+   packets are copied straight into a lock-free ring, and a background thread
+   (asleep while the ring is empty) formats and writes them. The ring
+   holds what the link can deliver, and as much again dropped, while the
+   thread is stalled for up to WRITER_STALL. If the thread falls further
+   behind and the ring fills, packets are left out of the capture (never
+   delayed), and the count of those left out goes in the interface
+   statistics at the end. */
+
+class PacketCapture
+{
+public:
+    static const size_t SNAPLEN = 1504; /* the largest TUN payload */
+
+    /* the longest the writer should fall behind (e.g. on a slow disk) without losing packets */
+    static const uint64_t WRITER_STALL = 200000000; /* ns */
+
+private:
+    struct Record
+    {
+        uint64_t time;         /* ns: departure or drop */
+        uint64_t arrival_time; /* ns */
+        const char * drop_reason; /* a string literal, or null if delivered */
+        uint32_t length;
+        char data[ SNAPLEN ];
+    };
+
+    FileDescriptor fd_;
+    uint64_t start_time_;   /* ns, of the link */
+    uint64_t epoch_offset_; /* ns, from timestamp_ns() to the Unix epoch */
+
+    SPSCRing<Record> ring_;
+    Doorbell has_records_;
+
+    std::atomic<uint64_t> skipped_;
+    std::atomic<bool> finishing_, failed_;
+    std::thread writer_;
+
+    void add( const uint64_t time, const QueuedPacket & packet, const char * const drop_reason );
+    void write_records( void );
+
+public:
+    /* peak_packets: the most the link can deliver in any WRITER_STALL */
+    PacketCapture( const std::string & filename, const std::string & interface_name,
+                   const uint64_t peak_packets );
+    ~PacketCapture();
+
+    /* times in ns */
+    void delivered( const uint64_t time, const QueuedPacket & packet ) { add( time, packet, nullptr ); }
+    void dropped( const uint64_t time, const QueuedPacket & packet, const char * const reason ) { add( time, packet, reason ); }
+
+    /* forbid copying or assigning */
+    PacketCapture( const PacketCapture & other ) = delete;
+    PacketCapture & operator=( const PacketCapture & other ) = delete;
+};
+
+#endif /* PACKET_CAPTURE_HH */
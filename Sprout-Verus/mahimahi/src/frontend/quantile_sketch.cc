@@ -0,0 +1,121 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cmath>
+#include <stdexcept>
+
+#include "quantile_sketch.hh"
+
+using namespace std;
+
+/* smaller values are counted as zero */
+static const double MIN_VALUE = 1e-9;
+
+QuantileSketch::QuantileSketch( const double relative_accuracy )
+    : gamma_( (1 + relative_accuracy) / (1 - relative_accuracy) ),
+      log_gamma_( log( gamma_ ) ),
+      zero_count_( 0 ),
+      counts_(),
+      first_index_( 0 ),
+      count_( 0 )
+{
+    if ( relative_accuracy <= 0 or relative_accuracy >= 1 ) {
+        throw runtime_error( "QuantileSketch: relative accuracy must be between 0 and 1" );
+    }
+}
+
+/* bucket i holds ( gamma^(i-1), gamma^i ] */
+int QuantileSketch::bucket_index( const double value ) const
+{
+    return int( ceil( log( value ) / log_gamma_ ) );
+}
+
+/* the value within relative_accuracy of everything in the bucket */
+double QuantileSketch::bucket_value( const int index ) const
+{
+    return 2 * pow( gamma_, index ) / (gamma_ + 1);
+}
+
+void QuantileSketch::add( const double value )
+{
+    count_++;
+
+    if ( value < MIN_VALUE ) {
+        zero_count_++;
+        return;
+    }
+
+    const int index = bucket_index( value );
+
+    if ( counts_.empty() ) {
+        first_index_ = index;
+        counts_.push_back( 0 );
+    } else if ( index < first_index_ ) {
+        counts_.insert( counts_.begin(), first_index_ - index, 0 );
+        first_index_ = index;
+    } else if ( index >= first_index_ + int( counts_.size() ) ) {
+        counts_.resize( index - first_index_ + 1, 0 );
+    }
+
+    counts_[ index - first_index_ ]++;
+}
+
+void QuantileSketch::merge( const QuantileSketch & other )
+{
+    if ( other.gamma_ != gamma_ ) {
+        throw runtime_error( "QuantileSketch: can't merge sketches of different accuracy" );
+    }
+
+    if ( other.counts_.empty() ) {
+        zero_count_ += other.zero_count_;
+        count_ += other.count_;
+        return;
+    }
+
+    if ( counts_.empty() ) {
+        counts_ = other.counts_;
+        first_index_ = other.first_index_;
+    } else {
+        const int first = min( first_index_, other.first_index_ );
+        const int last = max( first_index_ + int( counts_.size() ),
+                              other.first_index_ + int( other.counts_.size() ) );
+
+        if ( first < first_index_ ) {
+            counts_.insert( counts_.begin(), first_index_ - first, 0 );
+            first_index_ = first;
+        }
+        counts_.resize( last - first_index_, 0 );
+
+        for ( size_t i = 0; i < other.counts_.size(); i++ ) {
+            counts_[ other.first_index_ - first_index_ + i ] += other.counts_[ i ];
+        }
+    }
+
+    zero_count_ += other.zero_count_;
+    count_ += other.count_;
+}
+
+double QuantileSketch::quantile( const double q ) const
+{
+    if ( count_ == 0 ) {
+        throw runtime_error( "QuantileSketch: no values" );
+    }
+
+    uint64_t rank = q * count_;
+    if ( rank >= count_ ) {
+        rank = count_ - 1;
+    }
+
+    if ( rank < zero_count_ ) {
+        return 0;
+    }
+
+    uint64_t seen = zero_count_;
+    for ( size_t i = 0; i < counts_.size(); i++ ) {
+        seen += counts_[ i ];
+        if ( seen > rank ) {
+            return bucket_value( first_index_ + i );
+        }
+    }
+
+    throw runtime_error( "QuantileSketch: counts inconsistent" );
+}
@@ -0,0 +1,41 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef QUANTILE_SKETCH_HH
+#define QUANTILE_SKETCH_HH
+
+#include <cstdint>
+#include <vector>
+
+/* Approximate quantiles of nonnegative values, in a fixed amount of
+   memory per order of magnitude (after DDSketch). Values are counted
+   in logarithmically-sized buckets, so any quantile is returned within
+   the given relative error, and two sketches with the same accuracy
+   can be merged by adding their counts. */
+
+class QuantileSketch
+{
+private:
+    double gamma_, log_gamma_;
+
+    uint64_t zero_count_; /* values too small to bucket */
+    std::vector<uint64_t> counts_;
+    int first_index_;     /* bucket index of counts_[ 0 ] */
+    uint64_t count_;
+
+    int bucket_index( const double value ) const;
+    double bucket_value( const int index ) const;
+
+public:
+    QuantileSketch( const double relative_accuracy = 0.01 );
+
+    void add( const double value );
+
+    void merge( const QuantileSketch & other );
+
+    /* the value of rank floor( q * count ) in sorted order */
+    double quantile( const double q ) const;
+
+    uint64_t count( void ) const { return count_; }
+};
+
+#endif /* QUANTILE_SKETCH_HH */
@@ -0,0 +1,182 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#include "replay_index.hh"
+
+using namespace std;
+
+static const char MAGIC[ 8 ] = { 'M', 'M', 'R', 'I', 'D', 'X', '0', '1' };
+static const uint32_t ABSENT = UINT32_MAX;
+
+struct ReplayIndexHeader
+{
+    char magic[ 8 ];
+    uint32_t entry_count;
+    uint32_t strings_length;
+};
+
+static string strip_query( const string & request_line )
+{
+    const auto index = request_line.find( "?" );
+    if ( index == string::npos ) {
+        return request_line;
+    } else {
+        return request_line.substr( 0, index );
+    }
+}
+
+/* what a stored request has to match exactly */
+static string index_key( const bool is_https, const char * host, const string & request_line )
+{
+    return string( is_https ? "https " : "http " )
+        + ( host ? "+" + string( host ) : "-" )
+        + "\n" + strip_query( request_line );
+}
+
+void ReplayIndexWriter::add( const bool is_https, const char * host, const char * user_agent,
+                             const string & first_line, const RecordLocation & location )
+{
+    records_.push_back( { index_key( is_https, host, first_line ), first_line,
+                          user_agent != nullptr, user_agent ? user_agent : "", location } );
+}
+
+void ReplayIndexWriter::write( FileDescriptor & fd ) const
+{
+    /* sort by key, keeping the directory order within a key (it breaks ties) */
+    vector< const Record * > sorted;
+    for ( const auto & record : records_ ) {
+        sorted.push_back( &record );
+    }
+    stable_sort( sorted.begin(), sorted.end(),
+                 [] ( const Record * a, const Record * b ) { return a->key < b->key; } );
+
+    string strings;
+    auto intern = [&] ( const string & str, uint32_t & offset, uint32_t & length ) {
+        if ( strings.size() + str.size() >= ABSENT ) {
+            throw runtime_error( "ReplayIndexWriter: recording too large to index" );
+        }
+        offset = strings.size();
+        length = str.size();
+        strings.append( str );
+    };
+
+    vector< ReplayIndexEntry > entries;
+    for ( const auto record : sorted ) {
+        ReplayIndexEntry entry;
+        intern( record->key, entry.key_offset, entry.key_length );
+        intern( record->first_line, entry.first_line_offset, entry.first_line_length );
+        intern( record->location.filename, entry.filename_offset, entry.filename_length );
+        entry.record_offset = record->location.offset;
+        entry.record_length = record->location.length;
+        entry.archived = record->location.archived;
+        if ( record->has_user_agent ) {
+            intern( record->user_agent, entry.user_agent_offset, entry.user_agent_length );
+        } else {
+            entry.user_agent_offset = ABSENT;
+            entry.user_agent_length = 0;
+        }
+        entries.push_back( entry );
+    }
+
+    ReplayIndexHeader header;
+    memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+    header.entry_count = entries.size();
+    header.strings_length = strings.size();
+
+    string contents( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+    contents.append( reinterpret_cast<const char *>( entries.data() ),
+                     entries.size() * sizeof( ReplayIndexEntry ) );
+    contents.append( strings );
+
+    fd.write( contents );
+}
+
+ReplayIndex::ReplayIndex( const string & filename )
+    : region_( filename ),
+      entries_( nullptr ),
+      entry_count_( 0 ),
+      strings_( nullptr ),
+      strings_length_( 0 )
+{
+    if ( region_.size() < sizeof( ReplayIndexHeader ) ) {
+        throw runtime_error( filename + ": truncated replay index" );
+    }
+
+    ReplayIndexHeader header;
+    memcpy( &header, region_.data(), sizeof( header ) );
+
+    if ( memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) ) {
+        throw runtime_error( filename + ": not a replay index" );
+    }
+
+    const size_t table_length = size_t( header.entry_count ) * sizeof( ReplayIndexEntry );
+    if ( region_.size() != sizeof( header ) + table_length + header.strings_length ) {
+        throw runtime_error( filename + ": truncated replay index" );
+    }
+
+    entries_ = reinterpret_cast<const ReplayIndexEntry *>( region_.data() + sizeof( header ) );
+    entry_count_ = header.entry_count;
+    strings_ = region_.data() + sizeof( header ) + table_length;
+    strings_length_ = header.strings_length;
+}
+
+string ReplayIndex::string_at( const uint32_t offset, const uint32_t length ) const
+{
+    if ( offset > strings_length_ or length > strings_length_ - offset ) {
+        throw runtime_error( "ReplayIndex: string out of bounds" );
+    }
+
+    return string( strings_ + offset, length );
+}
+
+bool ReplayIndex::find( const bool is_https, const char * host, const char * user_agent,
+                        const string & request_line, RecordLocation & location ) const
+{
+    const string key = index_key( is_https, host, request_line );
+
+    auto key_less = [&] ( const ReplayIndexEntry & entry, const string & k ) {
+        return string_at( entry.key_offset, entry.key_length ) < k;
+    };
+
+    const ReplayIndexEntry * const end = entries_ + entry_count_;
+
+    unsigned int best_score = 0;
+    const ReplayIndexEntry * best_match = nullptr;
+
+    for ( const ReplayIndexEntry * entry = lower_bound( entries_, end, key, key_less );
+          entry != end and string_at( entry->key_offset, entry->key_length ) == key;
+          entry++ ) {
+        /* match user agent */
+        if ( entry->user_agent_offset == ABSENT ) {
+            if ( user_agent ) {
+                continue;
+            }
+        } else if ( not user_agent
+                    or string_at( entry->user_agent_offset, entry->user_agent_length ) != user_agent ) {
+            continue;
+        }
+
+        /* score is size of common prefix */
+        const string first_line = string_at( entry->first_line_offset, entry->first_line_length );
+        const auto mismatch_point = mismatch( first_line.begin(),
+                                              first_line.begin() + min( first_line.size(), request_line.size() ),
+                                              request_line.begin() );
+        const unsigned int score = mismatch_point.first - first_line.begin();
+
+        if ( score > best_score ) {
+            best_score = score;
+            best_match = entry;
+        }
+    }
+
+    if ( not best_match ) {
+        return false;
+    }
+
+    location = { string_at( best_match->filename_offset, best_match->filename_length ),
+                 best_match->archived != 0, best_match->record_offset, best_match->record_length };
+    return true;
+}
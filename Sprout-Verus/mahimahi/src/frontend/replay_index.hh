@@ -0,0 +1,81 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef REPLAY_INDEX_HH
+#define REPLAY_INDEX_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "mmap_region.hh"
+#include "file_descriptor.hh"
+#include "record_archive.hh"
+
+/* An index of a recorded site, so the replayserver can find the
+   candidates for a request without opening and parsing every file in
+   the recording.
+
+   The file is a header, a table of fixed-size entries sorted by key,
+   and a pool of strings. The key is what a request must match exactly
+   (the scheme, the Host header and the request line up to the "?"); among
+   the entries sharing a key, the best match is the first with a
+   matching User-Agent and the longest common prefix with the full
+   request line. A null host or user agent means the header is absent. */
+
+struct ReplayIndexEntry
+{
+    uint32_t key_offset, key_length;
+    uint32_t first_line_offset, first_line_length;
+    uint32_t user_agent_offset, user_agent_length; /* offset is ABSENT if no header */
+    uint32_t filename_offset, filename_length;
+    uint64_t record_offset; /* where the record is, if it is in an archive */
+    uint32_t record_length;
+    uint32_t archived;
+};
+
+class ReplayIndexWriter
+{
+private:
+    struct Record
+    {
+        std::string key, first_line;
+        bool has_user_agent;
+        std::string user_agent;
+        RecordLocation location;
+    };
+
+    std::vector< Record > records_ {};
+
+public:
+    void add( const bool is_https, const char * host, const char * user_agent,
+              const std::string & first_line, const RecordLocation & location );
+
+    void write( FileDescriptor & fd ) const;
+};
+
+class ReplayIndex
+{
+private:
+    MMapRegion region_;
+    const ReplayIndexEntry * entries_;
+    uint32_t entry_count_;
+    const char * strings_;
+    size_t strings_length_;
+
+    std::string string_at( const uint32_t offset, const uint32_t length ) const;
+
+public:
+    ReplayIndex( const std::string & filename );
+
+    /* finds the best match for a request, returning false if there is none */
+    bool find( const bool is_https, const char * host, const char * user_agent,
+               const std::string & request_line, RecordLocation & location ) const;
+
+    uint32_t size( void ) const { return entry_count_; }
+
+    /* forbid copying or assigning */
+    ReplayIndex( const ReplayIndex & other ) = delete;
+    ReplayIndex & operator=( const ReplayIndex & other ) = delete;
+};
+
+#endif /* REPLAY_INDEX_HH */
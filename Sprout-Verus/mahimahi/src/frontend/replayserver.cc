@@ -16,6 +16,8 @@
 #include "http_request.hh"
 #include "http_response.hh"
 #include "file_descriptor.hh"
+#include "replay_index.hh"
+#include "record_archive.hh"
 
 using namespace std;
 
@@ -115,23 +117,29 @@ int main( void )
 
         SystemCall( "chdir", chdir( working_directory.c_str() ) );
 
-        const vector< string > files = list_directory_contents( recording_directory );
-
         unsigned int best_score = 0;
         MahimahiProtobufs::RequestResponse best_match;
 
-        for ( const auto & filename : files ) {
-            FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
-            MahimahiProtobufs::RequestResponse current_record;
-            if ( not current_record.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                throw runtime_error( filename + ": invalid HTTP request/response" );
-            }
+        const char * const index_filename = getenv( "MAHIMAHI_REPLAY_INDEX" );
 
-            unsigned int score = match_score( current_record, request_line, is_https );
-            if ( score > best_score ) {
-                best_match = current_record;
-                best_score = score;
+        if ( index_filename ) {
+            /* mm-webreplay has indexed the recording: only read the match */
+            const ReplayIndex index( index_filename );
+            RecordLocation location { "", false, 0, 0 };
+            if ( index.find( is_https, getenv( "HTTP_HOST" ), getenv( "HTTP_USER_AGENT" ),
+                             request_line, location ) ) {
+                best_match = read_record( location );
+                best_score = match_score( best_match, request_line, is_https );
             }
+        } else {
+            for_each_record( recording_directory,
+                             [&] ( const RecordLocation &, const MahimahiProtobufs::RequestResponse & current_record ) {
+                                 unsigned int score = match_score( current_record, request_line, is_https );
+                                 if ( score > best_score ) {
+                                     best_match = current_record;
+                                     best_score = score;
+                                 }
+                             } );
         }
 
         if ( best_score > 0 ) { /* give client the best match */
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <set>
+#include <memory>
 
 #include "util.hh"
 #include "netdevice.hh"
@@ -16,6 +17,8 @@
 #include "http_response.hh"
 #include "dns_server.hh"
 #include "exception.hh"
+#include "replay_index.hh"
+#include "record_archive.hh"
 
 #include "http_record.pb.h"
 
@@ -89,28 +92,37 @@ int main( int argc, char *argv[] )
         set< Address > unique_ip_and_port;
         vector< pair< string, Address > > hostname_to_ip;
 
+        /* index of the recording for the replayservers, owned by the user so they can read it */
+        unique_ptr< TempFile > replay_index;
+
         {
             TemporarilyUnprivileged tu;
             /* would be privilege escalation if we let the user read directories or open files as root */
 
-            const vector< string > files = list_directory_contents( directory  );
+            ReplayIndexWriter index_writer;
 
-            for ( const auto filename : files ) {
-                FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+            for_each_record( directory,
+                             [&] ( const RecordLocation & location, const MahimahiProtobufs::RequestResponse & protobuf ) {
+                                 const Address address( protobuf.ip(), protobuf.port() );
 
-                MahimahiProtobufs::RequestResponse protobuf;
-                if ( not protobuf.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                    throw runtime_error( filename + ": invalid HTTP request/response" );
-                }
+                                 unique_ip.emplace( address.ip(), 0 );
+                                 unique_ip_and_port.emplace( address );
 
-                const Address address( protobuf.ip(), protobuf.port() );
+                                 const HTTPRequest request( protobuf.request() );
 
-                unique_ip.emplace( address.ip(), 0 );
-                unique_ip_and_port.emplace( address );
+                                 hostname_to_ip.emplace_back( request.get_header_value( "Host" ), address );
 
-                hostname_to_ip.emplace_back( HTTPRequest( protobuf.request() ).get_header_value( "Host" ),
-                                             address );
-            }
+                                 auto header_or_null = [&] ( const string & name ) {
+                                     return request.has_header( name ) ? request.get_header_value( name ).c_str() : nullptr;
+                                 };
+
+                                 index_writer.add( protobuf.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS,
+                                                   header_or_null( "Host" ), header_or_null( "User-Agent" ),
+                                                   request.first_line(), location );
+                             } );
+
+            replay_index.reset( new TempFile( "/tmp/replayshell_index" ) );
+            index_writer.write( replay_index->fd() );
         }
 
         /* set up dummy interfaces */
@@ -123,7 +135,7 @@ int main( int argc, char *argv[] )
         /* set up web servers */
         vector< WebServer > servers;
         for ( const auto ip_port : unique_ip_and_port ) {
-            servers.emplace_back( ip_port, working_directory, directory );
+            servers.emplace_back( ip_port, working_directory, directory, replay_index->name() );
         }
 
         /* set up DNS server */
@@ -0,0 +1,250 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "simulated_path.hh"
+#include "delay_queue.hh"
+#include "loss_queue.hh"
+#include "link_queue.hh"
+#include "link_log.hh"
+#include "infinite_packet_queue.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Replays the arrivals recorded in an mm-link log through delay, loss
+   and link queues (in the order given, as if nested in shells), in
+   virtual time: a run over a long trace takes only as long as the
+   work. Replaying a log through the link that recorded it reproduces
+   the log. */
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " ARRIVAL-LOG [QUEUE]... [OPTION]..." << endl;
+    cerr << endl;
+    cerr << "QUEUE = --delay=MS | --loss=RATE | --link=TRACE" << endl;
+    cerr << "        | --gilbert-elliott=P,R[,LOSS-GOOD,LOSS-BAD] | --loss-trace=FILENAME" << endl;
+    cerr << "Options (for the link) = --log=FILENAME --binary-log --once" << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* the events of a log of either format, in order */
+class LinkLogEvents
+{
+private:
+    unique_ptr<BinaryLinkLogReader> binary_;
+    ifstream text_;
+    string comments_;
+    string line_;
+
+public:
+    LinkLogEvents( const string & filename )
+        : binary_(), text_(), comments_(), line_()
+    {
+        if ( is_binary_link_log( filename ) ) {
+            binary_.reset( new BinaryLinkLogReader( filename ) );
+            comments_ = binary_->comments();
+            return;
+        }
+
+        text_.open( filename );
+        if ( not text_.good() ) {
+            throw runtime_error( filename + ": error opening for reading" );
+        }
+
+        while ( text_.peek() == '#' and getline( text_, line_ ) ) {
+            comments_ += line_ + "\n";
+        }
+    }
+
+    uint64_t base_timestamp( void ) const /* ns */
+    {
+        return link_log_base_timestamp( comments_.data(), comments_.data() + comments_.size() ) * NS_PER_MS;
+    }
+
+    bool next( LinkLogEvent & event )
+    {
+        if ( binary_ ) {
+            return binary_->next( event );
+        }
+
+        while ( getline( text_, line_ ) ) {
+            if ( not line_.empty() and line_[ 0 ] != '#' ) {
+                event = parse_link_log_line( line_.data(), line_.data() + line_.size() );
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* no devices or namespaces, so nothing here needs privileges:
+           the queues may be made as whoever runs it, root included */
+        allow_root();
+
+        const option command_line_options[] = {
+            { "delay",           required_argument, nullptr, 'd' },
+            { "loss",            required_argument, nullptr, 'l' },
+            { "link",            required_argument, nullptr, 'k' },
+            { "gilbert-elliott", required_argument, nullptr, 'e' },
+            { "loss-trace",      required_argument, nullptr, 't' },
+            { "log",             required_argument, nullptr, 'g' },
+            { "binary-log",            no_argument, nullptr, 'b' },
+            { "once",                  no_argument, nullptr, 'o' },
+            { 0,                                 0, nullptr, 0 }
+        };
+
+        string command_line { argv[ 0 ] }; /* for the log file */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + argv[ i ];
+        }
+
+        vector<pair<char, string>> queues;
+        string logfile;
+        bool binary_log = false;
+        bool repeat = true;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'd':
+            case 'l':
+            case 'k':
+            case 'e':
+            case 't':
+                queues.emplace_back( opt, optarg );
+                break;
+            case 'g':
+                logfile = optarg;
+                break;
+            case 'b':
+                binary_log = true;
+                break;
+            case 'o':
+                repeat = false;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 1 != argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        LinkLogEvents arrivals( argv[ optind ] );
+
+        uint64_t packets_out = 0, bytes_out = 0;
+        SimulatedPath path( arrivals.base_timestamp(),
+                            [&] ( const uint64_t, PacketBuffer && packet ) {
+                                packets_out++;
+                                bytes_out += packet.size();
+                            } );
+
+        unsigned int links = 0;
+        for ( const auto & queue : queues ) {
+            switch ( queue.first ) {
+            case 'd': {
+                const double ms = myatof( queue.second );
+                if ( not (ms >= 0) ) {
+                    throw runtime_error( "delay must be non-negative: " + queue.second );
+                }
+                path.add_queue<DelayQueue>( uint64_t( llround( ms * NS_PER_MS ) ) );
+                break;
+            }
+            case 'l': {
+                const double rate = myatof( queue.second );
+                if ( not (rate >= 0 and rate <= 1) ) {
+                    throw runtime_error( "loss rate must be between 0 and 1: " + queue.second );
+                }
+                path.add_queue<IIDLoss>( rate );
+                break;
+            }
+            case 'e':
+                path.add_queue<GilbertElliottLoss>( parse_gilbert_elliott( queue.second ) );
+                break;
+            case 't':
+                path.add_queue<TraceLoss>( queue.second );
+                break;
+            case 'k':
+                if ( ++links > 1 ) {
+                    throw runtime_error( "only one --link is supported" );
+                }
+                path.add_queue<LinkQueue>( "Link", queue.second, logfile, binary_log, repeat, false, false, "", "",
+                                           unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( "" ) ),
+                                           command_line );
+                break;
+            }
+        }
+
+        if ( not logfile.empty() and links == 0 ) {
+            throw runtime_error( "--log requires a --link" );
+        }
+
+        const auto start = chrono::steady_clock::now();
+
+        /* send each arrival, and run until the last event of the log */
+        uint64_t packets_in = 0, bytes_in = 0, oversized = 0, end_time = path.now();
+        LinkLogEvent event;
+        while ( arrivals.next( event ) and not path.finished() ) {
+            end_time = max( end_time, event.time );
+
+            if ( event.type != '+' ) {
+                continue;
+            }
+
+            /* the ferries would have dropped it too */
+            if ( event.bytes >= PacketBuffer::CAPACITY ) {
+                oversized++;
+                continue;
+            }
+
+            PacketBuffer packet = PacketBuffer::allocate();
+            packet.resize( event.bytes );
+            path.send( event.time, move( packet ) );
+
+            packets_in++;
+            bytes_in += event.bytes;
+        }
+
+        path.advance( end_time );
+
+        const double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+        cout << "sent " << packets_in << " packets (" << bytes_in << " bytes), "
+             << "delivered " << packets_out << " (" << bytes_out << " bytes)" << endl;
+        if ( oversized ) {
+            cout << "skipped " << oversized << " packets of " << PacketBuffer::CAPACITY
+                 << " bytes or more" << endl;
+        }
+        cout << "simulated " << (path.now() - arrivals.base_timestamp()) / double( NS_PER_MS * 1000 )
+             << " s in " << seconds << " s" << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
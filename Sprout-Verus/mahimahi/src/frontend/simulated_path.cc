@@ -0,0 +1,97 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <limits>
+
+#include "simulated_path.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+SimulatedPath::SimulatedPath( const uint64_t start_time, const Sink & sink )
+    : stages_(),
+      sink_( sink ),
+      now_( start_time ),
+      virtual_time_token_( start_virtual_time( now_ ) )
+{}
+
+SimulatedPath::~SimulatedPath()
+{
+    /* the queues may read the clock on their way out */
+    stages_.clear();
+    stop_virtual_time( virtual_time_token_ );
+}
+
+uint64_t SimulatedPath::settle( void )
+{
+    uint64_t next_event = numeric_limits<uint64_t>::max();
+
+    for ( unsigned int i = 0; i < stages_.size(); i++ ) {
+        Stage & stage = *stages_[ i ];
+
+        /* catch the queue up to now, then pass on whatever left it */
+        stage.wait_time();
+
+        PacketBuffer packet;
+        while ( stage.pop_output( packet ) ) {
+            if ( i + 1 < stages_.size() ) {
+                stages_[ i + 1 ]->read_packet( move( packet ) );
+            } else {
+                sink_( now_, move( packet ) );
+            }
+        }
+
+        const uint64_t wait = stage.wait_time();
+        if ( wait == 0 ) {
+            throw runtime_error( "SimulatedPath: queue has output it did not release" );
+        } else if ( wait != numeric_limits<uint64_t>::max() ) {
+            next_event = min( next_event, now_ + wait );
+        }
+    }
+
+    return next_event;
+}
+
+void SimulatedPath::advance( const uint64_t time )
+{
+    if ( time < now_ ) {
+        throw runtime_error( "SimulatedPath: cannot go back in time" );
+    }
+
+    set_virtual_time( now_ );
+
+    for ( uint64_t next_event = settle(); next_event <= time; next_event = settle() ) {
+        now_ = next_event;
+        set_virtual_time( now_ );
+    }
+
+    /* nothing happens between the last event and then */
+    now_ = time;
+    set_virtual_time( now_ );
+}
+
+void SimulatedPath::send( const uint64_t time, PacketBuffer && packet )
+{
+    advance( time );
+
+    if ( stages_.empty() ) {
+        sink_( now_, move( packet ) );
+        return;
+    }
+
+    stages_.front()->read_packet( move( packet ) );
+
+    /* some queues let packets straight through */
+    settle();
+}
+
+bool SimulatedPath::finished( void ) const
+{
+    for ( const auto & stage : stages_ ) {
+        if ( stage->finished() ) {
+            return true;
+        }
+    }
+
+    return false;
+}
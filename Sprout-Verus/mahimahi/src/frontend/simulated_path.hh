@@ -0,0 +1,108 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef SIMULATED_PATH_HH
+#define SIMULATED_PATH_HH
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+#include "packet_buffer.hh"
+#include "timestamp.hh"
+
+/* A chain of mahimahi queues (LinkQueue, DelayQueue, LossQueue...),
+   as if each were in its own nested shell, run as a discrete-event
+   simulation in virtual time instead of between TUN devices. Packets
+   go in with send(), and each one that leaves the last queue goes to
+   the sink along with the time it left. The clock jumps from one
+   event to the next, so a run takes only as long as the work it does.
+
+   The queues see the virtual clock through timestamp_ns(), which is
+   per thread: add the queues and run the path on the thread that made
+   it. Paths on one thread (e.g. the two directions of a connection)
+   share its clock, so they must be run in step, and destroyed in the
+   reverse order of their creation. The sink must not call back into
+   the path. */
+
+class SimulatedPath
+{
+public:
+    typedef std::function<void( const uint64_t time, PacketBuffer && packet )> Sink; /* time in ns */
+
+private:
+    /* what the path needs of a queue */
+    class Stage
+    {
+    public:
+        virtual void read_packet( PacketBuffer && packet ) = 0;
+        virtual bool pop_output( PacketBuffer & packet ) = 0;
+        virtual uint64_t wait_time( void ) = 0;
+        virtual bool finished( void ) const = 0;
+
+        virtual ~Stage() {}
+    };
+
+    template <class QueueType>
+    class QueueStage : public Stage
+    {
+    private:
+        QueueType queue_;
+
+    public:
+        template <typename... Targs>
+        QueueStage( Targs&&... Fargs ) : queue_( std::forward<Targs>( Fargs )... ) {}
+
+        QueueType & queue( void ) { return queue_; }
+
+        void read_packet( PacketBuffer && packet ) override { queue_.read_packet( std::move( packet ) ); }
+        bool pop_output( PacketBuffer & packet ) override { return queue_.pop_output( packet ); }
+        uint64_t wait_time( void ) override { return queue_.wait_time(); }
+        bool finished( void ) const override { return queue_.finished(); }
+    };
+
+    std::vector<std::unique_ptr<Stage>> stages_;
+    Sink sink_;
+    uint64_t now_; /* ns */
+    size_t virtual_time_token_; /* for stopping the clock we started */
+
+    /* bring each queue up to now, passing packets down the path;
+       returns the time of the next event */
+    uint64_t settle( void );
+
+public:
+    SimulatedPath( const uint64_t start_time, const Sink & sink ); /* ns */
+    ~SimulatedPath();
+
+    /* add a queue to the end of the path (constructed at the current time) */
+    template <class QueueType, typename... Targs>
+    QueueType & add_queue( Targs&&... Fargs );
+
+    /* run until time, then give the packet to the first queue */
+    void send( const uint64_t time, PacketBuffer && packet );
+
+    /* run until time */
+    void advance( const uint64_t time );
+
+    uint64_t now( void ) const { return now_; }
+
+    /* has any queue finished (e.g. a link that doesn't repeat its trace)? */
+    bool finished( void ) const;
+
+    /* forbid copying or assigning */
+    SimulatedPath( const SimulatedPath & other ) = delete;
+    SimulatedPath & operator=( const SimulatedPath & other ) = delete;
+};
+
+template <class QueueType, typename... Targs>
+QueueType & SimulatedPath::add_queue( Targs&&... Fargs )
+{
+    set_virtual_time( now_ );
+
+    QueueStage<QueueType> * const stage = new QueueStage<QueueType>( std::forward<Targs>( Fargs )... );
+    stages_.emplace_back( stage );
+    return stage->queue();
+}
+
+#endif /* SIMULATED_PATH_HH */
@@ -0,0 +1,65 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "link_trace.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* convert an mm-link trace between the text and binary formats
+   (the direction is chosen by the format of the input) */
+
+static uint64_t gcd( uint64_t a, uint64_t b )
+{
+    while ( b ) {
+        const uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+
+    return a;
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 3 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " INPUT-TRACE OUTPUT-TRACE" );
+        }
+
+        const string input_filename = argv[ 1 ], output_filename = argv[ 2 ];
+
+        if ( is_binary_trace( input_filename ) ) {
+            /* binary -> text */
+            BinaryLinkTrace trace( input_filename );
+            TextTraceWriter writer( output_filename );
+
+            do {
+                writer.add( trace.current(), trace.count() );
+            } while ( trace.advance() );
+
+            writer.add( trace.duration(), 0 ); /* in case it ends in silence */
+
+            writer.finish();
+        } else {
+            /* text -> binary, without holding the whole trace in memory */
+
+            /* first pass: find the coarsest time unit (at most 1 ms) that
+               represents every timestamp exactly, to keep the deltas small */
+            uint64_t time_unit_ns = 1000000;
+            read_text_trace( input_filename,
+                             [&] ( const uint64_t ns, const uint64_t ) { time_unit_ns = gcd( time_unit_ns, ns ); } );
+
+            BinaryTraceWriter writer( output_filename, time_unit_ns );
+
+            read_text_trace( input_filename,
+                             [&] ( const uint64_t ns, const uint64_t count ) { writer.add( ns, count ); } );
+
+            writer.finish();
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
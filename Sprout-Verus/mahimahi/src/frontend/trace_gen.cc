@@ -0,0 +1,473 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "link_trace.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Synthesizes an mm-link trace from a model of the link's rate, in
+   either format. Time is cut into ticks (1 ms by default); each tick,
+   the model's mean rate over the tick becomes delivery opportunities
+   (of 1500 bytes) at the end of the tick: as a fluid, carrying the
+   fractions over to the next tick, or as a Poisson draw, as in
+   Sprout's model of a cellular link. Times are kept in whole ns and the
+   fluid's fractions in fixed point, so segments start and end on the
+   ticks they should and a constant rate gives exactly its count. */
+
+static const double BITS_PER_OPPORTUNITY = 1500 * 8;
+
+/* the fluid's fractions of an opportunity are counted in these, and
+   an opportunity this close to whole (e.g. three thirds, each rounded
+   down) counts as whole */
+static const int64_t CARRY_UNITS_PER_OPPORTUNITY = 1000000000;
+static const int64_t CARRY_SLACK = 1000;
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " MODEL OUTPUT-TRACE [OPTION]..." << endl;
+    cerr << endl;
+    cerr << "MODEL = constant:MBPS" << endl;
+    cerr << "        | onoff:MBPS,ON-MS,OFF-MS" << endl;
+    cerr << "        | brownian:MBPS,SIGMA,MAX-MBPS[,ESCAPE-RATE]" << endl;
+    cerr << "        | markov:MBPS/MEAN-MS[,MBPS/MEAN-MS]..." << endl;
+    cerr << "        | csv:FILENAME" << endl;
+    cerr << "Options = --duration=MS --resolution=MS --seed=N --poisson --binary" << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* s to whole ns */
+static uint64_t seconds_to_ns( const double seconds )
+{
+    return llround( seconds * 1e9 );
+}
+
+/* the rate of a link, as a series of segments at a constant rate */
+class RateModel
+{
+protected:
+    double rate_;        /* Mbit/s */
+    uint64_t remaining_; /* ns left in the current segment */
+
+    /* start the next segment */
+    virtual void next_segment( void ) = 0;
+
+public:
+    RateModel() : rate_( 0 ), remaining_( 0 ) {}
+
+    /* bits that can be delivered in the next interval (ns) */
+    double bits( uint64_t ns )
+    {
+        double total = 0;
+
+        while ( ns > 0 ) {
+            while ( remaining_ == 0 ) {
+                next_segment();
+            }
+
+            const uint64_t elapsed = min( ns, remaining_ );
+            total += rate_ * elapsed / 1000; /* Mbit/s times ns */
+            ns -= elapsed;
+            remaining_ -= elapsed;
+        }
+
+        return total;
+    }
+
+    virtual ~RateModel() {}
+};
+
+class ConstantRate : public RateModel
+{
+private:
+    void next_segment( void ) override { remaining_ = numeric_limits<uint64_t>::max(); }
+
+public:
+    ConstantRate( const double mbps ) { rate_ = mbps; }
+};
+
+/* MBPS for ON-MS, then nothing for OFF-MS, and again */
+class OnOffRate : public RateModel
+{
+private:
+    double mbps_;
+    uint64_t on_, off_; /* ns */
+    bool on_now_;
+
+    void next_segment( void ) override
+    {
+        on_now_ = not on_now_;
+        rate_ = on_now_ ? mbps_ : 0;
+        remaining_ = on_now_ ? on_ : off_;
+    }
+
+public:
+    OnOffRate( const double mbps, const uint64_t on, const uint64_t off )
+        : mbps_( mbps ), on_( on ), off_( off ), on_now_( false )
+    {
+        if ( on_ + off_ == 0 ) {
+            throw runtime_error( "onoff: the period must be nonzero" );
+        }
+    }
+};
+
+/* As in Sprout's model of a cellular link: the rate wanders in Brownian
+   motion (with a standard deviation of SIGMA Mbit/s after one second),
+   reflected at MAX-MBPS. At zero the link is in an outage, which it
+   leaves at ESCAPE-RATE (per second), as a Poisson process. */
+class BrownianRate : public RateModel
+{
+private:
+    normal_distribution<double> step_;
+    double maximum_, escape_probability_;
+    uint64_t step_length_; /* ns */
+    bool outage_;
+    default_random_engine & prng_;
+
+    void next_segment( void ) override
+    {
+        remaining_ = step_length_;
+
+        if ( outage_ ) {
+            if ( bernoulli_distribution( escape_probability_ )( prng_ ) ) {
+                outage_ = false;
+                rate_ = abs( step_( prng_ ) );
+            }
+            return;
+        }
+
+        rate_ += step_( prng_ );
+        if ( rate_ > maximum_ ) {
+            rate_ = 2 * maximum_ - rate_;
+        }
+        if ( rate_ <= 0 ) {
+            rate_ = 0;
+            outage_ = true;
+        }
+    }
+
+public:
+    BrownianRate( const double mbps, const double sigma, const double maximum, const double escape_rate,
+                  const uint64_t step_length, default_random_engine & prng )
+        : step_( 0, sigma * sqrt( step_length / 1e9 ) ),
+          maximum_( maximum ),
+          escape_probability_( 1 - exp( -escape_rate * step_length / 1e9 ) ),
+          step_length_( step_length ),
+          outage_( false ),
+          prng_( prng )
+    {
+        if ( not (mbps <= maximum) ) {
+            throw runtime_error( "brownian: starting rate is over the maximum" );
+        }
+
+        /* the first segment starts at the given rate */
+        rate_ = mbps;
+        remaining_ = step_length_;
+    }
+};
+
+/* Markov-modulated: each state has a rate, and the link stays in it for
+   an exponentially distributed time with the given mean, then moves to
+   one of the other states, chosen uniformly. Starts in the first state. */
+class MarkovRate : public RateModel
+{
+public:
+    struct State
+    {
+        double mbps;
+        double mean_sojourn; /* s */
+    };
+
+private:
+    vector<State> states_;
+    size_t state_;
+    default_random_engine & prng_;
+
+    void next_segment( void ) override
+    {
+        if ( states_.size() > 1 ) {
+            /* any state but this one */
+            const size_t next = uniform_int_distribution<size_t>( 0, states_.size() - 2 )( prng_ );
+            state_ = next < state_ ? next : next + 1;
+        }
+
+        enter_state();
+    }
+
+    void enter_state( void )
+    {
+        rate_ = states_[ state_ ].mbps;
+        remaining_ = seconds_to_ns( exponential_distribution<double>( 1 / states_[ state_ ].mean_sojourn )( prng_ ) );
+    }
+
+public:
+    MarkovRate( const vector<State> & states, default_random_engine & prng )
+        : states_( states ), state_( 0 ), prng_( prng )
+    {
+        if ( states_.empty() ) {
+            throw runtime_error( "markov: no states" );
+        }
+
+        enter_state();
+    }
+};
+
+/* Replays a throughput log: lines of "SECONDS,MBPS", each giving the
+   rate over the interval since the previous line (or since 0). Lines
+   that don't start with a number (e.g. a header) are skipped. The log
+   repeats if the trace is longer. */
+class CSVRate : public RateModel
+{
+private:
+    struct Row
+    {
+        uint64_t end; /* ns */
+        double mbps;
+    };
+
+    vector<Row> rows_;
+    size_t next_row_;
+    uint64_t last_end_;
+
+    void next_segment( void ) override
+    {
+        if ( next_row_ == rows_.size() ) {
+            next_row_ = 0;
+            last_end_ = 0;
+        }
+
+        const Row & row = rows_[ next_row_++ ];
+        rate_ = row.mbps;
+        remaining_ = row.end - last_end_;
+        last_end_ = row.end;
+    }
+
+public:
+    CSVRate( const string & filename )
+        : rows_(), next_row_( 0 ), last_end_( 0 )
+    {
+        ifstream csv( filename );
+        if ( not csv.good() ) {
+            throw runtime_error( filename + ": error opening for reading" );
+        }
+
+        string line;
+        while ( getline( csv, line ) ) {
+            const auto first = line.find_first_not_of( " \t" );
+            if ( first == string::npos
+                 or not ((line[ first ] >= '0' and line[ first ] <= '9') or line[ first ] == '.') ) {
+                continue;
+            }
+
+            const auto comma = line.find( ',' );
+            if ( comma == string::npos ) {
+                throw runtime_error( filename + ": expected SECONDS,MBPS: " + line );
+            }
+
+            const double end = myatof( line.substr( 0, comma ) ), mbps = myatof( line.substr( comma + 1 ) );
+            if ( not (mbps >= 0) ) {
+                throw runtime_error( filename + ": rate must be non-negative: " + line );
+            }
+            if ( not (end >= 0) or seconds_to_ns( end ) < (rows_.empty() ? 0 : rows_.back().end) ) {
+                throw runtime_error( filename + ": times must be nondecreasing: " + line );
+            }
+
+            rows_.push_back( { seconds_to_ns( end ), mbps } );
+        }
+
+        if ( rows_.empty() or rows_.back().end == 0 ) {
+            throw runtime_error( filename + ": log must last for a nonzero amount of time" );
+        }
+    }
+
+    uint64_t duration( void ) const { return rows_.back().end; } /* ns */
+};
+
+/* split "a,b,c" into numbers */
+static vector<double> parse_numbers( const string & str, const char separator )
+{
+    vector<double> ret;
+
+    istringstream fields( str );
+    for ( string field; getline( fields, field, separator ); ) {
+        ret.push_back( myatof( field ) );
+        if ( not (ret.back() >= 0) ) {
+            throw runtime_error( "values must be non-negative: " + str );
+        }
+    }
+
+    return ret;
+}
+
+static uint64_t gcd( uint64_t a, uint64_t b )
+{
+    while ( b ) {
+        const uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+
+    return a;
+}
+
+/* run the model for the length of the trace, writing each tick's opportunities */
+template <class Writer>
+static void generate( RateModel & model, Writer & writer,
+                      const uint64_t duration_ns, const uint64_t resolution_ns,
+                      const bool poisson, default_random_engine & prng )
+{
+    int64_t carry = 0; /* fraction of an opportunity from the ticks so far, in carry units */
+
+    for ( uint64_t start = 0; start < duration_ns; start += resolution_ns ) {
+        const uint64_t end = min( start + resolution_ns, duration_ns );
+        const double expected = model.bits( end - start ) / BITS_PER_OPPORTUNITY;
+
+        uint64_t count;
+        if ( poisson ) {
+            count = expected > 0 ? poisson_distribution<uint64_t>( expected )( prng ) : 0;
+        } else {
+            carry += llround( expected * CARRY_UNITS_PER_OPPORTUNITY );
+            count = (carry + CARRY_SLACK) / CARRY_UNITS_PER_OPPORTUNITY;
+            carry -= count * CARRY_UNITS_PER_OPPORTUNITY;
+        }
+
+        writer.add( end, count );
+    }
+
+    writer.finish();
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const option command_line_options[] = {
+            { "duration",   required_argument, nullptr, 'd' },
+            { "resolution", required_argument, nullptr, 'r' },
+            { "seed",       required_argument, nullptr, 's' },
+            { "poisson",          no_argument, nullptr, 'p' },
+            { "binary",           no_argument, nullptr, 'b' },
+            { 0,                            0, nullptr, 0 }
+        };
+
+        double duration_ms = -1, resolution_ms = 1;
+        default_random_engine prng { random_device()() };
+        bool poisson = false, binary = false;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'd':
+                duration_ms = myatof( optarg );
+                break;
+            case 'r':
+                resolution_ms = myatof( optarg );
+                break;
+            case 's':
+                prng.seed( myatoi( optarg ) );
+                break;
+            case 'p':
+                poisson = true;
+                break;
+            case 'b':
+                binary = true;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 2 != argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const string spec = argv[ optind ], output_filename = argv[ optind + 1 ];
+        const auto colon = spec.find( ':' );
+        if ( colon == string::npos ) {
+            usage_error( argv[ 0 ] );
+        }
+        const string name = spec.substr( 0, colon ), args = spec.substr( colon + 1 );
+
+        const uint64_t resolution_ns = llround( resolution_ms * NS_PER_MS );
+        if ( not (resolution_ms > 0) or resolution_ns == 0 ) {
+            throw runtime_error( "resolution must be positive" );
+        }
+
+        unique_ptr<RateModel> model;
+        if ( name == "csv" ) {
+            CSVRate * const csv = new CSVRate( args );
+            model.reset( csv );
+            if ( duration_ms < 0 ) {
+                duration_ms = csv->duration() / double( NS_PER_MS ); /* play the log once */
+            }
+        } else {
+            const vector<double> values = name == "markov" ? vector<double>() : parse_numbers( args, ',' );
+
+            if ( name == "constant" and values.size() == 1 ) {
+                model.reset( new ConstantRate( values[ 0 ] ) );
+            } else if ( name == "onoff" and values.size() == 3 ) {
+                model.reset( new OnOffRate( values[ 0 ], llround( values[ 1 ] * NS_PER_MS ),
+                                            llround( values[ 2 ] * NS_PER_MS ) ) );
+            } else if ( name == "brownian" and (values.size() == 3 or values.size() == 4) ) {
+                model.reset( new BrownianRate( values[ 0 ], values[ 1 ], values[ 2 ],
+                                               values.size() == 4 ? values[ 3 ] : 1,
+                                               resolution_ns, prng ) );
+            } else if ( name == "markov" ) {
+                vector<MarkovRate::State> states;
+                istringstream fields( args );
+                for ( string field; getline( fields, field, ',' ); ) {
+                    const vector<double> state = parse_numbers( field, '/' );
+                    if ( state.size() != 2 or not (state[ 1 ] > 0) ) {
+                        throw runtime_error( "markov: expected MBPS/MEAN-MS: " + field );
+                    }
+                    states.push_back( { state[ 0 ], state[ 1 ] / 1000 } );
+                }
+                model.reset( new MarkovRate( states, prng ) );
+            } else {
+                usage_error( argv[ 0 ] );
+            }
+        }
+
+        if ( duration_ms < 0 ) {
+            duration_ms = 60000;
+        }
+
+        const uint64_t duration_ns = llround( duration_ms * NS_PER_MS );
+        if ( duration_ns == 0 ) {
+            throw runtime_error( "duration must be positive" );
+        }
+
+        if ( binary ) {
+            /* the coarsest time unit (at most 1 ms) that every time is a multiple of */
+            BinaryTraceWriter writer( output_filename, gcd( gcd( resolution_ns, duration_ns ), NS_PER_MS ) );
+            generate( *model, writer, duration_ns, resolution_ns, poisson, prng );
+        } else {
+            TextTraceWriter writer( output_filename );
+            generate( *model, writer, duration_ns, resolution_ns, poisson, prng );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <chrono>
+
+#include "binned_live_export.hh"
+#include "file_descriptor.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const char EXPORT_MAGIC[ 8 ] = { 'M', 'M', 'E', 'X', 'P', 'O', 'R', 'T' };
+static const uint32_t EXPORT_VERSION = 1;
+static const uint32_t EXPORT_CAPACITY = 1024; /* bins */
+static const size_t LABEL_LENGTH = 64;
+
+static int64_t initial_value( const BinnedExportSeries & series )
+{
+    return series.maximum ? -1 : 0;
+}
+
+BinnedLiveExport::BinnedLiveExport( const string & filename, const string & name,
+                                    const vector<BinnedExportSeries> & series,
+                                    const unsigned int bin_width_ms )
+    : series_( series ),
+      bin_width_ms_( bin_width_ms ),
+      value_this_bin_( series.size() ),
+      current_bin_( timestamp() / bin_width_ms_ ),
+      region_( nullptr ),
+      region_length_( 0 ),
+      header_( nullptr ),
+      records_offset_( sizeof( BinnedExportHeader ) + series.size() * LABEL_LENGTH ),
+      record_length_( sizeof( uint64_t ) + series.size() * sizeof( double ) ),
+      mutex_(),
+      wakeup_(),
+      halt_( false ),
+      export_thread_exception_(),
+      export_thread_()
+{
+    if ( bin_width_ms_ == 0 ) {
+        throw runtime_error( "BinnedLiveExport: bin width must be positive" );
+    }
+
+    for ( unsigned int i = 0; i < series_.size(); i++ ) {
+        value_this_bin_[ i ] = initial_value( series_[ i ] );
+    }
+
+    /* replace (rather than truncate) any old file, so its readers keep a valid mapping */
+    if ( unlink( filename.c_str() ) < 0 and errno != ENOENT ) {
+        throw unix_error( "unlink " + filename );
+    }
+
+    FileDescriptor fd( SystemCall( "open " + filename,
+                                   open( filename.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 ) ) );
+
+    region_length_ = records_offset_ + EXPORT_CAPACITY * record_length_;
+    SystemCall( "ftruncate " + filename, ftruncate( fd.fd_num(), region_length_ ) );
+
+    void * const addr = mmap( nullptr, region_length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd_num(), 0 );
+    if ( addr == MAP_FAILED ) {
+        throw unix_error( "mmap " + filename );
+    }
+    region_ = static_cast<char *>( addr );
+
+    /* the file starts out zeroed */
+    header_ = reinterpret_cast<BinnedExportHeader *>( region_ );
+    header_->version = EXPORT_VERSION;
+    header_->series_count = series_.size();
+    header_->bin_width_ms = bin_width_ms_;
+    header_->capacity = EXPORT_CAPACITY;
+    name.copy( header_->name, sizeof( header_->name ) - 1 );
+    for ( unsigned int i = 0; i < series_.size(); i++ ) {
+        series_[ i ].label.copy( region_ + sizeof( BinnedExportHeader ) + i * LABEL_LENGTH,
+                                 LABEL_LENGTH - 1 );
+    }
+
+    /* readers check the magic last */
+    atomic_thread_fence( memory_order_release );
+    memcpy( header_->magic, EXPORT_MAGIC, sizeof( EXPORT_MAGIC ) );
+
+    export_thread_ = thread( [&] () {
+            try {
+                export_loop();
+            } catch ( ... ) {
+                export_thread_exception_ = current_exception();
+            } } );
+}
+
+void BinnedLiveExport::set_max_value_now( const unsigned int num, const unsigned int amount )
+{
+    atomic<int64_t> & value = value_this_bin_.at( num );
+
+    int64_t current = value.load( memory_order_relaxed );
+    while ( current < amount
+            and not value.compare_exchange_weak( current, amount, memory_order_relaxed ) ) {}
+}
+
+/* close and publish every bin that has ended */
+void BinnedLiveExport::advance( void )
+{
+    const uint64_t now_bin = timestamp() / bin_width_ms_;
+
+    while ( current_bin_ < now_bin ) {
+        const uint64_t bin = header_->published; /* only this thread writes it */
+        char * const record = region_ + records_offset_ + (bin % EXPORT_CAPACITY) * record_length_;
+
+        const uint64_t end_ms = (current_bin_ + 1) * bin_width_ms_;
+        memcpy( record, &end_ms, sizeof( end_ms ) );
+
+        for ( unsigned int i = 0; i < series_.size(); i++ ) {
+            const int64_t raw = value_this_bin_[ i ].exchange( initial_value( series_[ i ] ),
+                                                               memory_order_relaxed );
+            double value = numeric_limits<double>::quiet_NaN();
+            if ( raw >= 0 ) {
+                value = raw * series_[ i ].multiplier;
+                if ( series_[ i ].rate_quantity ) {
+                    value /= (bin_width_ms_ / 1000.0);
+                }
+            }
+            memcpy( record + sizeof( end_ms ) + i * sizeof( double ), &value, sizeof( value ) );
+        }
+
+        __atomic_store_n( &header_->published, bin + 1, __ATOMIC_RELEASE );
+        current_bin_++;
+    }
+}
+
+void BinnedLiveExport::export_loop( void )
+{
+    unique_lock<mutex> ul { mutex_ };
+
+    while ( not halt_ ) {
+        const uint64_t now = timestamp();
+        const uint64_t end_of_bin = (current_bin_ + 1) * bin_width_ms_;
+        if ( now < end_of_bin ) {
+            wakeup_.wait_for( ul, chrono::milliseconds( end_of_bin - now ) );
+        }
+
+        advance();
+    }
+}
+
+BinnedLiveExport::~BinnedLiveExport()
+{
+    {
+        unique_lock<mutex> ul { mutex_ };
+        halt_ = true;
+    }
+    wakeup_.notify_all();
+    export_thread_.join();
+
+    __atomic_store_n( &header_->finished, 1, __ATOMIC_RELEASE );
+
+    try {
+        SystemCall( "munmap", munmap( region_, region_length_ ) );
+
+        if ( export_thread_exception_ != exception_ptr() ) {
+            rethrow_exception( export_thread_exception_ );
+        }
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        cerr << "BinnedLiveExport exited from exception: ";
+        print_exception( e );
+    }
+}
+
+BinnedExportReader::BinnedExportReader( const string & filename )
+    : file_( filename ),
+      header_( reinterpret_cast<const BinnedExportHeader *>( file_.data() ) ),
+      labels_(),
+      records_offset_( 0 ),
+      record_length_( 0 ),
+      next_bin_( 0 )
+{
+    if ( file_.size() < sizeof( BinnedExportHeader )
+         or memcmp( header_->magic, EXPORT_MAGIC, sizeof( EXPORT_MAGIC ) ) ) {
+        throw runtime_error( filename + ": not a meter export (or not yet initialized)" );
+    }
+    atomic_thread_fence( memory_order_acquire );
+
+    if ( header_->version != EXPORT_VERSION ) {
+        throw runtime_error( filename + ": unsupported export version " + to_string( header_->version ) );
+    }
+
+    if ( header_->bin_width_ms == 0 or header_->capacity == 0 ) {
+        throw runtime_error( filename + ": invalid export header" );
+    }
+
+    records_offset_ = sizeof( BinnedExportHeader ) + header_->series_count * LABEL_LENGTH;
+    record_length_ = sizeof( uint64_t ) + header_->series_count * sizeof( double );
+
+    if ( file_.size() < records_offset_ + header_->capacity * record_length_ ) {
+        throw runtime_error( filename + ": export file is truncated" );
+    }
+
+    for ( unsigned int i = 0; i < header_->series_count; i++ ) {
+        const char * label = file_.data() + sizeof( BinnedExportHeader ) + i * LABEL_LENGTH;
+        labels_.emplace_back( label, strnlen( label, LABEL_LENGTH ) );
+    }
+}
+
+string BinnedExportReader::name( void ) const
+{
+    return string( header_->name, strnlen( header_->name, sizeof( header_->name ) ) );
+}
+
+bool BinnedExportReader::finished( void ) const
+{
+    return __atomic_load_n( &header_->finished, __ATOMIC_ACQUIRE );
+}
+
+vector<BinnedExportBin> BinnedExportReader::read( uint64_t & lost )
+{
+    const uint64_t capacity = header_->capacity;
+    const uint64_t published = __atomic_load_n( &header_->published, __ATOMIC_ACQUIRE );
+
+    if ( published - next_bin_ > capacity ) {
+        lost += published - capacity - next_bin_;
+        next_bin_ = published - capacity;
+    }
+
+    vector<BinnedExportBin> ret;
+
+    for ( ; next_bin_ < published; next_bin_++ ) {
+        const char * record = file_.data() + records_offset_ + (next_bin_ % capacity) * record_length_;
+
+        BinnedExportBin bin { 0, vector<double>( labels_.size() ) };
+        memcpy( &bin.end_ms, record, sizeof( bin.end_ms ) );
+        memcpy( bin.values.data(), record + sizeof( bin.end_ms ), labels_.size() * sizeof( double ) );
+
+        /* the writer may have lapped us while we copied */
+        atomic_thread_fence( memory_order_acquire );
+        if ( __atomic_load_n( &header_->published, __ATOMIC_ACQUIRE ) >= next_bin_ + capacity ) {
+            lost++;
+            continue;
+        }
+
+        ret.emplace_back( move( bin ) );
+    }
+
+    return ret;
+}
@@ -0,0 +1,138 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef BINNED_LIVE_EXPORT_HH
+#define BINNED_LIVE_EXPORT_HH
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#include "mmap_region.hh"
+
+/* The binned series that BinnedLiveGraph draws, published instead to a
+   file (e.g. in /dev/shm) so they can be followed without a display.
+   The file is a fixed-size ring of closed bins, which any number of
+   readers can map and poll (see mm-meter-read); the writer never waits
+   for them. In host byte order:
+
+   header: "MMEXPORT", u32 version, u32 number of series, u32 bin width
+           (ms), u32 capacity (bins), u64 bins published so far, u32 set
+           when the writer has exited, u32 zero, char name[ 128 ], then
+           char label[ 64 ] for each series
+
+   ring:   capacity records, each a u64 end of the bin (ms, on the
+           timestamp() clock) followed by a double for each series (NaN
+           for a maximum with no values in that bin)
+
+   Bin n is in record n % capacity, and is complete once the count of
+   bins published exceeds n.
+
+   Recording a value only adds it to (or takes the maximum with) an
+   atomic counter; a background thread closes each bin on time. */
+
+struct BinnedExportHeader
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t series_count;
+    uint32_t bin_width_ms;
+    uint32_t capacity;
+    uint64_t published;
+    uint32_t finished;
+    uint32_t reserved;
+    char name[ 128 ];
+};
+
+struct BinnedExportSeries
+{
+    std::string label;
+    double multiplier;
+    bool rate_quantity; /* divide by the bin width in seconds */
+    bool maximum;       /* the bin holds the largest value instead of the sum */
+};
+
+class BinnedLiveExport
+{
+private:
+    std::vector<BinnedExportSeries> series_;
+    unsigned int bin_width_ms_;
+    std::vector<std::atomic<int64_t>> value_this_bin_;
+    uint64_t current_bin_;
+
+    char * region_;
+    size_t region_length_;
+    BinnedExportHeader * header_;
+    size_t records_offset_, record_length_;
+
+    void advance( void );
+
+    void export_loop( void );
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool halt_;
+
+    std::exception_ptr export_thread_exception_;
+    std::thread export_thread_;
+
+public:
+    BinnedLiveExport( const std::string & filename, const std::string & name,
+                      const std::vector<BinnedExportSeries> & series,
+                      const unsigned int bin_width_ms );
+    ~BinnedLiveExport();
+
+    /* for sums */
+    void add_value_now( const unsigned int num, const unsigned int amount )
+    {
+        value_this_bin_.at( num ).fetch_add( amount, std::memory_order_relaxed );
+    }
+
+    /* for maximums */
+    void set_max_value_now( const unsigned int num, const unsigned int amount );
+
+    /* forbid copying or assigning */
+    BinnedLiveExport( const BinnedLiveExport & other ) = delete;
+    BinnedLiveExport & operator=( const BinnedLiveExport & other ) = delete;
+};
+
+struct BinnedExportBin
+{
+    uint64_t end_ms;
+    std::vector<double> values;
+};
+
+/* follows an export file */
+class BinnedExportReader
+{
+private:
+    MMapRegion file_;
+    const BinnedExportHeader * header_;
+    std::vector<std::string> labels_;
+    size_t records_offset_, record_length_;
+    uint64_t next_bin_;
+
+public:
+    BinnedExportReader( const std::string & filename );
+
+    std::string name( void ) const;
+    const std::vector<std::string> & labels( void ) const { return labels_; }
+    unsigned int bin_width_ms( void ) const { return header_->bin_width_ms; }
+
+    /* has the writer exited? */
+    bool finished( void ) const;
+
+    /* the bins closed since the last call; bins that were overwritten
+       before they could be read are skipped and added to lost */
+    std::vector<BinnedExportBin> read( uint64_t & lost );
+
+    /* forbid copying or assigning */
+    BinnedExportReader( const BinnedExportReader & other ) = delete;
+    BinnedExportReader & operator=( const BinnedExportReader & other ) = delete;
+};
+
+#endif /* BINNED_LIVE_EXPORT_HH */
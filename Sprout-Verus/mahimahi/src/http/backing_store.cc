@@ -1,22 +1,72 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <sys/eventfd.h>
+
 #include "backing_store.hh"
 #include "http_record.pb.h"
-#include "temp_file.hh"
+#include "exception.hh"
 
 using namespace std;
 
 HTTPDiskStore::HTTPDiskStore( const string & record_folder )
-    : record_folder_( record_folder ),
-      mutex_()
+    : archive_( record_folder + "archive" ),
+      queue_(),
+      wakeup_( SystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) ),
+      finishing_( false ),
+      failed_( false ),
+      writer_( [&] () { write_records(); } )
 {}
 
-void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_address )
+HTTPDiskStore::~HTTPDiskStore()
+{
+    try {
+        finishing_ = true;
+        wake_writer();
+        writer_.join();
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
+
+void HTTPDiskStore::wake_writer( void )
+{
+    const uint64_t one = 1;
+    wakeup_.write( reinterpret_cast<const char *>( &one ), sizeof( one ) );
+}
+
+/* the writer thread */
+void HTTPDiskStore::write_records( void )
 {
-    unique_lock<mutex> ul( mutex_ );
+    try {
+        while ( true ) {
+            /* sleep until something is queued */
+            uint64_t count;
+            wakeup_.read( reinterpret_cast<char *>( &count ), sizeof( count ) );
 
-    /* output file to write current request/response pair protobuf (user has all permissions) */
-    UniqueFile file( record_folder_ + "save" );
+            const bool finishing = finishing_;
+
+            string record;
+            while ( queue_.pop( record ) ) {
+                archive_.append( record );
+            }
+            archive_.flush();
+
+            if ( finishing ) {
+                archive_.finish();
+                return;
+            }
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        failed_ = true;
+    }
+}
+
+void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_address )
+{
+    if ( failed_ ) {
+        throw runtime_error( "HTTPDiskStore: writer thread failed" );
+    }
 
     /* construct protocol buffer */
     MahimahiProtobufs::RequestResponse output;
@@ -29,8 +79,11 @@ void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_
     output.mutable_request()->CopyFrom( response.request().toprotobuf() );
     output.mutable_response()->CopyFrom( response.toprotobuf() );
 
-    if ( not output.SerializeToFileDescriptor( file.fd().fd_num() ) ) {
+    string record;
+    if ( not output.SerializeToString( &record ) ) {
         throw runtime_error( "save_to_disk: failure to serialize HTTP request/response pair" );
     }
 
+    queue_.push( move( record ) );
+    wake_writer();
 }
@@ -4,11 +4,15 @@
 #define BACKING_STORE_HH
 
 #include <string>
-#include <mutex>
+#include <atomic>
+#include <thread>
 
 #include "http_request.hh"
 #include "http_response.hh"
 #include "address.hh"
+#include "file_descriptor.hh"
+#include "mpsc_queue.hh"
+#include "record_archive.hh"
 
 /* abstract base class to store an HTTP request/response from a particular server address */
 class HTTPBackingStore
@@ -18,15 +22,30 @@ public:
     virtual ~HTTPBackingStore() {}
 };
 
+/* saves to a record archive in the folder. The proxy threads serialize
+   their records and queue them without locking; one writer thread
+   appends them to the archive, and writes its index on destruction. */
 class HTTPDiskStore : public HTTPBackingStore
 {
 private:
-    std::string record_folder_;
-    std::mutex mutex_;
+    RecordArchiveWriter archive_;
+    MPSCQueue< std::string > queue_;
+    FileDescriptor wakeup_; /* eventfd, signalled after each record is queued */
+    std::atomic<bool> finishing_, failed_;
+    std::thread writer_;
+
+    void write_records( void );
+    void wake_writer( void );
 
 public:
     HTTPDiskStore( const std::string & record_folder );
+    ~HTTPDiskStore();
+
     void save( const HTTPResponse & response, const Address & server_address ) override;
+
+    /* forbid copying or assigning */
+    HTTPDiskStore( const HTTPDiskStore & other ) = delete;
+    HTTPDiskStore & operator=( const HTTPDiskStore & other ) = delete;
 };
 
 #endif /* BACKING_STORE_HH */
@@ -10,7 +10,7 @@ public:
         - entire string belongs to body
         - only some of string (0 bytes to n bytes) belongs to body */
 
-    virtual std::string::size_type read( const std::string & str ) = 0;
+    virtual std::string::size_type read( const char * data, const size_t length ) = 0;
 
     /* does message become complete upon EOF in body? */
     virtual bool eof( void ) const = 0;
@@ -23,7 +23,7 @@ class Rule5BodyParser : public BodyParser
 {
 public:
     /* all of buffer always belongs to body */
-    std::string::size_type read( const std::string & ) override
+    std::string::size_type read( const char *, const size_t ) override
     {
         return std::string::npos;
     }
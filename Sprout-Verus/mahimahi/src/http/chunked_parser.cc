@@ -1,123 +1,102 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <cassert>
+#include <cstring>
 
 #include "ezio.hh"
 #include "chunked_parser.hh"
 
 using namespace std;
 
-/* Take a chunk header and parse it assuming no folding */
+/* a chunk-size or trailer line is never anywhere near this long */
+static const size_t MAX_LINE_LENGTH = 64 * 1024;
+
+/* Take a chunk header (without its CRLF) and parse it assuming no folding */
 uint32_t ChunkedBodyParser::get_chunk_size( const string & chunk_hdr ) const
 {
-    /* Check that the chunk header ends with a CRLF */
-    assert(chunk_hdr.substr( chunk_hdr.length() - 2, 2 ) == "\r\n" );
+    /* If there are chunk extensions, ';' terminates chunk size;
+       also remove trailing spaces (RFC 2616 Section 2.1) */
+    return myatoi( chunk_hdr.substr( 0, chunk_hdr.find_first_of( "; " ) ), 16 );
+}
 
-    /* If there are chunk extensions, ';' terminates chunk size */
-    auto pos = chunk_hdr.find( ";" );
+bool ChunkedBodyParser::read_line( const char * & data, const char * const end )
+{
+    const char * const newline = static_cast<const char *>( memchr( data, '\n', end - data ) );
+    const char * const line_end = newline ? newline : end;
 
-    /* There are no ';'s, and hence no chunk externsions, CRLF terminates chunk size */
-    if ( pos == string::npos ) {
-        pos = chunk_hdr.find( "\r\n" );
+    line_buffer_.append( data, line_end );
+    if ( line_buffer_.size() > MAX_LINE_LENGTH ) {
+        throw runtime_error( "ChunkedBodyParser: line too long" );
     }
 
-    /* Can't be npos even now */
-    assert( pos != string::npos );
+    if ( not newline ) {
+        data = end;
+        return false;
+    }
 
-    /* Parse hex string, after removing trailing spaces (RFC 2616 Section 2.1) */
-    auto hex_string = chunk_hdr.substr( 0, pos );
-    auto space_loc = hex_string.find( " " );
-    if ( space_loc != string::npos ) hex_string.erase( space_loc, hex_string.length() - space_loc );
-    return myatoi( hex_string, 16 );
+    data = newline + 1;
+    if ( line_buffer_.empty() or line_buffer_.back() != '\r' ) {
+        throw runtime_error( "ChunkedBodyParser: line not terminated by CRLF" );
+    }
+    line_buffer_.pop_back();
+    return true;
 }
 
-string::size_type ChunkedBodyParser::read( const std::string & input_buffer )
+string::size_type ChunkedBodyParser::read( const char * const input, const size_t length )
 {
-    parser_buffer_ += input_buffer;
+    const char * data = input;
+    const char * const end = input + length;
 
-    while ( !parser_buffer_.empty() ) {
+    while ( data < end ) {
         switch (state_) {
-        case CHUNK_HDR: {
-            auto it = parser_buffer_.find( "\r\n" );
-            if (it != string::npos) {
-                /* if you have CRLF, get chunk size & transition to CHUNK/TRAILER */
-                current_chunk_size_ = get_chunk_size( parser_buffer_.substr( 0, it + 2 ) );
-
-                /* Transition appropriately */
-                state_ = ( current_chunk_size_ == 0 ) ? TRAILER : CHUNK;
-
-                /* shrink parser_buffer_ */
-                parsed_so_far_ += ( it + 2 );
-                parser_buffer_ = parser_buffer_.substr( it + 2 );
-                break;
-            } else {
-                /* if you haven't seen a CRLF so far, do nothing */
-                acked_so_far_ += input_buffer.length();
-                return string::npos;
+        case CHUNK_HDR:
+            if ( read_line( data, end ) ) {
+                /* get chunk size & transition to CHUNK/TRAILER */
+                chunk_bytes_left_ = get_chunk_size( line_buffer_ );
+                line_buffer_.clear();
+                state_ = ( chunk_bytes_left_ == 0 ) ? TRAILER : CHUNK;
             }
-        }
+            break;
 
         case CHUNK: {
-            if ( parser_buffer_.length() >= current_chunk_size_ + 2 ) {
-                /* accumulated enough bytes, check CRLF at the end of the chunk */
-                assert( parser_buffer_.substr( current_chunk_size_, 2 ) == "\r\n" );
-
-                /* Transition to next state */
-                state_ = CHUNK_HDR;
-
-                /* shrink parser_buffer_ */
-                parsed_so_far_ += current_chunk_size_ + 2;
-                parser_buffer_ = parser_buffer_.substr( current_chunk_size_ + 2 );
-                break;
-            } else {
-                /* Haven't seen enough bytes so far, do nothing */
-                acked_so_far_ += input_buffer.length();
-                return string::npos;
+            /* skip over as much of the chunk as we have */
+            const size_t amount = min( static_cast<size_t>( end - data ),
+                                       static_cast<size_t>( chunk_bytes_left_ ) );
+            data += amount;
+            chunk_bytes_left_ -= amount;
+            if ( chunk_bytes_left_ == 0 ) {
+                state_ = CHUNK_END;
             }
+            break;
         }
 
-        case TRAILER: {
-            if ( trailers_enabled_) {
-                /* We need two consecutive CRLFs */
-                return compute_ack_size( parser_buffer_,
-                                         "\r\n\r\n",
-                                         input_buffer.length() );
-            } else {
-                /* We need only one CRLF now */
-                return compute_ack_size( parser_buffer_,
-                                         "\r\n",
-                                         input_buffer.length() );
+        case CHUNK_END:
+            /* the CRLF at the end of the chunk */
+            if ( read_line( data, end ) ) {
+                if ( not line_buffer_.empty() ) {
+                    throw runtime_error( "ChunkedBodyParser: chunk not followed by CRLF" );
+                }
+                state_ = CHUNK_HDR;
             }
-        }
+            break;
+
+        case TRAILER:
+            if ( read_line( data, end ) ) {
+                /* We need only one CRLF, unless there are trailers,
+                   which end with a blank line */
+                const bool done = ( not trailers_enabled_ ) or line_buffer_.empty();
+                line_buffer_.clear();
+                if ( done ) {
+                    return data - input;
+                }
+            }
+            break;
 
-        default: {
+        default:
             assert( false );
             return false;
         }
-        }
     }
-    acked_so_far_ += input_buffer.length();
-    return string::npos;
-}
 
-/*
-   Computes the acknowledgement from the BodyParser to its caller,
-   telling it how much of the current input_buffer has been
-   successfully parsed.
-*/
-string::size_type ChunkedBodyParser::compute_ack_size( const string & haystack,
-                                                       const string & needle,
-                                                       const string::size_type input_size )
-{
-    auto loc = haystack.find( needle );
-    if ( loc != string::npos ) {
-        /* Found it, eat up the whole buffer */
-        parsed_so_far_ += loc + needle.length();
-        assert( parsed_so_far_ > acked_so_far_ );
-        return ( parsed_so_far_ - acked_so_far_ );
-    } else {
-        /* Find unacknowledged buffer so far, ack it, and be done */
-        acked_so_far_ += input_size;
-        return loc;
-    }
+    return string::npos;
 }
@@ -3,25 +3,31 @@
 #ifndef CHUNKED_BODY_PARSER_HH
 #define CHUNKED_BODY_PARSER_HH
 
+#include <string>
+
 #include "body_parser.hh"
 #include "exception.hh"
 
+/* Finds the end of a chunked body as it streams past. Chunk data is
+   only counted, never buffered; just the current chunk-size or
+   trailer line is held across reads. */
+
 class ChunkedBodyParser : public BodyParser
 {
 private:
-    std::string::size_type compute_ack_size(const std::string & haystack,
-                                            const std::string & needle,
-                                            std::string::size_type input_size);
-    uint32_t get_chunk_size(const std::string & chunk_hdr) const;
-    std::string parser_buffer_ {""};
-    uint32_t current_chunk_size_ {0};
-    std::string::size_type acked_so_far_ {0};
-    std::string::size_type parsed_so_far_ {0};
-    enum {CHUNK_HDR, CHUNK, TRAILER} state_ {CHUNK_HDR};
+    /* accumulate a line into line_buffer_, advancing data;
+       returns true once the line is complete (its CRLF is dropped) */
+    bool read_line( const char * & data, const char * const end );
+
+    uint32_t get_chunk_size( const std::string & chunk_hdr ) const;
+
+    std::string line_buffer_ {};
+    uint32_t chunk_bytes_left_ {0};
+    enum {CHUNK_HDR, CHUNK, CHUNK_END, TRAILER} state_ {CHUNK_HDR};
     const bool trailers_enabled_ {false};
 
 public:
-    std::string::size_type read( const std::string & ) override;
+    std::string::size_type read( const char * data, const size_t length ) override;
 
     /* Follow item 2, Section 4.4 of RFC 2616 */
     bool eof( void ) const override { return true; }
@@ -6,6 +6,9 @@
 
 using namespace std;
 
+/* don't trust a Content-Length beyond this when reserving space */
+static const size_t MAX_BODY_RESERVATION = 64 * 1024 * 1024;
+
 /* methods called by an external parser */
 void HTTPMessage::set_first_line( const string & str )
 {
@@ -26,6 +29,11 @@ void HTTPMessage::done_with_headers( void )
     state_ = BODY_PENDING;
 
     calculate_expected_body_size();
+
+    /* grow the body once, rather than on every read */
+    if ( body_size_is_known() ) {
+        body_.reserve( min( expected_body_size(), MAX_BODY_RESERVATION ) );
+    }
 }
 
 void HTTPMessage::set_expected_body_size( const bool is_known, const size_t value )
@@ -35,7 +43,7 @@ void HTTPMessage::set_expected_body_size( const bool is_known, const size_t valu
     expected_body_size_ = make_pair( is_known, value );
 }
 
-size_t HTTPMessage::read_in_body( const std::string & str )
+size_t HTTPMessage::read_in_body( const char * data, const size_t length )
 {
     assert( state_ == BODY_PENDING );
 
@@ -44,9 +52,9 @@ size_t HTTPMessage::read_in_body( const std::string & str )
 
         assert( body_.size() <= expected_body_size() );
         const size_t amount_to_append = min( expected_body_size() - body_.size(),
-                                             str.size() );
+                                             length );
 
-        body_.append( str.substr( 0, amount_to_append ) );
+        body_.append( data, amount_to_append );
         if ( body_.size() == expected_body_size() ) {
             state_ = COMPLETE;
         }
@@ -54,7 +62,7 @@ size_t HTTPMessage::read_in_body( const std::string & str )
         return amount_to_append;
     } else {
         /* body size not known in advance */
-        return read_in_complex_body( str );
+        return read_in_complex_body( data, length );
     }
 }
 
@@ -98,28 +106,25 @@ static char http_to_lower( char c )
     return c;
 }
 
-static string strip_initial_whitespace( const string & str )
+/* index of the first non-space character (or the length, if none) */
+static size_t initial_whitespace( const string & str )
 {
-    size_t first_nonspace = str.find_first_not_of( " " );
-    if ( first_nonspace == std::string::npos ) {
-        return "";
-    } else {
-        return str.substr( first_nonspace );
-    }
+    const size_t first_nonspace = str.find_first_not_of( ' ' );
+    return first_nonspace == std::string::npos ? str.size() : first_nonspace;
 }
 
 /* check if two strings are equivalent per HTTP 1.1 comparison (case-insensitive) */
+/* (called for every header on every lookup, so compares in place without copying) */
 bool HTTPMessage::equivalent_strings( const string & a, const string & b )
 {
-    const string new_a = strip_initial_whitespace( a ),
-        new_b = strip_initial_whitespace( b );
+    const size_t start_a = initial_whitespace( a ), start_b = initial_whitespace( b );
 
-    if ( new_a.size() != new_b.size() ) {
+    if ( a.size() - start_a != b.size() - start_b ) {
         return false;
     }
 
-    for ( auto it_a = new_a.begin(), it_b = new_b.begin(); it_a < new_a.end(); it_a++, it_b++ ) {
-        if ( http_to_lower( *it_a ) != http_to_lower( *it_b ) ) {
+    for ( size_t i = start_a, j = start_b; i < a.size(); i++, j++ ) {
+        if ( http_to_lower( a[ i ] ) != http_to_lower( b[ j ] ) ) {
             return false;
         }
     }
@@ -156,12 +161,21 @@ std::string HTTPMessage::str( void ) const
 {
     assert( state_ == COMPLETE );
 
+    /* size it first, so the body is copied exactly once */
+    size_t length = first_line_.size() + CRLF.size() + CRLF.size() + body_.size();
+    for ( const auto & header : headers_ ) {
+        length += header.key().size() + 2 + header.value().size() + CRLF.size();
+    }
+
+    string ret;
+    ret.reserve( length );
+
     /* start with first line */
-    string ret( first_line_ + CRLF );
+    ret.append( first_line_ ).append( CRLF );
 
     /* iterate through headers and add "key: value\r\n" to request */
     for ( const auto & header : headers_ ) {
-        ret.append( header.str() + CRLF );
+        ret.append( header.key() ).append( ": " ).append( header.value() ).append( CRLF );
     }
 
     /* blank line between headers and body */
@@ -26,7 +26,7 @@ private:
     virtual void calculate_expected_body_size( void ) = 0;
 
     /* bodies with size not known in advance must be handled by subclass */
-    virtual size_t read_in_complex_body( const std::string & str ) = 0;
+    virtual size_t read_in_complex_body( const char * data, const size_t length ) = 0;
 
     /* does message become complete upon EOF in body? */
     virtual bool eof_in_body( void ) const = 0;
@@ -51,11 +51,19 @@ public:
     HTTPMessage() {}
     virtual ~HTTPMessage() {}
 
+    /* the virtual destructor would otherwise turn every move (e.g. of
+       a finished message into its queue) into a copy of the body */
+    HTTPMessage( const HTTPMessage & other ) = default;
+    HTTPMessage & operator=( const HTTPMessage & other ) = default;
+    HTTPMessage( HTTPMessage && other ) = default;
+    HTTPMessage & operator=( HTTPMessage && other ) = default;
+
     /* methods called by an external parser */
     void set_first_line( const std::string & str );
     void add_header( const std::string & str );
     void done_with_headers( void );
-    size_t read_in_body( const std::string & str );
+    /* returns how many of the bytes belong to this message's body */
+    size_t read_in_body( const char * data, const size_t length );
     void eof( void );
 
     /* getters */
@@ -12,34 +12,19 @@ template <class MessageType>
 class HTTPMessageSequence
 {
 private:
-    class InternalBuffer
-    {
-    private:
-        std::string buffer_ {};
-    
-    public:
-        bool have_complete_line( void ) const;
-
-        std::string get_and_pop_line( void );
-
-        void pop_bytes( const size_t n );
-
-        bool empty( void ) const { return buffer_.empty(); }
-
-        void append( const std::string & str ) { buffer_.append( str ); }
-
-        const std::string & str( void ) const { return buffer_; }
-    };
-
-    /* bytes that haven't been parsed yet */
-    InternalBuffer buffer_ {};
+    /* bytes that haven't been parsed yet: only ever the start of an
+       incomplete line, since bodies are consumed as they arrive */
+    std::string buffer_ {};
 
     /* complete messages ready to go */
     std::queue< MessageType > complete_messages_ {};
 
-    /* one loop through the parser */
-    /* returns whether to continue */
-    bool parsing_step( void );
+    /* one loop through the parser, starting at offset in str */
+    /* advances offset past what was consumed, and returns whether to continue */
+    bool parsing_step( const std::string & str, size_t & offset );
+
+    /* parse as much of str as we can, and return how much was consumed */
+    size_t parse_from( const std::string & str );
 
     /* what to do to create a new message.
        must be implemented by subclass */
@@ -65,65 +50,45 @@ public:
 };
 
 template <class MessageType>
-bool HTTPMessageSequence<MessageType>::InternalBuffer::have_complete_line( void ) const
-{
-    size_t first_line_ending = buffer_.find( CRLF );
-    return first_line_ending != std::string::npos;
-}
-
-template <class MessageType>
-std::string HTTPMessageSequence<MessageType>::InternalBuffer::get_and_pop_line( void )
-{
-    size_t first_line_ending = buffer_.find( CRLF );
-    assert( first_line_ending != std::string::npos );
-
-    std::string first_line( buffer_.substr( 0, first_line_ending ) );
-    pop_bytes( first_line_ending + CRLF.size() );
-
-    return first_line;
-}
-
-template <class MessageType>
-void HTTPMessageSequence<MessageType>::InternalBuffer::pop_bytes( const size_t num )
-{
-    assert( buffer_.size() >= num );
-    buffer_.replace( 0, num, std::string() );
-}
-
-template <class MessageType>
-bool HTTPMessageSequence<MessageType>::parsing_step( void )
+bool HTTPMessageSequence<MessageType>::parsing_step( const std::string & str, size_t & offset )
 {
     switch ( message_in_progress_.state() ) {
     case FIRST_LINE_PENDING:
-        /* do we have a complete line? */
-        if ( not buffer_.have_complete_line() ) { return false; }
-
-        /* supply status line to request/response initialization routine */
-        initialize_new_message();
+        {
+            /* do we have a complete line? */
+            const size_t line_ending = str.find( CRLF, offset );
+            if ( line_ending == std::string::npos ) { return false; }
 
-        message_in_progress_.set_first_line( buffer_.get_and_pop_line() );
+            /* supply status line to request/response initialization routine */
+            initialize_new_message();
 
+            message_in_progress_.set_first_line( str.substr( offset, line_ending - offset ) );
+            offset = line_ending + CRLF.size();
+        }
         return true;
-    case HEADERS_PENDING:
-        /* do we have a complete line? */
-        if ( not buffer_.have_complete_line() ) { return false; }
 
-        /* is line blank? */
+    case HEADERS_PENDING:
         {
-            std::string line( buffer_.get_and_pop_line() );
-            if ( line.empty() ) {
+            /* do we have a complete line? */
+            const size_t line_ending = str.find( CRLF, offset );
+            if ( line_ending == std::string::npos ) { return false; }
+
+            /* is line blank? */
+            if ( line_ending == offset ) {
                 message_in_progress_.done_with_headers();
             } else {
-                message_in_progress_.add_header( line );
+                message_in_progress_.add_header( str.substr( offset, line_ending - offset ) );
             }
+            offset = line_ending + CRLF.size();
         }
         return true;
 
     case BODY_PENDING:
         {
-            size_t bytes_read = message_in_progress_.read_in_body( buffer_.str() );
-            assert( bytes_read == buffer_.str().size() or message_in_progress_.state() == COMPLETE );
-            buffer_.pop_bytes( bytes_read );
+            const size_t remaining = str.size() - offset;
+            size_t bytes_read = message_in_progress_.read_in_body( str.data() + offset, remaining );
+            assert( bytes_read == remaining or message_in_progress_.state() == COMPLETE );
+            offset += bytes_read;
         }
         return message_in_progress_.state() == COMPLETE;
 
@@ -137,6 +102,14 @@ bool HTTPMessageSequence<MessageType>::parsing_step( void )
     return false;
 }
 
+template <class MessageType>
+size_t HTTPMessageSequence<MessageType>::parse_from( const std::string & str )
+{
+    size_t offset = 0;
+    while ( parsing_step( str, offset ) ) {}
+    return offset;
+}
+
 template <class MessageType>
 void HTTPMessageSequence<MessageType>::parse( const std::string & buf )
 {
@@ -144,11 +117,14 @@ void HTTPMessageSequence<MessageType>::parse( const std::string & buf )
         message_in_progress_.eof();
     }
 
-    /* append buf to internal buffer */
-    buffer_.append( buf );
-
-    /* parse as much as we can */
-    while ( parsing_step() ) {}
+    if ( buffer_.empty() ) {
+        /* usual case: parse buf where it is, and keep just the leftover partial line */
+        buffer_.assign( buf, parse_from( buf ), std::string::npos );
+    } else {
+        /* finish the partial line first */
+        buffer_.append( buf );
+        buffer_.erase( 0, parse_from( buffer_ ) );
+    }
 }
 
 #endif /* HTTP_MESSAGE_SEQUENCE */
@@ -24,7 +24,7 @@ void HTTPRequest::calculate_expected_body_size( void )
     }
 }
 
-size_t HTTPRequest::read_in_complex_body( const std::string & )
+size_t HTTPRequest::read_in_complex_body( const char *, const size_t )
 {
     /* we don't support complex bodies */
     throw runtime_error( "HTTPRequest: does not support chunked requests" );
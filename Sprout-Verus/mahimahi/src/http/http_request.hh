@@ -12,7 +12,7 @@ private:
     void calculate_expected_body_size( void ) override;
 
     /* we have no complex bodies */
-    size_t read_in_complex_body( const std::string & str ) override;
+    size_t read_in_complex_body( const char * data, const size_t length ) override;
 
     /* connection closed while body was pending */
     bool eof_in_body( void ) const override;
@@ -65,19 +65,19 @@ void HTTPResponse::calculate_expected_body_size( void )
     }
 }
 
-size_t HTTPResponse::read_in_complex_body( const std::string & str )
+size_t HTTPResponse::read_in_complex_body( const char * data, const size_t length )
 {
     assert( state_ == BODY_PENDING );
     assert( body_parser_ );
 
-    auto amount_parsed = body_parser_->read( str );
+    auto amount_parsed = body_parser_->read( data, length );
     if ( amount_parsed == std::string::npos ) {
         /* all of it belongs to the body */
-        body_.append( str );
-        return str.size();
+        body_.append( data, length );
+        return length;
     } else {
         /* body is now complete */
-        body_.append( str.substr( 0, amount_parsed ) );
+        body_.append( data, amount_parsed );
         state_ = COMPLETE;
         return amount_parsed;
     }
@@ -0,0 +1,199 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "record_archive.hh"
+#include "mmap_region.hh"
+#include "file_descriptor.hh"
+#include "exception.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const char ARCHIVE_MAGIC[ 8 ] = { 'M', 'M', 'R', 'E', 'C', 'A', 'R', 'C' };
+static const char FOOTER_MAGIC[ 8 ] = { 'M', 'M', 'R', 'E', 'C', 'I', 'D', 'X' };
+
+/* footer: offset of the index, number of records, magic */
+static const size_t FOOTER_SIZE = 8 + 8 + sizeof( FOOTER_MAGIC );
+
+static void put_le32( string & buffer, const uint32_t value )
+{
+    const uint32_t le = htole32( value );
+    buffer.append( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+static void put_le64( string & buffer, const uint64_t value )
+{
+    const uint64_t le = htole64( value );
+    buffer.append( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+static uint32_t get_le32( const char * data )
+{
+    uint32_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le32toh( le );
+}
+
+static uint64_t get_le64( const char * data )
+{
+    uint64_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le64toh( le );
+}
+
+RecordArchiveWriter::RecordArchiveWriter( const string & filename_template )
+    : file_( filename_template ),
+      offset_( 0 ),
+      record_offsets_(),
+      buffer_( ARCHIVE_MAGIC, sizeof( ARCHIVE_MAGIC ) )
+{}
+
+void RecordArchiveWriter::append( const string & record )
+{
+    if ( record.size() > UINT32_MAX ) {
+        throw runtime_error( "RecordArchiveWriter: record too large" );
+    }
+
+    record_offsets_.push_back( offset_ + buffer_.size() );
+    put_le32( buffer_, record.size() );
+    buffer_.append( record );
+}
+
+void RecordArchiveWriter::flush( void )
+{
+    if ( buffer_.empty() ) {
+        return;
+    }
+
+    file_.write( buffer_ );
+    offset_ += buffer_.size();
+    buffer_.clear();
+}
+
+void RecordArchiveWriter::finish( void )
+{
+    flush();
+
+    const uint64_t index_offset = offset_;
+    for ( const auto & record_offset : record_offsets_ ) {
+        put_le64( buffer_, record_offset );
+    }
+
+    put_le64( buffer_, index_offset );
+    put_le64( buffer_, record_offsets_.size() );
+    buffer_.append( FOOTER_MAGIC, sizeof( FOOTER_MAGIC ) );
+
+    flush();
+}
+
+/* find the records in a mapped archive */
+static vector< RecordLocation > archive_contents( const string & filename, const MMapRegion & archive )
+{
+    const char * const data = archive.data();
+    const uint64_t size = archive.size();
+
+    vector< RecordLocation > ret;
+
+    /* a record's length prefix is at offset; is the whole record before end? */
+    auto add_record = [&] ( const uint64_t offset, const uint64_t end ) {
+        if ( offset < sizeof( ARCHIVE_MAGIC ) or offset > end or end - offset < 4
+             or get_le32( data + offset ) > end - offset - 4 ) {
+            return false;
+        }
+        ret.push_back( { filename, true, offset + 4, get_le32( data + offset ) } );
+        return true;
+    };
+
+    /* use the index if the archive was finished */
+    if ( size >= sizeof( ARCHIVE_MAGIC ) + FOOTER_SIZE
+         and not memcmp( data + size - sizeof( FOOTER_MAGIC ), FOOTER_MAGIC, sizeof( FOOTER_MAGIC ) ) ) {
+        const uint64_t footer_offset = size - FOOTER_SIZE;
+        const uint64_t index_offset = get_le64( data + footer_offset );
+        const uint64_t count = get_le64( data + footer_offset + 8 );
+
+        if ( index_offset > footer_offset or count != (footer_offset - index_offset) / 8
+             or (footer_offset - index_offset) % 8 ) {
+            throw runtime_error( filename + ": corrupt record archive index" );
+        }
+
+        for ( uint64_t i = 0; i < count; i++ ) {
+            if ( not add_record( get_le64( data + index_offset + 8 * i ), index_offset ) ) {
+                throw runtime_error( filename + ": corrupt record archive index" );
+            }
+        }
+
+        return ret;
+    }
+
+    /* otherwise the recorder didn't finish: take every complete record */
+    uint64_t offset = sizeof( ARCHIVE_MAGIC );
+    while ( add_record( offset, size ) ) {
+        offset = ret.back().offset + ret.back().length;
+    }
+
+    return ret;
+}
+
+void for_each_record( const string & directory,
+                      const function<void( const RecordLocation &,
+                                           const MahimahiProtobufs::RequestResponse & )> & callback )
+{
+    for ( const auto & filename : list_directory_contents( directory ) ) {
+        const MMapRegion file( filename );
+
+        if ( file.size() >= sizeof( ARCHIVE_MAGIC )
+             and not memcmp( file.data(), ARCHIVE_MAGIC, sizeof( ARCHIVE_MAGIC ) ) ) {
+            for ( const auto & location : archive_contents( filename, file ) ) {
+                MahimahiProtobufs::RequestResponse record;
+                if ( not record.ParseFromArray( file.data() + location.offset, location.length ) ) {
+                    throw runtime_error( filename + ": invalid HTTP request/response at offset "
+                                         + to_string( location.offset ) );
+                }
+                callback( location, record );
+            }
+        } else { /* one record per file */
+            MahimahiProtobufs::RequestResponse record;
+            if ( not record.ParseFromArray( file.data(), file.size() ) ) {
+                throw runtime_error( filename + ": invalid HTTP request/response" );
+            }
+            callback( { filename, false, 0, 0 }, record );
+        }
+    }
+}
+
+MahimahiProtobufs::RequestResponse read_record( const RecordLocation & location )
+{
+    FileDescriptor fd( SystemCall( "open", open( location.filename.c_str(), O_RDONLY ) ) );
+    MahimahiProtobufs::RequestResponse record;
+
+    if ( location.archived ) {
+        string contents( location.length, 0 );
+        size_t bytes_read = 0;
+        while ( bytes_read < contents.size() ) {
+            const ssize_t ret = SystemCall( "pread", pread( fd.fd_num(), &contents[ bytes_read ],
+                                                            contents.size() - bytes_read,
+                                                            location.offset + bytes_read ) );
+            if ( ret == 0 ) {
+                throw runtime_error( location.filename + ": record archive truncated" );
+            }
+            bytes_read += ret;
+        }
+
+        if ( not record.ParseFromString( contents ) ) {
+            throw runtime_error( location.filename + ": invalid HTTP request/response at offset "
+                                 + to_string( location.offset ) );
+        }
+    } else if ( not record.ParseFromFileDescriptor( fd.fd_num() ) ) {
+        throw runtime_error( location.filename + ": invalid HTTP request/response" );
+    }
+
+    return record;
+}
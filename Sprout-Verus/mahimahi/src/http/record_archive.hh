@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RECORD_ARCHIVE_HH
+#define RECORD_ARCHIVE_HH
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "temp_file.hh"
+#include "http_record.pb.h"
+
+/* A recording kept in one append-only file: a magic number, then the
+   records, each a 32-bit length and a serialized RequestResponse, then
+   (once the recording is finished) an index of the records' offsets and
+   a footer. If the recorder dies before writing the index, the records
+   can still be read from the front. Integers are little-endian. */
+
+class RecordArchiveWriter
+{
+private:
+    UniqueFile file_;
+    uint64_t offset_;
+    std::vector<uint64_t> record_offsets_;
+    std::string buffer_;
+
+public:
+    RecordArchiveWriter( const std::string & filename_template );
+
+    /* add a serialized record (written out by the next flush) */
+    void append( const std::string & record );
+
+    void flush( void );
+
+    /* write the index; no more records can be appended */
+    void finish( void );
+};
+
+/* where a record lives: a file of its own, or a range of an archive */
+struct RecordLocation
+{
+    std::string filename;
+    bool archived;
+    uint64_t offset;
+    uint32_t length;
+};
+
+/* calls back with every record in a recording directory, whether saved one per file or in archives */
+void for_each_record( const std::string & directory,
+                      const std::function<void( const RecordLocation &,
+                                                const MahimahiProtobufs::RequestResponse & )> & callback );
+
+MahimahiProtobufs::RequestResponse read_record( const RecordLocation & location );
+
+#endif /* RECORD_ARCHIVE_HH */
@@ -1,22 +1,12 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
-#include <thread>
 #include <string>
 #include <iostream>
-#include <arpa/inet.h>
-#include <linux/netfilter_ipv4.h>
 
 #include "address.hh"
 #include "socket.hh"
-#include "system_runner.hh"
 #include "http_proxy.hh"
-#include "poller.hh"
-#include "bytestream_queue.hh"
-#include "http_request_parser.hh"
-#include "http_response_parser.hh"
-#include "file_descriptor.hh"
 #include "event_loop.hh"
-#include "temp_file.hh"
 #include "secure_socket.hh"
 #include "backing_store.hh"
 #include "exception.hh"
@@ -24,101 +14,109 @@
 using namespace std;
 using namespace PollerShortNames;
 
+/* pages open many connections at once */
+static const int LISTEN_BACKLOG = 1024;
+
+/* epoll ids: connection id, then which socket */
+static const uint64_t CLIENT_SIDE = 0, SERVER_SIDE = 1;
+
 HTTPProxy::HTTPProxy( const Address & listener_addr )
     : listener_socket_(),
       server_context_( SERVER ),
-      client_context_( CLIENT )
+      client_context_( CLIENT ),
+      epoll_(),
+      connections_(),
+      next_connection_id_( 0 )
 {
     listener_socket_.bind( listener_addr );
-    listener_socket_.listen();
+    listener_socket_.listen( LISTEN_BACKLOG );
 }
 
-template <class SocketType>
-void HTTPProxy::loop( SocketType & server, SocketType & client, HTTPBackingStore & backing_store )
+void HTTPProxy::update_side( const int fd, const uint32_t events, const uint64_t tag, Side & side )
 {
-    Poller poller;
-
-    HTTPRequestParser request_parser;
-    HTTPResponseParser response_parser;
-
-    const Address server_addr = client.original_dest();
-
-    /* poll on original connect socket and new connection socket to ferry packets */
-    /* responses from server go to response parser */
-    poller.add_action( Poller::Action( server, Direction::In,
-                                       [&] () {
-                                           string buffer = server.read();
-                                           response_parser.parse( buffer );
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not client.eof(); } ) );
-
-    /* requests from client go to request parser */
-    poller.add_action( Poller::Action( client, Direction::In,
-                                       [&] () {
-                                           string buffer = client.read();
-                                           request_parser.parse( buffer );
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not server.eof(); } ) );
-
-    /* completed requests from client are serialized and sent to server */
-    poller.add_action( Poller::Action( server, Direction::Out,
-                                       [&] () {
-                                           server.write( request_parser.front().str() );
-                                           response_parser.new_request_arrived( request_parser.front() );
-                                           request_parser.pop();
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not request_parser.empty(); } ) );
-
-    /* completed responses from server are serialized and sent to client */
-    poller.add_action( Poller::Action( client, Direction::Out,
-                                       [&] () {
-                                           client.write( response_parser.front().str() );
-                                           backing_store.save( response_parser.front(), server_addr );
-                                           response_parser.pop();
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not response_parser.empty(); } ) );
-
-    while ( true ) {
-        if ( poller.poll( -1 ).result == Poller::Result::Type::Exit ) {
-            return;
+    if ( side.hung_up and events == 0 ) {
+        if ( side.registered ) {
+            epoll_->remove( fd );
+            side.registered = false;
         }
+        return;
+    }
+
+    if ( not side.registered ) {
+        epoll_->add( fd, events, tag );
+        side.registered = true;
+    } else if ( events != side.events ) {
+        epoll_->modify( fd, events, tag );
     }
+    side.events = events;
+}
+
+void HTTPProxy::update_interest( const uint64_t id, Registration & registration )
+{
+    const ProxyConnection & connection = *registration.connection;
+
+    update_side( connection.client_fd(), connection.client_events(), id << 1 | CLIENT_SIDE, registration.client );
+    update_side( connection.server_fd(), connection.server_events(), id << 1 | SERVER_SIDE, registration.server );
 }
 
 void HTTPProxy::handle_tcp( HTTPBackingStore & backing_store )
 {
-    thread newthread( [&] ( TCPSocket client ) {
-            try {
-                /* get original destination for connection request */
-                Address server_addr = client.original_dest();
+    try {
+        /* connects to the original destination without waiting */
+        unique_ptr<ProxyConnection> connection( new ProxyConnection( listener_socket_.accept(),
+                                                                     server_context_, client_context_,
+                                                                     backing_store ) );
+
+        const uint64_t id = next_connection_id_++;
+        Registration registration { move( connection ), { 0, false, false }, { 0, false, false } };
+
+        update_interest( id, registration );
+
+        connections_.emplace( id, move( registration ) );
+    } catch ( const exception & e ) {
+        print_exception( e );
+    }
+}
+
+void HTTPProxy::handle_ready( void )
+{
+    for ( const auto & event : epoll_->wait( 0 ) ) {
+        const uint64_t id = event.data.u64 >> 1;
 
-                /* create socket and connect to original destination and send original request */
-                TCPSocket server;
-                server.connect( server_addr );
+        auto registration = connections_.find( id );
+        if ( registration == connections_.end() ) {
+            continue; /* closed earlier in this batch */
+        }
 
-                if ( server_addr.port() != 443 ) { /* normal HTTP */
-                    return loop( server, client, backing_store );
-                }
+        /* a hangup still leaves data to read from the socket, and
+           responses to flush to the other side, before closing */
+        if ( event.events & EPOLLHUP ) {
+            Side & side = (event.data.u64 & 1) == SERVER_SIDE ? registration->second.server
+                                                              : registration->second.client;
+            side.hung_up = true;
+        }
 
-                /* handle TLS */
-                SecureSocket tls_server( client_context_.new_secure_socket( move( server ) ) );
-                tls_server.connect();
+        bool close = true;
 
-                SecureSocket tls_client( server_context_.new_secure_socket( move( client ) ) );
-                tls_client.accept();
+        try {
+            /* an error on either socket ends the connection */
+            if ( not (event.events & EPOLLERR) ) {
+                registration->second.connection->service();
+                close = registration->second.connection->finished();
+            }
 
-                loop( tls_server, tls_client, backing_store );
-            } catch ( const exception & e ) {
-                print_exception( e );
+            if ( not close ) {
+                update_interest( id, registration->second );
             }
-        }, listener_socket_.accept() );
+        } catch ( const exception & e ) {
+            print_exception( e );
+        }
 
-    /* don't wait around for the reply */
-    newthread.detach();
+        if ( close ) {
+            /* closing the sockets takes them out of the epoll set */
+            connections_.erase( registration );
+        }
+    }
 }
 
 /* register this HTTPProxy's TCP listener socket to handle events with
@@ -126,9 +124,17 @@ void HTTPProxy::handle_tcp( HTTPBackingStore & backing_store )
    backing_store (which is captured and must continue to persist) */
 void HTTPProxy::register_handlers( EventLoop & event_loop, HTTPBackingStore & backing_store )
 {
+    epoll_.reset( new Epoll() );
+
     event_loop.add_simple_input_handler( tcp_listener(),
                                          [&] () {
                                              handle_tcp( backing_store );
                                              return ResultType::Continue;
                                          } );
+
+    event_loop.add_simple_input_handler( *epoll_,
+                                         [&] () {
+                                             handle_ready();
+                                             return ResultType::Continue;
+                                         } );
 }
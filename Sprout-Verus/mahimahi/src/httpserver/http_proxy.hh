@@ -4,38 +4,74 @@
 #define HTTP_PROXY_HH
 
 #include <string>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
 
 #include "socket.hh"
 #include "secure_socket.hh"
-#include "http_response.hh"
+#include "epoll.hh"
+#include "proxy_connection.hh"
 
 class HTTPBackingStore;
 class EventLoop;
-class Poller;
-class HTTPRequestParser;
-class HTTPResponseParser;
+
+/* Transparent HTTP/HTTPS proxy that records each request-response pair.
+   All connections are driven from the EventLoop's thread with
+   non-blocking sockets (and non-blocking TLS handshakes), through one
+   epoll instance that the EventLoop polls like any other fd. */
 
 class HTTPProxy
 {
 private:
     TCPSocket listener_socket_;
 
-    template <class SocketType>
-    void loop( SocketType & server, SocketType & client, HTTPBackingStore & backing_store );
-
     SSLContext server_context_, client_context_;
 
+    /* one socket's place in the epoll set. Once its peer has hung up,
+       epoll reports that every time, so the socket is only kept in the
+       set while the connection wants something from it. */
+    struct Side
+    {
+        uint32_t events;  /* as last told to epoll */
+        bool registered;
+        bool hung_up;
+    };
+
+    struct Registration
+    {
+        std::unique_ptr<ProxyConnection> connection;
+        Side client, server;
+    };
+
+    /* created when the handlers are registered (e.g. after a fork) */
+    std::unique_ptr<Epoll> epoll_;
+    std::unordered_map<uint64_t, Registration> connections_;
+    uint64_t next_connection_id_;
+
+    /* tell epoll what a connection is now waiting for */
+    void update_side( const int fd, const uint32_t events, const uint64_t tag, Side & side );
+    void update_interest( const uint64_t id, Registration & registration );
+
+    /* service the connections that are ready */
+    void handle_ready( void );
+
 public:
     HTTPProxy( const Address & listener_addr );
 
     TCPSocket & tcp_listener( void ) { return listener_socket_; }
 
+    /* accept a new connection */
     void handle_tcp( HTTPBackingStore & backing_store );
 
     /* register this HTTPProxy's TCP listener socket to handle events with
        the given event_loop, saving request-response pairs to the given
        backing_store (which is captured and must continue to persist) */
     void register_handlers( EventLoop & event_loop, HTTPBackingStore & backing_store );
+
+    /* forbid copying or assigning */
+    HTTPProxy( const HTTPProxy & other ) = delete;
+    HTTPProxy & operator=( const HTTPProxy & other ) = delete;
 };
 
 #endif /* HTTP_PROXY_HH */
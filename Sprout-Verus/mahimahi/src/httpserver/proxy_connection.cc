@@ -0,0 +1,245 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/epoll.h>
+
+#include "proxy_connection.hh"
+#include "backing_store.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* largest read from a socket (a TLS read returns at most one 16 kB record) */
+static const size_t READ_SIZE = 65536;
+
+/* let the already-written prefix of an output buffer grow this big
+   before trimming it */
+static const size_t MAX_WRITTEN_PREFIX = 1024 * 1024;
+
+/* stop reading from one side while this much is waiting to be written
+   to the other */
+static const size_t HIGH_WATER_MARK = 1024 * 1024;
+
+ProxyConnection::Endpoint::Endpoint( TCPSocket && socket )
+    : socket_( move( socket ) ),
+      tls_(),
+      outgoing_(),
+      outgoing_offset_( 0 ),
+      read_wants_write_( false ),
+      write_wants_read_( false )
+{
+    socket_.set_blocking( false );
+}
+
+void ProxyConnection::Endpoint::start_tls( SSLContext & context )
+{
+    tls_.reset( new SecureSocket( context.new_secure_socket( move( socket_ ) ) ) );
+}
+
+bool ProxyConnection::Endpoint::read( string & buffer )
+{
+    char data[ READ_SIZE ];
+    size_t bytes_read = 0;
+
+    if ( tls_ ) {
+        read_wants_write_ = false;
+        if ( not tls_->read_nonblocking( data, sizeof( data ), bytes_read ) ) {
+            read_wants_write_ = tls_->want_write();
+            return false;
+        }
+    } else if ( not socket_.read_nonblocking( data, sizeof( data ), bytes_read ) ) {
+        return false;
+    }
+
+    buffer.assign( data, bytes_read );
+    return true;
+}
+
+void ProxyConnection::Endpoint::queue( string && message )
+{
+    if ( pending_output() ) {
+        outgoing_.append( message );
+    } else {
+        outgoing_ = move( message );
+        outgoing_offset_ = 0;
+    }
+}
+
+void ProxyConnection::Endpoint::flush( void )
+{
+    write_wants_read_ = false;
+
+    while ( pending_output() ) {
+        const char * const data = outgoing_.data() + outgoing_offset_;
+        const size_t size = outgoing_.size() - outgoing_offset_;
+        size_t bytes_written = 0;
+
+        if ( tls_ ) {
+            if ( not tls_->write_nonblocking( data, size, bytes_written ) ) {
+                write_wants_read_ = not tls_->want_write();
+                break;
+            }
+        } else if ( not socket_.write_nonblocking( data, size, bytes_written ) ) {
+            break;
+        }
+
+        outgoing_offset_ += bytes_written;
+    }
+
+    if ( not pending_output() ) {
+        outgoing_.clear();
+        outgoing_offset_ = 0;
+    } else if ( outgoing_offset_ > MAX_WRITTEN_PREFIX ) {
+        outgoing_.erase( 0, outgoing_offset_ );
+        outgoing_offset_ = 0;
+    }
+}
+
+uint32_t ProxyConnection::Endpoint::events( const bool want_read, const bool want_write ) const
+{
+    uint32_t ret = 0;
+
+    if ( want_read ) {
+        ret |= read_wants_write_ ? EPOLLOUT : EPOLLIN;
+    }
+
+    if ( want_write ) {
+        ret |= write_wants_read_ ? EPOLLIN : EPOLLOUT;
+    }
+
+    return ret;
+}
+
+ProxyConnection::ProxyConnection( TCPSocket && client,
+                                  SSLContext & server_context, SSLContext & client_context,
+                                  HTTPBackingStore & backing_store )
+    : state_( State::Connecting ),
+      server_addr_( client.original_dest() ),
+      client_( move( client ) ),
+      server_( TCPSocket() ),
+      server_context_( server_context ),
+      client_context_( client_context ),
+      backing_store_( backing_store ),
+      request_parser_(),
+      response_parser_()
+{
+    /* connect to the original destination (finished once the socket is writable) */
+    server_.socket().connect_nonblocking( server_addr_ );
+}
+
+bool ProxyConnection::want_client_read( void ) const
+{
+    return not client_.socket().eof() and not server_.socket().eof()
+        and server_.pending_bytes() < HIGH_WATER_MARK;
+}
+
+bool ProxyConnection::want_server_read( void ) const
+{
+    return not server_.socket().eof() and not client_.socket().eof()
+        and client_.pending_bytes() < HIGH_WATER_MARK;
+}
+
+void ProxyConnection::service( void )
+{
+    switch ( state_ ) {
+    case State::Connecting:
+        server_.socket().finish_connect();
+
+        if ( server_addr_.port() != 443 ) { /* normal HTTP */
+            state_ = State::Proxying;
+            break;
+        }
+
+        /* handle TLS: first with the server, then with the client */
+        server_.start_tls( client_context_ );
+        state_ = State::ServerHandshake;
+        /* fall through */
+
+    case State::ServerHandshake:
+        if ( not server_.tls().connect_nonblocking() ) {
+            return;
+        }
+
+        client_.start_tls( server_context_ );
+        state_ = State::ClientHandshake;
+        /* fall through */
+
+    case State::ClientHandshake:
+        if ( not client_.tls().accept_nonblocking() ) {
+            return;
+        }
+
+        state_ = State::Proxying;
+        break;
+
+    case State::Proxying:
+        break;
+
+    case State::Finished:
+        return;
+    }
+
+    ferry();
+}
+
+void ProxyConnection::ferry( void )
+{
+    string buffer;
+
+    /* responses from server go to response parser */
+    if ( want_server_read() and server_.read( buffer ) ) {
+        response_parser_.parse( buffer );
+    }
+
+    /* requests from client go to request parser */
+    if ( want_client_read() and client_.read( buffer ) ) {
+        request_parser_.parse( buffer );
+    }
+
+    /* completed requests from client are serialized and sent to server */
+    while ( not request_parser_.empty() ) {
+        server_.queue( request_parser_.front().str() );
+        response_parser_.new_request_arrived( request_parser_.front() );
+        request_parser_.pop();
+    }
+
+    /* completed responses from server are serialized and sent to client */
+    while ( not response_parser_.empty() ) {
+        client_.queue( response_parser_.front().str() );
+        backing_store_.save( response_parser_.front(), server_addr_ );
+        response_parser_.pop();
+    }
+
+    server_.flush();
+    client_.flush();
+
+    if ( not want_server_read() and not want_client_read()
+         and not server_.pending_output() and not client_.pending_output() ) {
+        state_ = State::Finished;
+    }
+}
+
+uint32_t ProxyConnection::client_events( void ) const
+{
+    switch ( state_ ) {
+    case State::ClientHandshake:
+        return client_.tls_want_write() ? EPOLLOUT : EPOLLIN;
+    case State::Proxying:
+        return client_.events( want_client_read(), client_.pending_output() );
+    default:
+        return 0;
+    }
+}
+
+uint32_t ProxyConnection::server_events( void ) const
+{
+    switch ( state_ ) {
+    case State::Connecting:
+        return EPOLLOUT;
+    case State::ServerHandshake:
+        return server_.tls_want_write() ? EPOLLOUT : EPOLLIN;
+    case State::Proxying:
+        return server_.events( want_server_read(), server_.pending_output() );
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,110 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PROXY_CONNECTION_HH
+#define PROXY_CONNECTION_HH
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "socket.hh"
+#include "secure_socket.hh"
+#include "address.hh"
+#include "http_request_parser.hh"
+#include "http_response_parser.hh"
+
+class HTTPBackingStore;
+
+/* One connection through the HTTPProxy: the socket from the client,
+   a socket to the client's original destination, and the HTTP (or,
+   on port 443, HTTPS) exchange between them. Everything is
+   non-blocking, so one thread can drive any number of connections:
+   whenever either socket is ready, service() makes what progress it
+   can, and events() says what each socket must wait for next. */
+
+class ProxyConnection
+{
+private:
+    /* one end of the connection */
+    class Endpoint
+    {
+    private:
+        TCPSocket socket_; /* until TLS takes it over */
+        std::unique_ptr<SecureSocket> tls_;
+
+        /* bytes waiting to be written */
+        std::string outgoing_;
+        size_t outgoing_offset_;
+
+        /* TLS reads can have to wait for writability, and vice versa */
+        bool read_wants_write_, write_wants_read_;
+
+    public:
+        Endpoint( TCPSocket && socket );
+
+        TCPSocket & socket( void ) { return tls_ ? *tls_ : socket_; }
+        const TCPSocket & socket( void ) const { return tls_ ? *tls_ : socket_; }
+
+        void start_tls( SSLContext & context );
+        SecureSocket & tls( void ) { return *tls_; }
+        bool tls_want_write( void ) const { return tls_->want_write(); }
+
+        /* returns false if it would block; an empty buffer means EOF */
+        bool read( std::string & buffer );
+
+        /* takes over the message's storage if nothing else is waiting */
+        void queue( std::string && message );
+        bool pending_output( void ) const { return outgoing_offset_ < outgoing_.size(); }
+        size_t pending_bytes( void ) const { return outgoing_.size() - outgoing_offset_; }
+
+        /* write as much as possible without blocking */
+        void flush( void );
+
+        /* the epoll events to wait for, given what we want to do */
+        uint32_t events( const bool want_read, const bool want_write ) const;
+    };
+
+    enum class State { Connecting, ServerHandshake, ClientHandshake, Proxying, Finished };
+
+    State state_;
+    const Address server_addr_;
+    Endpoint client_, server_;
+
+    SSLContext & server_context_, & client_context_;
+    HTTPBackingStore & backing_store_;
+
+    HTTPRequestParser request_parser_;
+    HTTPResponseParser response_parser_;
+
+    /* each side is read until either side reaches EOF, pausing while
+       too much is waiting to be written to the other side */
+    bool want_client_read( void ) const;
+    bool want_server_read( void ) const;
+
+    /* move HTTP messages along */
+    void ferry( void );
+
+public:
+    ProxyConnection( TCPSocket && client,
+                     SSLContext & server_context, SSLContext & client_context,
+                     HTTPBackingStore & backing_store );
+
+    int client_fd( void ) const { return client_.socket().fd_num(); }
+    int server_fd( void ) const { return server_.socket().fd_num(); }
+
+    /* make all the progress possible without blocking */
+    void service( void );
+
+    /* epoll events to wait for on each socket (0 for none) */
+    uint32_t client_events( void ) const;
+    uint32_t server_events( void ) const;
+
+    /* nothing left to do: the connection can be closed */
+    bool finished( void ) const { return state_ == State::Finished; }
+
+    /* forbid copying or assigning */
+    ProxyConnection( const ProxyConnection & other ) = delete;
+    ProxyConnection & operator=( const ProxyConnection & other ) = delete;
+};
+
+#endif /* PROXY_CONNECTION_HH */
@@ -105,7 +105,9 @@ SSLContext::SSLContext( const SSL_MODE type )
 
 SecureSocket::SecureSocket( TCPSocket && sock, SSL * ssl )
     : TCPSocket( move( sock ) ),
-      ssl_( ssl )
+      ssl_( ssl ),
+      want_write_( false ),
+      retry_write_length_( 0 )
 {
     if ( not ssl_ ) {
         throw runtime_error( "SecureSocket: constructor must be passed valid SSL structure" );
@@ -117,6 +119,11 @@ SecureSocket::SecureSocket( TCPSocket && sock, SSL * ssl )
 
     /* enable read/write to return only after handshake/renegotiation and successful completion */
     SSL_set_mode( ssl_.get(), SSL_MODE_AUTO_RETRY );
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    /* a TCP close without close_notify is EOF (OpenSSL 3 otherwise makes it an error) */
+    SSL_set_options( ssl_.get(), SSL_OP_IGNORE_UNEXPECTED_EOF );
+#endif
 }
 
 SecureSocket SSLContext::new_secure_socket( TCPSocket && sock )
@@ -187,3 +194,78 @@ void SecureSocket::write(const string & message )
 
     register_write();
 }
+
+bool SecureSocket::check_nonblocking( const string & s_attempt, const int ret )
+{
+    if ( ret > 0 ) {
+        return true;
+    }
+
+    switch ( SSL_get_error( ssl_.get(), ret ) ) {
+    case SSL_ERROR_WANT_READ:
+        want_write_ = false;
+        return false;
+    case SSL_ERROR_WANT_WRITE:
+        want_write_ = true;
+        return false;
+    default:
+        throw ssl_error( s_attempt );
+    }
+}
+
+bool SecureSocket::connect_nonblocking( void )
+{
+    return check_nonblocking( "SSL_connect", SSL_connect( ssl_.get() ) );
+}
+
+bool SecureSocket::accept_nonblocking( void )
+{
+    return check_nonblocking( "SSL_accept", SSL_accept( ssl_.get() ) );
+}
+
+bool SecureSocket::read_nonblocking( char * const buffer, const size_t capacity, size_t & bytes_read )
+{
+    const int ret = SSL_read( ssl_.get(), buffer, capacity );
+
+    /* count the attempt even if it has to wait, as FileDescriptor does */
+    register_read();
+
+    if ( ret <= 0 ) {
+        const int error_return = SSL_get_error( ssl_.get(), ret );
+        if ( error_return == SSL_ERROR_ZERO_RETURN /* clean SSL close */
+             or ( error_return == SSL_ERROR_SYSCALL and ERR_peek_error() == 0 ) ) { /* TCP close */
+            set_eof();
+            bytes_read = 0;
+            return true;
+        }
+    }
+
+    if ( not check_nonblocking( "SSL_read", ret ) ) {
+        return false;
+    }
+
+    bytes_read = ret;
+    return true;
+}
+
+bool SecureSocket::write_nonblocking( const char * const buffer, const size_t size, size_t & bytes_written )
+{
+    /* let a write finish early, and be retried from a buffer that has since grown */
+    SSL_set_mode( ssl_.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+
+    const size_t length = retry_write_length_ ? retry_write_length_ : size;
+    assert( length <= size );
+
+    const int ret = SSL_write( ssl_.get(), buffer, length );
+
+    register_write();
+
+    if ( not check_nonblocking( "SSL_write", ret ) ) {
+        retry_write_length_ = length;
+        return false;
+    }
+
+    retry_write_length_ = 0;
+    bytes_written = ret;
+    return true;
+}
@@ -5,6 +5,8 @@
 #ifndef SECURE_SOCKET_HH
 #define SECURE_SOCKET_HH
 
+#include <memory>
+
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -21,14 +23,32 @@ private:
     typedef std::unique_ptr<SSL, SSL_deleter> SSL_handle;
     SSL_handle ssl_;
 
+    /* for non-blocking use */
+    bool want_write_;
+    size_t retry_write_length_; /* a write that had to wait must be retried with the same length */
+
     SecureSocket( TCPSocket && sock, SSL * ssl );
 
+    /* after an SSL call that returned ret: false if it has to wait for the socket, throws on error */
+    bool check_nonblocking( const std::string & s_attempt, const int ret );
+
 public:
     void connect( void );
     void accept( void );
 
     std::string read( void );
     void write( const std::string & message );
+
+    /* non-blocking versions (once set_blocking( false ) has been called):
+       each returns false if it has to wait for the socket to become
+       readable or (if want_write()) writable, and should then be retried.
+       A read of 0 bytes means EOF. */
+    bool connect_nonblocking( void );
+    bool accept_nonblocking( void );
+    bool read_nonblocking( char * const buffer, const size_t capacity, size_t & bytes_read );
+    bool write_nonblocking( const char * const buffer, const size_t size, size_t & bytes_written );
+
+    bool want_write( void ) const { return want_write_; }
 };
 
 class SSLContext
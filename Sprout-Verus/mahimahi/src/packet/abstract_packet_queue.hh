@@ -4,21 +4,49 @@
 #define ABSTRACT_PACKET_QUEUE
 
 #include <string>
+#include <functional>
+#include <cstdint>
 
 #include "queued_packet.hh"
 
 class AbstractPacketQueue
 {
 public:
+    /* told about each packet the queue drops, why, and when (in ns)
+       (e.g. for a packet capture) */
+    typedef std::function<void( const QueuedPacket & packet, const char * const reason,
+                                const uint64_t time )> DropObserver;
+
+private:
+    DropObserver drop_observer_ {};
+
+protected:
+    void dropped( const QueuedPacket & packet, const char * const reason, const uint64_t time ) const
+    {
+        if ( drop_observer_ ) {
+            drop_observer_( packet, reason, time );
+        }
+    }
+
+public:
+    /* Times are those of the emulated link, not the clock: a link that
+       is catching up serves its queue at each past delivery opportunity
+       in turn. A packet is enqueued at its arrival_time, and dequeued at
+       now (both in ns, and never going backwards). */
     virtual void enqueue( QueuedPacket && p ) = 0;
 
-    virtual QueuedPacket dequeue( void ) = 0;
+    /* only called when not empty, but a queue that drops packets as they
+       are dequeued (e.g. CoDel) may still find it has nothing to return:
+       then the packet has no contents */
+    virtual QueuedPacket dequeue( const uint64_t now ) = 0;
 
     virtual bool empty( void ) const = 0;
 
     virtual ~AbstractPacketQueue() = default;
 
     virtual std::string to_string( void ) const = 0;
+
+    void set_drop_observer( const DropObserver & observer ) { drop_observer_ = observer; }
 };
 
 #endif /* ABSTRACT_PACKET_QUEUE */ 
@@ -0,0 +1,131 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef CODEL_HH
+#define CODEL_HH
+
+#include <cmath>
+#include <cstdint>
+
+#include "queued_packet.hh"
+
+/* The CoDel dequeue-side state machine (RFC 8289) for one queue of
+   packets. The queue is reached through a pop_head functor,
+
+       bool pop_head( QueuedPacket & packet, unsigned int & bytes_left )
+
+   which takes the packet at the head (returning false if there is
+   none) and reports the bytes still queued behind it. This lets CoDel
+   run on a plain FIFO or on one flow of FQ-CoDel without copying.
+   Each packet CoDel drops is shown to a drop functor first,
+
+       void drop( const QueuedPacket & packet ) */
+
+class CoDel
+{
+private:
+    const static unsigned int MAX_PACKET = 1504; /* queue is never "standing" with less than this */
+
+    uint64_t target_, interval_; /* ns */
+
+    uint64_t first_above_time_ = 0, drop_next_ = 0;
+    unsigned int count_ = 0, last_count_ = 0;
+    bool dropping_ = false;
+
+    uint64_t dropped_ = 0;
+
+    uint64_t control_law( const uint64_t t ) const
+    {
+        return t + uint64_t( interval_ / std::sqrt( count_ ) );
+    }
+
+    /* take the head packet, and decide whether the queue has been over target for an interval */
+    template <typename PopHead>
+    bool do_dequeue( const uint64_t now, PopHead && pop_head, QueuedPacket & packet, bool & ok_to_drop )
+    {
+        unsigned int bytes_left;
+        ok_to_drop = false;
+
+        if ( not pop_head( packet, bytes_left ) ) {
+            first_above_time_ = 0;
+            return false;
+        }
+
+        const uint64_t sojourn_time = now > packet.arrival_time ? now - packet.arrival_time : 0;
+
+        if ( sojourn_time < target_ or bytes_left <= MAX_PACKET ) {
+            first_above_time_ = 0;
+        } else if ( first_above_time_ == 0 ) {
+            first_above_time_ = now + interval_;
+        } else if ( now >= first_above_time_ ) {
+            ok_to_drop = true;
+        }
+
+        return true;
+    }
+
+public:
+    CoDel( const uint64_t target_ns, const uint64_t interval_ns )
+        : target_( target_ns ), interval_( interval_ns )
+    {}
+
+    /* returns a packet with no contents if the queue is empty
+       (or CoDel has dropped everything in it) */
+    template <typename PopHead, typename Drop>
+    QueuedPacket dequeue( const uint64_t now, PopHead && pop_head, Drop && drop )
+    {
+        QueuedPacket packet( PacketBuffer(), 0 );
+        bool ok_to_drop;
+
+        if ( not do_dequeue( now, pop_head, packet, ok_to_drop ) ) {
+            dropping_ = false;
+            return packet;
+        }
+
+        if ( dropping_ ) {
+            if ( not ok_to_drop ) {
+                /* sojourn time below target: leave dropping state */
+                dropping_ = false;
+            }
+
+            while ( dropping_ and now >= drop_next_ ) {
+                drop( packet );
+                dropped_++;
+                count_++;
+
+                if ( not do_dequeue( now, pop_head, packet, ok_to_drop ) ) {
+                    dropping_ = false;
+                    return packet;
+                }
+
+                if ( not ok_to_drop ) {
+                    dropping_ = false;
+                } else {
+                    drop_next_ = control_law( drop_next_ );
+                }
+            }
+        } else if ( ok_to_drop ) {
+            drop( packet );
+            dropped_++;
+
+            if ( not do_dequeue( now, pop_head, packet, ok_to_drop ) ) {
+                return packet;
+            }
+
+            dropping_ = true;
+
+            /* if we were dropping recently, start at a rate near where we left off */
+            const unsigned int delta = count_ - last_count_;
+            count_ = ( delta > 1 and int64_t( now - drop_next_ ) < int64_t( 16 * interval_ ) ) ? delta : 1;
+            drop_next_ = control_law( now );
+            last_count_ = count_;
+        }
+
+        return packet;
+    }
+
+    uint64_t target( void ) const { return target_; }
+    uint64_t interval( void ) const { return interval_; }
+    uint64_t dropped( void ) const { return dropped_; }
+};
+
+#endif /* CODEL_HH */
@@ -0,0 +1,61 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "codel_packet_queue.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* defaults from RFC 8289 */
+static const unsigned int DEFAULT_TARGET_MS = 5;
+static const unsigned int DEFAULT_INTERVAL_MS = 100;
+
+static uint64_t arg_ms_or_default( const string & args, const string & name, const unsigned int default_ms )
+{
+    const unsigned int value = DroppingPacketQueue::get_arg( args, name );
+    return ( value ? value : default_ms ) * NS_PER_MS;
+}
+
+CoDelPacketQueue::CoDelPacketQueue( const string & args )
+    : DroppingPacketQueue( args ),
+      codel_( arg_ms_or_default( args, "target", DEFAULT_TARGET_MS ),
+              arg_ms_or_default( args, "interval", DEFAULT_INTERVAL_MS ) )
+{
+}
+
+void CoDelPacketQueue::enqueue( QueuedPacket && p )
+{
+    if ( good_with( size_bytes() + p.contents.size(),
+                    size_packets() + 1 ) ) {
+        accept( move( p ) );
+    } else {
+        dropped( p, "queue full", p.arrival_time );
+    }
+
+    assert( good() );
+}
+
+QueuedPacket CoDelPacketQueue::dequeue( const uint64_t now )
+{
+    return codel_.dequeue( now,
+                           [&] ( QueuedPacket & packet, unsigned int & bytes_left ) {
+                               if ( DroppingPacketQueue::empty() ) {
+                                   return false;
+                               }
+                               packet = DroppingPacketQueue::dequeue( now );
+                               bytes_left = size_bytes();
+                               return true;
+                           },
+                           [&] ( const QueuedPacket & packet ) { dropped( packet, "codel", now ); } );
+}
+
+string CoDelPacketQueue::to_string( void ) const
+{
+    string ret = DroppingPacketQueue::to_string();
+
+    /* add our parameters inside the brackets */
+    ret.pop_back();
+    ret += ", target=" + ::to_string( codel_.target() / NS_PER_MS )
+        + ", interval=" + ::to_string( codel_.interval() / NS_PER_MS ) + "]";
+
+    return ret;
+}
@@ -0,0 +1,33 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef CODEL_PACKET_QUEUE_HH
+#define CODEL_PACKET_QUEUE_HH
+
+#include "dropping_packet_queue.hh"
+#include "codel.hh"
+
+/* a drop-tail queue with CoDel active queue management
+   (args: packets and/or bytes, and optionally target and interval in ms) */
+
+class CoDelPacketQueue : public DroppingPacketQueue
+{
+private:
+    CoDel codel_;
+
+    virtual const std::string & type( void ) const override
+    {
+        static const std::string type_ { "codel" };
+        return type_;
+    }
+
+public:
+    CoDelPacketQueue( const std::string & args );
+
+    void enqueue( QueuedPacket && p ) override;
+
+    QueuedPacket dequeue( const uint64_t now ) override;
+
+    std::string to_string( void ) const override;
+};
+
+#endif /* CODEL_PACKET_QUEUE_HH */
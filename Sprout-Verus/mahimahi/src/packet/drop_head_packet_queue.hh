@@ -19,12 +19,14 @@ public:
 
     void enqueue( QueuedPacket && p ) override
     {
+        const uint64_t now = p.arrival_time;
+
         /* always accept the packet */
         accept( std::move( p ) );
 
         /* do we need to drop from the head? */
         while ( not good() ) {
-            dequeue();
+            dropped( dequeue( now ), "queue full (from head)", now );
         }
     }
 };
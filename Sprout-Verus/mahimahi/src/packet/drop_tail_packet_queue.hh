@@ -22,6 +22,8 @@ public:
         if ( good_with( size_bytes() + p.contents.size(),
                         size_packets() + 1 ) ) {
             accept( std::move( p ) );
+        } else {
+            dropped( p, "queue full", p.arrival_time );
         }
 
         assert( good() );
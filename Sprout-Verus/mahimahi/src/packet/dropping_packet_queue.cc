@@ -8,7 +8,7 @@
 
 using namespace std;
 
-static unsigned int get_arg( const string & args, const string & name )
+unsigned int DroppingPacketQueue::get_arg( const string & args, const string & name )
 {
     auto offset = args.find( name );
     if ( offset == string::npos ) {
@@ -49,7 +49,7 @@ DroppingPacketQueue::DroppingPacketQueue( const string & args )
     }
 }
 
-QueuedPacket DroppingPacketQueue::dequeue( void )
+QueuedPacket DroppingPacketQueue::dequeue( const uint64_t )
 {
     assert( not internal_queue_.empty() );
 
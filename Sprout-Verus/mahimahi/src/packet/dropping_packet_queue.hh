@@ -35,9 +35,12 @@ protected:
 public:
     DroppingPacketQueue( const std::string & args );
 
+    /* parse "NAME=NUMBER" out of the queue arguments (0 if absent) */
+    static unsigned int get_arg( const std::string & args, const std::string & name );
+
     virtual void enqueue( QueuedPacket && p ) = 0;
 
-    QueuedPacket dequeue( void ) override;
+    QueuedPacket dequeue( const uint64_t now ) override;
 
     bool empty( void ) const override;
 
@@ -0,0 +1,286 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <random>
+#include <cassert>
+#include <stdexcept>
+
+#include "fq_codel_packet_queue.hh"
+#include "dropping_packet_queue.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* defaults from RFC 8290 */
+static const unsigned int DEFAULT_PACKET_LIMIT = 10240;
+static const unsigned int DEFAULT_FLOWS = 1024;
+static const unsigned int DEFAULT_QUANTUM = 1514;
+static const unsigned int DEFAULT_TARGET_MS = 5;
+static const unsigned int DEFAULT_INTERVAL_MS = 100;
+
+/* TUN packets start with a 4-byte header (flags, protocol) */
+static const size_t TUN_HEADER_SIZE = 4;
+
+static unsigned int arg_or_default( const string & args, const string & name, const unsigned int default_value )
+{
+    const unsigned int value = DroppingPacketQueue::get_arg( args, name );
+    return value ? value : default_value;
+}
+
+FQCoDelPacketQueue::FQCoDelPacketQueue( const string & args )
+    : packet_limit_( DroppingPacketQueue::get_arg( args, "packets" ) ),
+      byte_limit_( DroppingPacketQueue::get_arg( args, "bytes" ) ),
+      quantum_( arg_or_default( args, "quantum", DEFAULT_QUANTUM ) ),
+      target_( arg_or_default( args, "target", DEFAULT_TARGET_MS ) * NS_PER_MS ),
+      interval_( arg_or_default( args, "interval", DEFAULT_INTERVAL_MS ) * NS_PER_MS ),
+      nodes_(),
+      free_list_( NIL ),
+      flows_( arg_or_default( args, "flows", DEFAULT_FLOWS ),
+              { NIL, NIL, 0, 0, CoDel( target_, interval_ ), FlowList::None, NIL } ),
+      new_flows_( { NIL, NIL } ),
+      old_flows_( { NIL, NIL } ),
+      size_packets_( 0 ),
+      size_bytes_( 0 ),
+      perturbation_( random_device()() )
+{
+    if ( packet_limit_ == 0 and byte_limit_ == 0 ) {
+        packet_limit_ = DEFAULT_PACKET_LIMIT;
+    }
+
+    /* with a packet limit, we know how many nodes we'll ever need */
+    if ( packet_limit_ ) {
+        nodes_.reserve( packet_limit_ + 1 );
+    }
+}
+
+/* hash the addresses, protocol and ports into a flow */
+uint32_t FQCoDelPacketQueue::classify( const PacketBuffer & packet ) const
+{
+    const uint8_t * const data = reinterpret_cast<const uint8_t *>( packet.data() );
+    const size_t size = packet.size();
+
+    /* FNV-1a, seeded with the perturbation */
+    uint32_t hash = 2166136261u ^ perturbation_;
+    auto mix = [&] ( const size_t offset, const size_t length ) {
+        for ( size_t i = offset; i < offset + length and i < size; i++ ) {
+            hash = ( hash ^ data[ i ] ) * 16777619u;
+        }
+    };
+
+    if ( size < TUN_HEADER_SIZE + 1 ) {
+        return 0;
+    }
+
+    const uint8_t * const ip = data + TUN_HEADER_SIZE;
+    size_t transport_offset;
+    uint8_t protocol;
+
+    switch ( ip[ 0 ] >> 4 ) {
+    case 4:
+        mix( TUN_HEADER_SIZE + 12, 8 ); /* source and destination */
+        protocol = size > TUN_HEADER_SIZE + 9 ? ip[ 9 ] : 0;
+        transport_offset = TUN_HEADER_SIZE + 4 * ( ip[ 0 ] & 0x0f );
+        break;
+    case 6:
+        mix( TUN_HEADER_SIZE + 8, 32 ); /* source and destination */
+        protocol = size > TUN_HEADER_SIZE + 6 ? ip[ 6 ] : 0;
+        transport_offset = TUN_HEADER_SIZE + 40;
+        break;
+    default:
+        return 0;
+    }
+
+    hash = ( hash ^ protocol ) * 16777619u;
+
+    /* TCP and UDP ports */
+    if ( protocol == 6 or protocol == 17 ) {
+        mix( transport_offset, 4 );
+    }
+
+    return hash % flows_.size();
+}
+
+void FQCoDelPacketQueue::push_flow( const FlowList which, const uint32_t flow )
+{
+    List & l = list( which );
+
+    flows_[ flow ].list = which;
+    flows_[ flow ].list_next = NIL;
+
+    if ( l.tail == NIL ) {
+        l.head = flow;
+    } else {
+        flows_[ l.tail ].list_next = flow;
+    }
+    l.tail = flow;
+}
+
+uint32_t FQCoDelPacketQueue::pop_flow( const FlowList which )
+{
+    List & l = list( which );
+    const uint32_t flow = l.head;
+    assert( flow != NIL );
+
+    l.head = flows_[ flow ].list_next;
+    if ( l.head == NIL ) {
+        l.tail = NIL;
+    }
+
+    flows_[ flow ].list = FlowList::None;
+    flows_[ flow ].list_next = NIL;
+
+    return flow;
+}
+
+bool FQCoDelPacketQueue::over_limit( void ) const
+{
+    return ( packet_limit_ and size_packets_ > packet_limit_ )
+        or ( byte_limit_ and size_bytes_ > byte_limit_ );
+}
+
+void FQCoDelPacketQueue::enqueue( QueuedPacket && p )
+{
+    const uint64_t now = p.arrival_time;
+    const uint32_t flow_index = classify( p.contents );
+    Flow & flow = flows_[ flow_index ];
+
+    /* get a node */
+    uint32_t node = free_list_;
+    if ( node == NIL ) {
+        node = nodes_.size();
+        nodes_.push_back( { QueuedPacket( PacketBuffer(), 0 ), NIL } );
+    } else {
+        free_list_ = nodes_[ node ].next;
+    }
+
+    /* append to the flow */
+    size_packets_++;
+    size_bytes_ += p.contents.size();
+    flow.bytes += p.contents.size();
+
+    nodes_[ node ].packet = move( p );
+    nodes_[ node ].next = NIL;
+
+    if ( flow.tail == NIL ) {
+        flow.head = node;
+    } else {
+        nodes_[ flow.tail ].next = node;
+    }
+    flow.tail = node;
+
+    /* a newly active flow goes to the back of the new flows */
+    if ( flow.list == FlowList::None ) {
+        flow.deficit = quantum_;
+        push_flow( FlowList::New, flow_index );
+    }
+
+    while ( over_limit() ) {
+        drop_from_fattest_flow( now );
+    }
+}
+
+QueuedPacket FQCoDelPacketQueue::pop_from_flow( Flow & flow )
+{
+    const uint32_t node = flow.head;
+    assert( node != NIL );
+
+    flow.head = nodes_[ node ].next;
+    if ( flow.head == NIL ) {
+        flow.tail = NIL;
+    }
+
+    QueuedPacket ret = move( nodes_[ node ].packet );
+
+    nodes_[ node ].next = free_list_;
+    free_list_ = node;
+
+    size_packets_--;
+    size_bytes_ -= ret.contents.size();
+    flow.bytes -= ret.contents.size();
+
+    return ret;
+}
+
+void FQCoDelPacketQueue::drop_from_fattest_flow( const uint64_t now )
+{
+    Flow * fattest = &flows_.front();
+    for ( auto & flow : flows_ ) {
+        if ( flow.bytes > fattest->bytes ) {
+            fattest = &flow;
+        }
+    }
+
+    if ( fattest->head == NIL ) {
+        throw runtime_error( "FQCoDelPacketQueue: over limit with no packets" );
+    }
+
+    dropped( pop_from_flow( *fattest ), "queue full (from fattest flow)", now );
+}
+
+QueuedPacket FQCoDelPacketQueue::dequeue( const uint64_t now )
+{
+    while ( true ) {
+        FlowList which;
+        if ( new_flows_.head != NIL ) {
+            which = FlowList::New;
+        } else if ( old_flows_.head != NIL ) {
+            which = FlowList::Old;
+        } else {
+            /* CoDel dropped everything */
+            return QueuedPacket( PacketBuffer(), 0 );
+        }
+
+        const uint32_t flow_index = list( which ).head;
+        Flow & flow = flows_[ flow_index ];
+
+        /* used up its quantum: top up and go to the back of the old flows */
+        if ( flow.deficit <= 0 ) {
+            flow.deficit += quantum_;
+            push_flow( FlowList::Old, pop_flow( which ) );
+            continue;
+        }
+
+        QueuedPacket packet = flow.codel.dequeue( now,
+                                                  [&] ( QueuedPacket & head, unsigned int & bytes_left ) {
+                                                      if ( flow.head == NIL ) {
+                                                          return false;
+                                                      }
+                                                      head = pop_from_flow( flow );
+                                                      bytes_left = flow.bytes;
+                                                      return true;
+                                                  },
+                                                  [&] ( const QueuedPacket & head ) { dropped( head, "codel", now ); } );
+
+        if ( packet.contents.empty() ) {
+            /* flow has gone empty. A new flow goes to the old flows (so it can't
+               jump the line again straight away) unless there are none. */
+            pop_flow( which );
+            if ( which == FlowList::New and old_flows_.head != NIL ) {
+                push_flow( FlowList::Old, flow_index );
+            }
+            continue;
+        }
+
+        flow.deficit -= int( packet.contents.size() );
+        return packet;
+    }
+}
+
+string FQCoDelPacketQueue::to_string( void ) const
+{
+    string ret = "fq_codel [";
+
+    if ( byte_limit_ ) {
+        ret += "bytes=" + ::to_string( byte_limit_ ) + ", ";
+    }
+
+    if ( packet_limit_ ) {
+        ret += "packets=" + ::to_string( packet_limit_ ) + ", ";
+    }
+
+    ret += "flows=" + ::to_string( flows_.size() )
+        + ", quantum=" + ::to_string( quantum_ )
+        + ", target=" + ::to_string( target_ / NS_PER_MS )
+        + ", interval=" + ::to_string( interval_ / NS_PER_MS ) + "]";
+
+    return ret;
+}
@@ -0,0 +1,87 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef FQ_CODEL_PACKET_QUEUE_HH
+#define FQ_CODEL_PACKET_QUEUE_HH
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "abstract_packet_queue.hh"
+#include "codel.hh"
+
+/* FQ-CoDel (RFC 8290): packets are hashed by their 5-tuple into a
+   fixed number of flows, each with its own CoDel state, and the flows
+   are served by deficit round robin, with newly active flows first.
+
+   Packets wait in per-flow lists threaded through one pool of nodes,
+   sized for the packet limit up front, so enqueueing doesn't allocate.
+
+   args: packets and/or bytes (limit; default packets=10240), flows,
+   quantum (bytes), and target and interval (ms) */
+
+class FQCoDelPacketQueue : public AbstractPacketQueue
+{
+private:
+    const static uint32_t NIL = UINT32_MAX;
+
+    enum class FlowList { None, New, Old };
+
+    struct Node
+    {
+        QueuedPacket packet;
+        uint32_t next;
+    };
+
+    struct Flow
+    {
+        uint32_t head, tail; /* packets */
+        unsigned int bytes;
+        int deficit;
+        CoDel codel;
+        FlowList list;
+        uint32_t list_next; /* next flow in the same list */
+    };
+
+    struct List
+    {
+        uint32_t head, tail;
+    };
+
+    unsigned int packet_limit_, byte_limit_, quantum_;
+    uint64_t target_, interval_; /* ns */
+
+    std::vector<Node> nodes_;
+    uint32_t free_list_;
+
+    std::vector<Flow> flows_;
+    List new_flows_, old_flows_;
+
+    unsigned int size_packets_, size_bytes_;
+    uint32_t perturbation_; /* random seed for the flow hash */
+
+    uint32_t classify( const PacketBuffer & packet ) const;
+
+    /* take the packet at the head of a flow */
+    QueuedPacket pop_from_flow( Flow & flow );
+
+    void drop_from_fattest_flow( const uint64_t now );
+    bool over_limit( void ) const;
+
+    List & list( const FlowList which ) { return which == FlowList::New ? new_flows_ : old_flows_; }
+    void push_flow( const FlowList which, const uint32_t flow );
+    uint32_t pop_flow( const FlowList which );
+
+public:
+    FQCoDelPacketQueue( const std::string & args );
+
+    void enqueue( QueuedPacket && p ) override;
+
+    QueuedPacket dequeue( const uint64_t now ) override;
+
+    bool empty( void ) const override { return size_packets_ == 0; }
+
+    std::string to_string( void ) const override;
+};
+
+#endif /* FQ_CODEL_PACKET_QUEUE_HH */
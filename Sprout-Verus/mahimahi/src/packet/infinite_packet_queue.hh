@@ -29,7 +29,7 @@ public:
         internal_queue_.emplace( std::move( p ) );
     }
 
-    QueuedPacket dequeue( void ) override
+    QueuedPacket dequeue( const uint64_t ) override
     {
         assert( not internal_queue_.empty() );
 
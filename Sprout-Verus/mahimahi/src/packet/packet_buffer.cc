@@ -0,0 +1,117 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+
+#include "packet_buffer.hh"
+
+using namespace std;
+
+/* the pool grows by this many buffers at a time, and never shrinks */
+static const size_t SLOTS_PER_SLAB = 256;
+
+class PacketBuffer::Pool
+{
+private:
+    vector< unique_ptr< Slot[] > > slabs_ {};
+    vector< Slot * > free_slots_ {};
+
+public:
+    Slot * take( void )
+    {
+        if ( free_slots_.empty() ) {
+            slabs_.emplace_back( new Slot[ SLOTS_PER_SLAB ] );
+            free_slots_.reserve( slabs_.size() * SLOTS_PER_SLAB );
+            for ( size_t i = 0; i < SLOTS_PER_SLAB; i++ ) {
+                free_slots_.push_back( &slabs_.back()[ i ] );
+            }
+        }
+
+        Slot * const ret = free_slots_.back();
+        free_slots_.pop_back();
+
+        ret->references = 1;
+        ret->size = 0;
+        return ret;
+    }
+
+    void give_back( Slot * const slot ) { free_slots_.push_back( slot ); }
+
+    /* one pool per thread, so threads can ferry packets without locking */
+    static Pool & instance( void )
+    {
+        static thread_local Pool the_pool;
+        return the_pool;
+    }
+};
+
+PacketBuffer PacketBuffer::allocate( void )
+{
+    return PacketBuffer( Pool::instance().take() );
+}
+
+PacketBuffer PacketBuffer::from_string( const string & contents )
+{
+    PacketBuffer ret = allocate();
+    ret.resize( contents.size() );
+    memcpy( ret.data(), contents.data(), contents.size() );
+    return ret;
+}
+
+void PacketBuffer::release( void )
+{
+    if ( slot_ ) {
+        assert( slot_->references > 0 );
+        if ( --slot_->references == 0 ) {
+            Pool::instance().give_back( slot_ );
+        }
+        slot_ = nullptr;
+    }
+}
+
+PacketBuffer::PacketBuffer( const PacketBuffer & other )
+    : slot_( other.slot_ )
+{
+    if ( slot_ ) {
+        slot_->references++;
+    }
+}
+
+PacketBuffer & PacketBuffer::operator=( const PacketBuffer & other )
+{
+    if ( other.slot_ ) {
+        other.slot_->references++;
+    }
+
+    release();
+    slot_ = other.slot_;
+
+    return *this;
+}
+
+PacketBuffer & PacketBuffer::operator=( PacketBuffer && other ) noexcept
+{
+    if ( this != &other ) {
+        release();
+        slot_ = other.slot_;
+        other.slot_ = nullptr;
+    }
+
+    return *this;
+}
+
+void PacketBuffer::resize( const size_t size )
+{
+    if ( not slot_ ) {
+        throw runtime_error( "PacketBuffer: resize of empty handle" );
+    }
+
+    if ( size > CAPACITY ) {
+        throw runtime_error( "PacketBuffer: packet larger than buffer" );
+    }
+
+    slot_->size = size;
+}
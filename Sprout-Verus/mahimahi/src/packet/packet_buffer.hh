@@ -0,0 +1,71 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_BUFFER_HH
+#define PACKET_BUFFER_HH
+
+#include <string>
+#include <cstddef>
+
+/* A reference-counted handle to a fixed-size packet buffer. Buffers
+   are carved out of slabs and recycled through a free list, so a
+   packet read from a TUN device travels through the queues to the
+   sibling device without being copied or individually malloc'd.
+   Copying a handle shares the buffer.
+
+   Each thread has its own pool, and a packet must stay on one thread
+   (e.g. with the ferry that read it) and not outlive it. */
+
+class PacketBuffer
+{
+public:
+    /* larger than any TUN datagram at the default MTU */
+    const static size_t CAPACITY = 2048;
+
+private:
+    struct Slot
+    {
+        unsigned int references;
+        size_t size;
+        char data[ CAPACITY ];
+    };
+
+    Slot * slot_;
+
+    explicit PacketBuffer( Slot * const slot ) : slot_( slot ) {}
+
+    void release( void );
+
+    class Pool; /* the slab allocator, in packet_buffer.cc */
+
+public:
+    /* a handle that refers to no buffer */
+    PacketBuffer() : slot_( nullptr ) {}
+
+    /* get a fresh (empty) buffer from the pool */
+    static PacketBuffer allocate( void );
+
+    /* copy a string into a fresh buffer */
+    static PacketBuffer from_string( const std::string & contents );
+
+    ~PacketBuffer() { release(); }
+
+    /* copying shares the underlying buffer */
+    PacketBuffer( const PacketBuffer & other );
+    PacketBuffer & operator=( const PacketBuffer & other );
+
+    PacketBuffer( PacketBuffer && other ) noexcept : slot_( other.slot_ ) { other.slot_ = nullptr; }
+    PacketBuffer & operator=( PacketBuffer && other ) noexcept;
+
+    /* accessors */
+    char * data( void ) { return slot_ ? slot_->data : nullptr; }
+    const char * data( void ) const { return slot_ ? slot_->data : nullptr; }
+    size_t size( void ) const { return slot_ ? slot_->size : 0; }
+    bool empty( void ) const { return size() == 0; }
+
+    /* set the length of the contents (e.g. after reading into data()) */
+    void resize( const size_t size );
+
+    std::string str( void ) const { return std::string( data(), size() ); }
+};
+
+#endif /* PACKET_BUFFER_HH */
@@ -16,6 +16,8 @@
 #include "timestamp.hh"
 #include "exception.hh"
 #include "bindworkaround.hh"
+#include "ezio.hh"
+#include "packet_buffer.hh"
 #include "config.h"
 
 using namespace std;
@@ -169,10 +171,53 @@ int PacketShell<FerryQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
                                               FileDescriptor & tun,
                                               FileDescriptor & sibling )
 {
-    /* tun device gets datagram -> read it -> give to ferry */
+    const unsigned int batch_size = ferry_batch_size();
+
+    /* with batching, drain the tun device until it would block
+       (the other ferry writes to this device, but writes to a
+       tun device never block, so O_NONBLOCK doesn't affect it) */
+    if ( batch_size > 1 ) {
+        tun.set_blocking( false );
+    }
+
+    uint64_t packets_in = 0, wakeups = 0, oversized = 0;
+    const unsigned int writes_before = sibling.write_count();
+    const uint64_t start_time = timestamp();
+
+    /* tun device gets datagram(s) -> read them -> give to ferry */
     add_simple_input_handler( tun, 
                               [&] () {
-                                  ferry_queue.read_packet( tun.read() );
+                                  wakeups++;
+
+                                  for ( unsigned int i = 0; i < batch_size; i++ ) {
+                                      /* read straight into a pooled buffer */
+                                      PacketBuffer packet = PacketBuffer::allocate();
+                                      size_t size;
+
+                                      if ( batch_size == 1 ) {
+                                          size = tun.read( packet.data(), PacketBuffer::CAPACITY );
+                                      } else if ( not tun.read_nonblocking( packet.data(), PacketBuffer::CAPACITY, size ) ) {
+                                          break;
+                                      }
+
+                                      /* a full buffer means the datagram may have been
+                                         truncated, so drop it (as a too-small MTU would) */
+                                      if ( size == PacketBuffer::CAPACITY ) {
+                                          if ( oversized++ == 0 ) {
+                                              cerr << "ferry: dropping datagrams of "
+                                                   << PacketBuffer::CAPACITY << " bytes or more" << endl;
+                                          }
+                                          continue;
+                                      }
+
+                                      packet.resize( size );
+                                      ferry_queue.read_packet( move( packet ) );
+                                      packets_in++;
+
+                                      if ( tun.eof() ) {
+                                          break;
+                                      }
+                                  }
                                   return ResultType::Continue;
                               } );
 
@@ -191,7 +236,21 @@ int PacketShell<FerryQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
                                 },
                                 [&] () { return ferry_queue.finished(); } ) );
 
-    return internal_loop( [&] () { return ferry_queue.wait_time(); } );
+    const int ret = internal_loop( [&] () { return ferry_queue.wait_time(); } );
+
+    /* report throughput of the ferry if asked */
+    if ( getenv( "MAHIMAHI_FERRY_STATS" ) ) {
+        const double seconds = max( uint64_t( 1 ), timestamp() - start_time ) / 1000.0;
+        const uint64_t packets_out = sibling.write_count() - writes_before;
+
+        cerr << "ferry: " << packets_in << " packets in (" << packets_in / seconds << " pkts/s), "
+             << packets_out << " out (" << packets_out / seconds << " pkts/s) over "
+             << seconds << " s; batch size " << batch_size << ", "
+             << (wakeups ? double( packets_in ) / wakeups : 0.0) << " packets per wakeup, "
+             << oversized << " oversized dropped" << endl;
+    }
+
+    return ret;
 }
 
 struct TemporaryEnvironment
@@ -0,0 +1,180 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+
+#include "pie_packet_queue.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* defaults from RFC 8033 */
+static const unsigned int DEFAULT_TARGET_MS = 15;
+static const unsigned int DEFAULT_TUPDATE_MS = 15;
+static const unsigned int DEFAULT_MAX_BURST_MS = 150;
+static const double ALPHA = 0.125, BETA = 1.25; /* per second */
+static const unsigned int MAX_PACKET = 1504;
+
+static uint64_t arg_ms_or_default( const string & args, const string & name, const unsigned int default_ms )
+{
+    const unsigned int value = DroppingPacketQueue::get_arg( args, name );
+    return ( value ? value : default_ms ) * NS_PER_MS;
+}
+
+PIEPacketQueue::PIEPacketQueue( const string & args )
+    : DroppingPacketQueue( args ),
+      target_( arg_ms_or_default( args, "target", DEFAULT_TARGET_MS ) ),
+      tupdate_( arg_ms_or_default( args, "tupdate", DEFAULT_TUPDATE_MS ) ),
+      max_burst_( arg_ms_or_default( args, "max_burst", DEFAULT_MAX_BURST_MS ) ),
+      burst_allowance_( max_burst_ ),
+      next_update_( 0 ),
+      prng_( random_device()() ),
+      uniform_( 0.0, 1.0 )
+{
+}
+
+/* RFC 8033 section 4.2 */
+void PIEPacketQueue::calculate_drop_prob( void )
+{
+    const double seconds_per_ns = 1e-9;
+    double p = ALPHA * ( double( qdelay_ ) - double( target_ ) ) * seconds_per_ns
+        + BETA * ( double( qdelay_ ) - double( qdelay_old_ ) ) * seconds_per_ns;
+
+    /* scale the adjustment to the current probability, so it is gentle when that is small */
+    if ( drop_prob_ < 0.000001 ) {
+        p /= 2048;
+    } else if ( drop_prob_ < 0.00001 ) {
+        p /= 512;
+    } else if ( drop_prob_ < 0.0001 ) {
+        p /= 128;
+    } else if ( drop_prob_ < 0.001 ) {
+        p /= 32;
+    } else if ( drop_prob_ < 0.01 ) {
+        p /= 8;
+    } else if ( drop_prob_ < 0.1 ) {
+        p /= 2;
+    } else if ( p > 0.02 ) {
+        p = 0.02;
+    }
+
+    drop_prob_ += p;
+
+    /* decay when the queue has been idle */
+    if ( qdelay_ == 0 and qdelay_old_ == 0 ) {
+        drop_prob_ *= 0.98;
+    }
+
+    drop_prob_ = min( max( drop_prob_, 0.0 ), 1.0 );
+
+    /* reset the burst allowance once the queue has drained */
+    if ( drop_prob_ == 0 and qdelay_ < target_ / 2 and qdelay_old_ < target_ / 2 ) {
+        burst_allowance_ = max_burst_;
+    }
+
+    burst_allowance_ = burst_allowance_ > tupdate_ ? burst_allowance_ - tupdate_ : 0;
+
+    qdelay_old_ = qdelay_;
+}
+
+/* run the periodic update for each tupdate that has passed */
+void PIEPacketQueue::update( const uint64_t now )
+{
+    /* after a long idle period, a few hundred updates decay any probability to nothing */
+    const unsigned int max_updates = 512;
+
+    /* the updates run on the link's time, from the first packet */
+    if ( next_update_ == 0 ) {
+        next_update_ = now + tupdate_;
+    }
+
+    for ( unsigned int i = 0; now >= next_update_; i++ ) {
+        if ( i == max_updates ) {
+            next_update_ = now + tupdate_;
+            break;
+        }
+
+        if ( DroppingPacketQueue::empty() ) {
+            qdelay_ = 0;
+        }
+
+        calculate_drop_prob();
+        next_update_ += tupdate_;
+    }
+}
+
+/* RFC 8033 section 4.1, with the derandomization of section 5.1 */
+bool PIEPacketQueue::drop_early( const unsigned int packet_size )
+{
+    if ( burst_allowance_ > 0 ) {
+        return false;
+    }
+
+    if ( qdelay_old_ < target_ / 2 and drop_prob_ < 0.2 ) {
+        return false;
+    }
+
+    if ( size_bytes() <= 2 * MAX_PACKET ) {
+        return false;
+    }
+
+    if ( drop_prob_ == 0 ) {
+        accu_prob_ = 0;
+    }
+
+    /* small packets are less likely to be dropped */
+    accu_prob_ += drop_prob_ * min( 1.0, double( packet_size ) / MAX_PACKET );
+
+    if ( accu_prob_ < 0.85 ) {
+        return false;
+    }
+
+    if ( accu_prob_ >= 8.5 or uniform_( prng_ ) < drop_prob_ ) {
+        accu_prob_ = 0;
+        return true;
+    }
+
+    return false;
+}
+
+void PIEPacketQueue::enqueue( QueuedPacket && p )
+{
+    update( p.arrival_time );
+
+    if ( drop_early( p.contents.size() ) ) {
+        dropped( p, "pie", p.arrival_time );
+        return;
+    }
+
+    if ( good_with( size_bytes() + p.contents.size(),
+                    size_packets() + 1 ) ) {
+        accept( move( p ) );
+    } else {
+        dropped( p, "queue full", p.arrival_time );
+    }
+
+    assert( good() );
+}
+
+QueuedPacket PIEPacketQueue::dequeue( const uint64_t now )
+{
+    update( now );
+
+    QueuedPacket ret = DroppingPacketQueue::dequeue( now );
+
+    /* the queueing delay is the sojourn time of the packet leaving */
+    qdelay_ = now > ret.arrival_time ? now - ret.arrival_time : 0;
+
+    return ret;
+}
+
+string PIEPacketQueue::to_string( void ) const
+{
+    string ret = DroppingPacketQueue::to_string();
+
+    /* add our parameters inside the brackets */
+    ret.pop_back();
+    ret += ", target=" + ::to_string( target_ / NS_PER_MS )
+        + ", tupdate=" + ::to_string( tupdate_ / NS_PER_MS )
+        + ", max_burst=" + ::to_string( max_burst_ / NS_PER_MS ) + "]";
+
+    return ret;
+}
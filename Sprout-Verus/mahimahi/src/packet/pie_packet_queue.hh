@@ -0,0 +1,48 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PIE_PACKET_QUEUE_HH
+#define PIE_PACKET_QUEUE_HH
+
+#include <random>
+
+#include "dropping_packet_queue.hh"
+
+/* a drop-tail queue with PIE active queue management (RFC 8033),
+   estimating queueing delay from packet timestamps
+   (args: packets and/or bytes, and optionally target, tupdate
+   and max_burst in ms) */
+
+class PIEPacketQueue : public DroppingPacketQueue
+{
+private:
+    uint64_t target_, tupdate_, max_burst_; /* ns */
+
+    double drop_prob_ = 0, accu_prob_ = 0;
+    uint64_t qdelay_ = 0, qdelay_old_ = 0; /* ns */
+    uint64_t burst_allowance_;
+    uint64_t next_update_;
+
+    std::default_random_engine prng_;
+    std::uniform_real_distribution<> uniform_;
+
+    virtual const std::string & type( void ) const override
+    {
+        static const std::string type_ { "pie" };
+        return type_;
+    }
+
+    void calculate_drop_prob( void );
+    void update( const uint64_t now );
+    bool drop_early( const unsigned int packet_size );
+
+public:
+    PIEPacketQueue( const std::string & args );
+
+    void enqueue( QueuedPacket && p ) override;
+
+    QueuedPacket dequeue( const uint64_t now ) override;
+
+    std::string to_string( void ) const override;
+};
+
+#endif /* PIE_PACKET_QUEUE_HH */
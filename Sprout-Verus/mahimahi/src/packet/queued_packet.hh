@@ -3,15 +3,17 @@
 #ifndef QUEUED_PACKET_HH
 #define QUEUED_PACKET_HH
 
-#include <string>
+#include <cstdint>
+
+#include "packet_buffer.hh"
 
 struct QueuedPacket
 {
-    uint64_t arrival_time;
-    std::string contents;
+    uint64_t arrival_time; /* ns */
+    PacketBuffer contents;
 
-    QueuedPacket( const std::string & s_contents, uint64_t s_arrival_time )
-        : arrival_time( s_arrival_time ), contents( s_contents )
+    QueuedPacket( PacketBuffer && s_contents, uint64_t s_arrival_time )
+        : arrival_time( s_arrival_time ), contents( std::move( s_contents ) )
     {}
 };
 
@@ -4,7 +4,6 @@
 #define RED_PACKET_QUEUE_HH
 
 #include <cassert>
-#include <chrono>
 #include <cstdlib>
 #include <cmath>
 #include <iostream>
@@ -15,6 +14,7 @@
 #include "abstract_packet_queue.hh"
 #include "exception.hh"
 #include "ezio.hh"
+#include "timestamp.hh"
 
 class RedPacketQueue : public AbstractPacketQueue
 {
@@ -86,15 +86,14 @@ public:
             average_queue_size_in_bytes_ =
                 (1 - W) * average_queue_size_in_bytes_ + W * queue_size_in_bytes_;
         } else {
-            unsigned long curr_time = 
-                std::chrono::system_clock::now().time_since_epoch() /
-                std::chrono::milliseconds(1);
+            unsigned long curr_time = p.arrival_time / NS_PER_MS;
             double m = packet_rate_ * (curr_time - q_time_);
             average_queue_size_in_bytes_ = pow(1 - W, m) * average_queue_size_in_bytes_;
         }
 
         if (average_queue_size_in_bytes_ >= max_queue_size_threshold_in_bytes_) {
             count_ = 0;
+            dropped( p, "red (over maximum)", p.arrival_time );
             return;
         } else if (average_queue_size_in_bytes_ >= min_queue_size_threshold_in_bytes_) {
             ++count_;
@@ -109,6 +108,7 @@ public:
             float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
             if (r < p_a) {
                 count_ = 0;
+                dropped( p, "red", p.arrival_time );
                 return;
             }
         }
@@ -119,7 +119,7 @@ public:
         internal_queue_.emplace( std::move( p ) );
     }
 
-    QueuedPacket dequeue( void ) override
+    QueuedPacket dequeue( const uint64_t now ) override
     {
         assert( not internal_queue_.empty() );
 
@@ -129,9 +129,7 @@ public:
         queue_size_in_bytes_ -= ret.contents.size();
 
         if (queue_size_in_bytes_ == 0) {
-            q_time_ =
-                std::chrono::system_clock::now().time_since_epoch() /
-                std::chrono::milliseconds(1);
+            q_time_ = now / NS_PER_MS;
         }
 
         return ret;
@@ -0,0 +1,193 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include "timing_wheel.hh"
+
+using namespace std;
+
+TimingWheel::TimingWheel( const uint64_t now_ns )
+    : nodes_(),
+      free_list_( NIL ),
+      slots_(),
+      occupied_(),
+      current_tick_( now_ns / TICK_NS ),
+      size_( 0 )
+{
+    for ( auto & level : slots_ ) {
+        for ( auto & slot : level ) {
+            slot.head = slot.tail = NIL;
+        }
+    }
+}
+
+/* put a node (whose tick is not before the current tick) in its slot */
+void TimingWheel::file( const uint32_t node )
+{
+    Node & n = nodes_[ node ];
+    assert( n.tick >= current_tick_ );
+
+    /* the level is given by the highest digit in which the tick differs from now */
+    const uint64_t difference = n.tick ^ current_tick_;
+    const unsigned int level = difference
+        ? (63 - __builtin_clzll( difference )) / BITS_PER_LEVEL : 0;
+
+    if ( level >= LEVELS ) {
+        throw runtime_error( "TimingWheel: release time beyond horizon" );
+    }
+
+    const unsigned int index = (n.tick >> (level * BITS_PER_LEVEL)) & (SLOTS_PER_LEVEL - 1);
+    Slot & slot = slots_[ level ][ index ];
+
+    n.next = NIL;
+    if ( slot.tail == NIL ) {
+        slot.head = node;
+        occupied_[ level ][ index / 64 ] |= uint64_t( 1 ) << (index % 64);
+    } else {
+        nodes_[ slot.tail ].next = node;
+    }
+    slot.tail = node;
+}
+
+void TimingWheel::insert( const uint64_t release_ns, PacketBuffer && packet )
+{
+    /* get a node, growing the pool if necessary */
+    uint32_t node = free_list_;
+    if ( node == NIL ) {
+        if ( nodes_.size() >= NIL ) {
+            throw runtime_error( "TimingWheel: too many packets" );
+        }
+        node = nodes_.size();
+        nodes_.push_back( { 0, NIL, PacketBuffer() } );
+    } else {
+        free_list_ = nodes_[ node ].next;
+    }
+
+    /* round up, so the packet is never released early */
+    const uint64_t tick = (release_ns + TICK_NS - 1) / TICK_NS;
+
+    nodes_[ node ].tick = max( tick, current_tick_ );
+    nodes_[ node ].packet = move( packet );
+    file( node );
+    size_++;
+}
+
+bool TimingWheel::next_slot( unsigned int & level, unsigned int & index ) const
+{
+    if ( size_ == 0 ) {
+        return false;
+    }
+
+    /* on each level, the slots that can be occupied are the one for the
+       current tick and those after it (the wheel doesn't wrap around
+       within a level: later ticks go on a higher level). The first
+       occupied slot on the lowest nonempty level is the earliest. */
+    for ( level = 0; level < LEVELS; level++ ) {
+        const unsigned int first = (current_tick_ >> (level * BITS_PER_LEVEL)) & (SLOTS_PER_LEVEL - 1);
+
+        for ( unsigned int word = first / 64; word < WORDS_PER_LEVEL; word++ ) {
+            uint64_t bits = occupied_[ level ][ word ];
+            if ( word == first / 64 ) {
+                bits &= ~uint64_t( 0 ) << (first % 64);
+            }
+
+            if ( bits ) {
+                index = word * 64 + __builtin_ctzll( bits );
+                return true;
+            }
+        }
+    }
+
+    throw runtime_error( "TimingWheel: nonempty wheel with no occupied slots" );
+}
+
+uint64_t TimingWheel::slot_start( const unsigned int level, const unsigned int index ) const
+{
+    const unsigned int shift = level * BITS_PER_LEVEL;
+    const uint64_t upper_digits = (current_tick_ >> (shift + BITS_PER_LEVEL)) << (shift + BITS_PER_LEVEL);
+
+    return upper_digits | (uint64_t( index ) << shift);
+}
+
+/* the wheel has reached a slot on a higher level: spread its packets over the levels below */
+void TimingWheel::cascade( const unsigned int level, const unsigned int index )
+{
+    assert( level > 0 );
+
+    Slot & slot = slots_[ level ][ index ];
+    uint32_t node = slot.head;
+
+    slot.head = slot.tail = NIL;
+    occupied_[ level ][ index / 64 ] &= ~(uint64_t( 1 ) << (index % 64));
+
+    current_tick_ = slot_start( level, index );
+
+    /* refile in order, so packets due in the same tick keep their order */
+    while ( node != NIL ) {
+        const uint32_t next = nodes_[ node ].next;
+        file( node );
+        node = next;
+    }
+}
+
+bool TimingWheel::pop_due( const uint64_t now_ns, PacketBuffer & packet )
+{
+    const uint64_t now_tick = now_ns / TICK_NS;
+    assert( now_tick >= current_tick_ );
+
+    unsigned int level, index;
+
+    while ( next_slot( level, index ) ) {
+        if ( level == 0 ) {
+            Slot & slot = slots_[ 0 ][ index ];
+            const uint32_t node = slot.head;
+
+            if ( nodes_[ node ].tick > now_tick ) {
+                break;
+            }
+
+            /* unlink the packet and recycle its node */
+            current_tick_ = nodes_[ node ].tick;
+            slot.head = nodes_[ node ].next;
+            if ( slot.head == NIL ) {
+                slot.tail = NIL;
+                occupied_[ 0 ][ index / 64 ] &= ~(uint64_t( 1 ) << (index % 64));
+            }
+
+            packet = move( nodes_[ node ].packet );
+            nodes_[ node ].next = free_list_;
+            free_list_ = node;
+            size_--;
+
+            return true;
+        }
+
+        if ( slot_start( level, index ) > now_tick ) {
+            break;
+        }
+
+        cascade( level, index );
+    }
+
+    /* nothing is due before the next slot, so the wheel can skip ahead */
+    current_tick_ = now_tick;
+
+    return false;
+}
+
+uint64_t TimingWheel::next_release_bound( void ) const
+{
+    unsigned int level, index;
+
+    if ( not next_slot( level, index ) ) {
+        throw runtime_error( "TimingWheel: no packets" );
+    }
+
+    if ( level == 0 ) {
+        return nodes_[ slots_[ 0 ][ index ].head ].tick * TICK_NS;
+    }
+
+    return slot_start( level, index ) * TICK_NS;
+}
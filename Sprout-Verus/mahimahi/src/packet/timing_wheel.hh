@@ -0,0 +1,85 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TIMING_WHEEL_HH
+#define TIMING_WHEEL_HH
+
+#include <vector>
+#include <cstdint>
+
+#include "packet_buffer.hh"
+
+/* A hierarchical timing wheel holding packets until their release
+   times, which may arrive in any order. Time is divided into ticks of
+   TICK_NS; a packet is filed on the lowest level whose slot tells its
+   tick apart from the wheel's current tick, and is cascaded down a
+   level when the wheel reaches that slot. Insertion and release are
+   O(1), and packets due in the same tick come out in the order they
+   went in.
+
+   Packets live in a pool of list nodes that is recycled through a
+   free list, so a wheel holding hundreds of thousands of packets
+   doesn't allocate once it has warmed up. */
+
+class TimingWheel
+{
+public:
+    const static uint64_t TICK_NS = 1024;
+
+private:
+    const static unsigned int BITS_PER_LEVEL = 8;
+    const static unsigned int SLOTS_PER_LEVEL = 1 << BITS_PER_LEVEL;
+    const static unsigned int LEVELS = 5; /* horizon of 2^40 ticks (about 13 days) */
+    const static unsigned int WORDS_PER_LEVEL = SLOTS_PER_LEVEL / 64;
+    const static uint32_t NIL = UINT32_MAX;
+
+    struct Node
+    {
+        uint64_t tick;
+        uint32_t next;
+        PacketBuffer packet;
+    };
+
+    struct Slot
+    {
+        uint32_t head, tail;
+    };
+
+    std::vector<Node> nodes_;
+    uint32_t free_list_;
+
+    Slot slots_[ LEVELS ][ SLOTS_PER_LEVEL ];
+    uint64_t occupied_[ LEVELS ][ WORDS_PER_LEVEL ]; /* bitmap of nonempty slots */
+
+    uint64_t current_tick_;
+    size_t size_;
+
+    void file( const uint32_t node );
+
+    /* find the first nonempty slot, searching up from the current tick;
+       returns false if the wheel is empty */
+    bool next_slot( unsigned int & level, unsigned int & index ) const;
+
+    /* first tick covered by a slot on a level above 0 */
+    uint64_t slot_start( const unsigned int level, const unsigned int index ) const;
+
+    void cascade( const unsigned int level, const unsigned int index );
+
+public:
+    TimingWheel( const uint64_t now_ns );
+
+    /* hold a packet until the given time (or, if that has passed, the next tick) */
+    void insert( const uint64_t release_ns, PacketBuffer && packet );
+
+    /* take out the next packet due by the given time; returns false if there is none
+       (time must not go backwards between calls) */
+    bool pop_due( const uint64_t now_ns, PacketBuffer & packet );
+
+    /* lower bound on when the next packet is due (exact once the packet
+       has cascaded to the lowest level); only meaningful if the wheel isn't empty */
+    uint64_t next_release_bound( void ) const;
+
+    size_t size( void ) const { return size_; }
+    bool empty( void ) const { return size_ == 0; }
+};
+
+#endif /* TIMING_WHEEL_HH */
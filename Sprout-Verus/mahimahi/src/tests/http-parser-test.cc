@@ -0,0 +1,157 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <random>
+#include <iostream>
+#include <vector>
+
+#include "http_request_parser.hh"
+#include "http_response_parser.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Feeds pipelined requests and responses to the parsers in random
+   pieces (down to a byte at a time, splitting CRLFs, chunk sizes and
+   trailers) and checks that each piece-wise parse gives the same
+   messages as parsing everything at once: the streaming chunked-body
+   parser and HTTPMessageSequence must not depend on where reads end. */
+
+static const unsigned int TRIALS = 2000;
+
+/* each message as it goes on the wire, which is also how the parsers
+   give it back */
+static const vector<string> requests = {
+    "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "POST /b HTTP/1.1\r\nHost: example.com\r\nContent-Length: 11\r\n\r\nhello=world",
+    "HEAD /c HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "POST /d HTTP/1.1\r\nHost: example.com\r\nContent-Length: 8\r\n\r\nab\r\n\r\ncd",
+    "GET /e HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "GET /f HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "GET /g HTTP/1.1\r\nHost: example.com\r\n\r\n",
+};
+
+static const vector<string> responses = {
+    "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n0123456789",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "5;ext=1\r\nhello\r\na \r\n0123456789\r\n10\r\n0123456789abcdef\r\n4\r\nab\r\n\r\n0\r\n\r\n",
+    /* the response to a HEAD has no body, whatever its headers say */
+    "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n",
+    "HTTP/1.1 204 No Content\r\nX: y\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\nTrailer: X-T\r\n\r\n"
+    "3\r\nabc\r\n0\r\nX-T: 1\r\nX-U: 2\r\n\r\n",
+    "HTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n",
+    /* no length: the body runs to the end of the connection */
+    "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nuntil eof...\r\n\r\n0\r\n",
+};
+
+static string concatenate( const vector<string> & messages )
+{
+    string ret;
+    for ( const auto & message : messages ) {
+        ret += message;
+    }
+    return ret;
+}
+
+/* cut wire into pieces of 1 to max_piece bytes */
+static vector<string> split( const string & wire, const size_t max_piece, default_random_engine & prng )
+{
+    uniform_int_distribution<size_t> piece_size( 1, max_piece );
+
+    vector<string> ret;
+    for ( size_t offset = 0; offset < wire.size(); ) {
+        const size_t length = min( piece_size( prng ), wire.size() - offset );
+        ret.push_back( wire.substr( offset, length ) );
+        offset += length;
+    }
+
+    return ret;
+}
+
+template <class Parser>
+static vector<string> drain( Parser & parser )
+{
+    vector<string> ret;
+    while ( not parser.empty() ) {
+        ret.push_back( parser.front().str() );
+        parser.pop();
+    }
+    return ret;
+}
+
+static vector<string> parse_requests( const vector<string> & pieces )
+{
+    HTTPRequestParser parser;
+    for ( const auto & piece : pieces ) {
+        parser.parse( piece );
+    }
+    return drain( parser );
+}
+
+static vector<string> parse_responses( const vector<string> & pieces )
+{
+    HTTPRequestParser request_parser;
+    request_parser.parse( concatenate( requests ) );
+
+    HTTPResponseParser parser;
+    while ( not request_parser.empty() ) {
+        parser.new_request_arrived( request_parser.front() );
+        request_parser.pop();
+    }
+
+    for ( const auto & piece : pieces ) {
+        parser.parse( piece );
+    }
+    parser.parse( "" ); /* EOF */
+
+    return drain( parser );
+}
+
+static bool check( const string & what, const vector<string> & expected, const vector<string> & got,
+                   const vector<string> & pieces )
+{
+    if ( got == expected ) {
+        return true;
+    }
+
+    cerr << what << ": parsed " << got.size() << " messages (expected " << expected.size() << ")"
+         << " from these pieces:" << endl;
+    for ( const auto & piece : pieces ) {
+        cerr << "[" << piece << "]" << endl;
+    }
+    return false;
+}
+
+int main( void )
+{
+    try {
+        const string request_wire = concatenate( requests ), response_wire = concatenate( responses );
+        default_random_engine prng( 1 );
+        uniform_int_distribution<size_t> max_piece( 1, 40 );
+
+        bool passed = check( "requests", requests, parse_requests( { request_wire } ), { request_wire } )
+            and check( "responses", responses, parse_responses( { response_wire } ), { response_wire } );
+
+        for ( unsigned int trial = 0; passed and trial < TRIALS; trial++ ) {
+            const size_t largest = trial == 0 ? 1 : max_piece( prng );
+
+            const vector<string> request_pieces = split( request_wire, largest, prng );
+            const vector<string> response_pieces = split( response_wire, largest, prng );
+
+            passed = check( "requests", requests, parse_requests( request_pieces ), request_pieces )
+                and check( "responses", responses, parse_responses( response_pieces ), response_pieces );
+        }
+
+        if ( not passed ) {
+            cerr << "http-parser-test FAILED" << endl;
+            return EXIT_FAILURE;
+        }
+
+        cout << "http-parser-test PASSED (" << TRIALS << " splittings)" << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "simulated_path.hh"
+#include "link_queue.hh"
+#include "link_log.hh"
+#include "infinite_packet_queue.hh"
+#include "timestamp.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Runs a LinkQueue in real time, as mm-link does, logging in the
+   binary format. Then replays the arrivals of that log through the
+   same link in a SimulatedPath, as mm-simulate does, and checks that
+   the simulated link's log has the same events: the same deliveries
+   of the same packets at the same times. */
+
+static const uint64_t RUN_LENGTH = 300 * NS_PER_MS;
+
+static unique_ptr<AbstractPacketQueue> infinite_queue( void )
+{
+    return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( "" ) );
+}
+
+static vector<LinkLogEvent> read_log( const string & filename, uint64_t & base_timestamp )
+{
+    BinaryLinkLogReader log( filename );
+    base_timestamp = link_log_base_timestamp( log.comments().data(),
+                                              log.comments().data() + log.comments().size() ) * NS_PER_MS;
+
+    vector<LinkLogEvent> ret;
+    LinkLogEvent event;
+    while ( log.next( event ) ) {
+        ret.push_back( event );
+    }
+
+    return ret;
+}
+
+static string describe( const LinkLogEvent & event )
+{
+    return to_string( event.time ) + " " + event.type + " " + to_string( event.bytes )
+        + ( event.type == '-' ? " " + to_string( event.delay ) : "" );
+}
+
+/* the packets' arrival times as they happen, to mm-link's schedule */
+static void run_real_link( const string & trace, const string & logfile )
+{
+    LinkQueue link( "real", trace, logfile, true, true, false, false, "", "", infinite_queue(), "real" );
+
+    default_random_engine prng( 1 );
+    uniform_int_distribution<unsigned int> gap_us( 0, 2000 ), size( 40, 1500 );
+
+    const uint64_t start = timestamp_ns();
+    while ( timestamp_ns() - start < RUN_LENGTH ) {
+        this_thread::sleep_for( chrono::microseconds( gap_us( prng ) ) );
+
+        /* a burst now and then, to build a queue */
+        const unsigned int burst = gap_us( prng ) < 100 ? 20 : 1;
+        for ( unsigned int i = 0; i < burst; i++ ) {
+            PacketBuffer packet = PacketBuffer::allocate();
+            packet.resize( size( prng ) );
+            link.read_packet( move( packet ) );
+        }
+
+        PacketBuffer packet;
+        while ( link.pop_output( packet ) ) {}
+    }
+}
+
+/* replay the real link's arrivals, until its last event */
+static void run_simulated_link( const string & trace, const vector<LinkLogEvent> & real_events,
+                                const uint64_t base_timestamp, const string & logfile )
+{
+    SimulatedPath path( base_timestamp, [] ( const uint64_t, PacketBuffer && ) {} );
+    path.add_queue<LinkQueue>( "simulated", trace, logfile, true, true, false, false, "", "",
+                               infinite_queue(), "simulated" );
+
+    for ( const auto & event : real_events ) {
+        if ( event.type == '+' ) {
+            PacketBuffer packet = PacketBuffer::allocate();
+            packet.resize( event.bytes );
+            path.send( event.time, move( packet ) );
+        }
+    }
+
+    path.advance( real_events.back().time );
+}
+
+/* paths on one thread share its clock, and put it back when they go */
+static bool check_nested_paths( void )
+{
+    const uint64_t before = timestamp_ns();
+
+    {
+        SimulatedPath outer( 1000, [] ( const uint64_t, PacketBuffer && ) {} );
+        {
+            SimulatedPath inner( 5000, [] ( const uint64_t, PacketBuffer && ) {} );
+            if ( timestamp_ns() != 5000 ) {
+                return false;
+            }
+        }
+        if ( timestamp_ns() != 1000 ) {
+            return false;
+        }
+    }
+
+    /* the real clock again */
+    return timestamp_ns() >= before and timestamp_ns() < before + 1000 * NS_PER_MS;
+}
+
+int main( void )
+{
+    try {
+        /* a test, not a setuid shell */
+        allow_root();
+
+        char directory_template[] = "/tmp/simulated-path-test.XXXXXX";
+        if ( not mkdtemp( directory_template ) ) {
+            throw unix_error( "mkdtemp" );
+        }
+        const string directory = directory_template;
+        const string trace = directory + "/trace", real_log = directory + "/real.log",
+            simulated_log = directory + "/simulated.log";
+
+        /* runs of different sizes at fractional times, repeating every 12 ms */
+        {
+            ofstream trace_file( trace );
+            trace_file << "1\n2 3\n2.5\n4\n7.25 2\n9\n12 4\n";
+        }
+
+        run_real_link( trace, real_log );
+
+        uint64_t base_timestamp;
+        const vector<LinkLogEvent> real_events = read_log( real_log, base_timestamp );
+
+        run_simulated_link( trace, real_events, base_timestamp, simulated_log );
+
+        uint64_t simulated_base_timestamp;
+        const vector<LinkLogEvent> simulated_events = read_log( simulated_log, simulated_base_timestamp );
+
+        bool passed = simulated_base_timestamp == base_timestamp;
+        unsigned int departures = 0;
+
+        for ( size_t i = 0; passed and i < max( real_events.size(), simulated_events.size() ); i++ ) {
+            if ( i >= real_events.size() or i >= simulated_events.size() ) {
+                cerr << "logs differ in length: " << real_events.size() << " real events, "
+                     << simulated_events.size() << " simulated" << endl;
+                passed = false;
+                break;
+            }
+
+            const LinkLogEvent & real = real_events[ i ], & simulated = simulated_events[ i ];
+            if ( describe( real ) != describe( simulated ) ) {
+                cerr << "event " << i << " differs: real \"" << describe( real )
+                     << "\", simulated \"" << describe( simulated ) << "\"" << endl;
+                passed = false;
+            }
+
+            departures += real.type == '-';
+        }
+
+        if ( passed and departures == 0 ) {
+            cerr << "the real link delivered nothing" << endl;
+            passed = false;
+        }
+
+        if ( passed and not check_nested_paths() ) {
+            cerr << "nested paths did not restore the clock" << endl;
+            passed = false;
+        }
+
+        for ( const auto & filename : { trace, real_log, simulated_log } ) {
+            unlink( filename.c_str() );
+        }
+        rmdir( directory.c_str() );
+
+        if ( not passed ) {
+            cerr << "simulated-path-test FAILED" << endl;
+            return EXIT_FAILURE;
+        }
+
+        cout << "simulated-path-test PASSED (" << real_events.size() << " events, "
+             << departures << " departures)" << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
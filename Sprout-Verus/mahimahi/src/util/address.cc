@@ -155,7 +155,7 @@ bool Address::operator<( const Address & other ) const
 }
 
 /* generate carrier-grade NAT address */
-Address Address::cgnat( const uint8_t last_octet )
+Address Address::cgnat( const uint16_t host )
 {
-    return Address( "100.64.0." + to_string( last_octet ), 0 );
+    return Address( "100.64." + to_string( host >> 8 ) + "." + to_string( host & 0xff ), 0 );
 }
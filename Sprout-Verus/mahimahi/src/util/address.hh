@@ -51,8 +51,8 @@ public:
     bool operator==( const Address & other ) const;
     bool operator<( const Address & other ) const;
 
-    /* generate carrier-grade NAT address */
-    static Address cgnat( const uint8_t last_octet );
+    /* generate carrier-grade NAT address (100.64.0.0 + host) */
+    static Address cgnat( const uint16_t host );
 };
 
 #endif /* ADDRESS_HH */
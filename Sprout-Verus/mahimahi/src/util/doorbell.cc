@@ -0,0 +1,40 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/eventfd.h>
+
+#include "doorbell.hh"
+#include "exception.hh"
+
+using namespace std;
+
+Doorbell::Doorbell()
+    : eventfd_( SystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) ),
+      waiting_( false )
+{}
+
+void Doorbell::wait_until( const function<bool( void )> & ready )
+{
+    while ( true ) {
+        /* announce the wait before the last check, so a ring that
+           makes ready() true can't fall between the two */
+        waiting_.store( true, memory_order_relaxed );
+        atomic_thread_fence( memory_order_seq_cst );
+
+        if ( ready() ) {
+            break;
+        }
+
+        /* sleep until rung (a ring left over from an earlier wait just
+           means another check) */
+        uint64_t count;
+        eventfd_.read( reinterpret_cast<char *>( &count ), sizeof( count ) );
+    }
+
+    waiting_.store( false, memory_order_relaxed );
+}
+
+void Doorbell::ring( void )
+{
+    const uint64_t one = 1;
+    eventfd_.write( reinterpret_cast<const char *>( &one ), sizeof( one ) );
+}
@@ -0,0 +1,49 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DOORBELL_HH
+#define DOORBELL_HH
+
+#include <atomic>
+#include <functional>
+
+#include "file_descriptor.hh"
+
+/* Lets one thread sleep (on an eventfd) until another has something
+   for it, e.g. the consumer of an SPSCRing until the ring has data.
+   The other thread rings only while the sleeper is waiting, so a
+   producer that keeps the consumer busy makes no system calls. */
+
+class Doorbell
+{
+private:
+    FileDescriptor eventfd_;
+    std::atomic<bool> waiting_;
+
+public:
+    Doorbell();
+
+    /* sleeper: return once ready() (re-checked after each wakeup; it
+       may be checked while the other thread is changing what it reads) */
+    void wait_until( const std::function<bool( void )> & ready );
+
+    /* other thread: wake the sleeper if it is waiting (once per wait).
+       Call after making ready() true; the fence makes sure the sleeper
+       either sees that or is woken. */
+    void ring_if_waiting( void )
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( waiting_.load( std::memory_order_relaxed )
+             and waiting_.exchange( false, std::memory_order_relaxed ) ) {
+            ring();
+        }
+    }
+
+    /* wake the sleeper (or its next wait) regardless */
+    void ring( void );
+
+    /* forbid copying or assigning */
+    Doorbell( const Doorbell & other ) = delete;
+    Doorbell & operator=( const Doorbell & other ) = delete;
+};
+
+#endif /* DOORBELL_HH */
@@ -0,0 +1,48 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "epoll.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* maximum number of ready fds to collect per wait */
+static const int MAX_EPOLL_EVENTS = 256;
+
+Epoll::Epoll()
+    : FileDescriptor( SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ),
+      ready_()
+{}
+
+void Epoll::add( const int fd, const uint32_t events, const uint64_t id )
+{
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = id;
+    SystemCall( "epoll_ctl ADD", epoll_ctl( fd_num(), EPOLL_CTL_ADD, fd, &event ) );
+}
+
+void Epoll::modify( const int fd, const uint32_t events, const uint64_t id )
+{
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = id;
+    SystemCall( "epoll_ctl MOD", epoll_ctl( fd_num(), EPOLL_CTL_MOD, fd, &event ) );
+}
+
+void Epoll::remove( const int fd )
+{
+    SystemCall( "epoll_ctl DEL", epoll_ctl( fd_num(), EPOLL_CTL_DEL, fd, nullptr ) );
+}
+
+const vector<epoll_event> & Epoll::wait( const int timeout_ms )
+{
+    ready_.resize( MAX_EPOLL_EVENTS );
+
+    const int ready_count = SystemCall( "epoll_wait", epoll_wait( fd_num(), ready_.data(),
+                                                                  MAX_EPOLL_EVENTS, timeout_ms ) );
+    ready_.resize( ready_count );
+
+    register_read();
+
+    return ready_;
+}
@@ -0,0 +1,35 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef EPOLL_HH
+#define EPOLL_HH
+
+#include <vector>
+#include <cstdint>
+
+#include <sys/epoll.h>
+
+#include "file_descriptor.hh"
+
+/* wrapper class for an epoll instance, for watching a changing set of
+   many fds. The instance is itself readable when any of them is ready,
+   so it can be polled like any other file descriptor (e.g. by an
+   EventLoop) and then asked which fds are ready. */
+
+class Epoll : public FileDescriptor
+{
+private:
+    std::vector<epoll_event> ready_;
+
+public:
+    Epoll();
+
+    /* watch fd for the given events (EPOLLIN, EPOLLOUT), tagged with id */
+    void add( const int fd, const uint32_t events, const uint64_t id );
+    void modify( const int fd, const uint32_t events, const uint64_t id );
+    void remove( const int fd );
+
+    /* the fds that are ready, waiting at most timeout_ms (-1: forever) */
+    const std::vector<epoll_event> & wait( const int timeout_ms );
+};
+
+#endif /* EPOLL_HH */
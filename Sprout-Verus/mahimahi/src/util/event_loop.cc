@@ -3,6 +3,7 @@
 #include <algorithm>
 
 #include "event_loop.hh"
+#include "timerfd.hh"
 #include "exception.hh"
 
 using namespace std;
@@ -80,7 +81,7 @@ Result EventLoop::handle_signal( const signalfd_siginfo & sig )
     return ResultType::Continue;
 }
 
-int EventLoop::internal_loop( const std::function<int(void)> & wait_time )
+int EventLoop::internal_loop( const std::function<uint64_t(void)> & wait_time )
 {
     TemporarilyUnprivileged tu;
 
@@ -97,8 +98,33 @@ int EventLoop::internal_loop( const std::function<int(void)> & wait_time )
     add_simple_input_handler( signal_fd.fd(),
                               [&] () { return handle_signal( signal_fd.read_signal() ); } );
 
+    /* poll's timeout is in ms, so timeouts go through a timerfd instead */
+    TimerFD timer;
+    bool timer_armed = false;
+
+    add_simple_input_handler( timer.fd(),
+                              [&] () {
+                                  if ( timer.read_expirations() ) {
+                                      timer_armed = false;
+                                  }
+                                  return ResultType::Continue;
+                              } );
+
     while ( true ) {
-        const auto poll_result = poller_.poll( wait_time() );
+        const uint64_t wait_ns = wait_time();
+        int timeout_ms = -1;
+
+        if ( wait_ns == 0 ) {
+            timeout_ms = 0;
+        } else if ( wait_ns != NO_TIMEOUT ) {
+            timer.arm( wait_ns );
+            timer_armed = true;
+        } else if ( timer_armed ) {
+            timer.arm( 0 ); /* disarm */
+            timer_armed = false;
+        }
+
+        const auto poll_result = poller_.poll( timeout_ms );
         if ( poll_result.result == Poller::Result::Type::Exit ) {
             return poll_result.exit_status;
         }
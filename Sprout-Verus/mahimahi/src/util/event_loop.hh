@@ -5,6 +5,8 @@
 
 #include <vector>
 #include <functional>
+#include <limits>
+#include <cstdint>
 
 #include "poller.hh"
 #include "file_descriptor.hh"
@@ -23,9 +25,13 @@ private:
 protected:
     void add_action( Poller::Action action ) { poller_.add_action( action ); }
 
-    int internal_loop( const std::function<int(void)> & wait_time );
+    /* wait_time returns the ns until something needs doing even if
+       no fd is ready, or NO_TIMEOUT */
+    int internal_loop( const std::function<uint64_t(void)> & wait_time );
 
 public:
+    static const uint64_t NO_TIMEOUT = std::numeric_limits<uint64_t>::max();
+
     EventLoop();
 
     void add_simple_input_handler( FileDescriptor & fd, const Poller::Action::CallbackType & callback );
@@ -45,7 +51,7 @@ public:
         child_processes_.emplace_back( continue_status, ChildProcess( std::forward<Targs>( Fargs )... ) );
     }
 
-    int loop( void ) { return internal_loop( [] () { return -1; } ); } /* no timeout */
+    int loop( void ) { return internal_loop( [] () { return NO_TIMEOUT; } ); }
 
     virtual ~EventLoop() {}
 };
@@ -82,6 +82,90 @@ string FileDescriptor::read( const size_t limit )
     return string( buffer, bytes_read );
 }
 
+/* read into caller's buffer */
+size_t FileDescriptor::read( char * const buffer, const size_t capacity )
+{
+    const ssize_t bytes_read = SystemCall( "read", ::read( fd_, buffer, capacity ) );
+    if ( bytes_read == 0 ) {
+        set_eof();
+    }
+
+    register_read();
+
+    return bytes_read;
+}
+
+/* non-blocking read into caller's buffer */
+bool FileDescriptor::read_nonblocking( char * const buffer, const size_t capacity, size_t & bytes_read )
+{
+    const ssize_t ret = ::read( fd_, buffer, capacity );
+
+    /* count the attempt even if it would block, so a spurious
+       wakeup is not mistaken for a busy wait */
+    register_read();
+
+    if ( ret < 0 ) {
+        if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+            return false;
+        }
+        throw unix_error( "read" );
+    }
+
+    if ( ret == 0 ) {
+        set_eof();
+    }
+
+    bytes_read = ret;
+    return true;
+}
+
+/* non-blocking write of as much of caller's buffer as fits */
+bool FileDescriptor::write_nonblocking( const char * const buffer, const size_t size, size_t & bytes_written )
+{
+    const ssize_t ret = ::write( fd_, buffer, size );
+
+    register_write();
+
+    if ( ret < 0 ) {
+        if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+            return false;
+        }
+        throw unix_error( "write" );
+    }
+
+    bytes_written = ret;
+    return true;
+}
+
+/* write all of caller's buffer */
+void FileDescriptor::write( const char * const buffer, const size_t size )
+{
+    size_t bytes_written = 0;
+
+    do {
+        const ssize_t ret = SystemCall( "write", ::write( fd_, buffer + bytes_written, size - bytes_written ) );
+        if ( ret == 0 ) {
+            throw runtime_error( "write returned 0" );
+        }
+
+        register_write();
+
+        bytes_written += ret;
+    } while ( bytes_written < size );
+}
+
+void FileDescriptor::set_blocking( const bool block )
+{
+    int flags = SystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
+    if ( block ) {
+        flags = flags & ~O_NONBLOCK;
+    } else {
+        flags = flags | O_NONBLOCK;
+    }
+
+    SystemCall( "fcntl F_SETFL", fcntl( fd_, F_SETFL, flags ) );
+}
+
 /* write method */
 string::const_iterator FileDescriptor::write( const std::string & buffer, const bool write_all )
 {
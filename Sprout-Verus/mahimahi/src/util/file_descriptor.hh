@@ -38,12 +38,23 @@ public:
     unsigned int read_count( void ) const { return read_count_; }
     unsigned int write_count( void ) const { return write_count_; }
 
+    /* set or clear O_NONBLOCK */
+    void set_blocking( const bool block );
+
     /* read and write methods */
     std::string read( const size_t limit = BUFFER_SIZE );
     std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
     std::string::const_iterator write( const std::string::const_iterator & begin,
                                        const std::string::const_iterator & end );
 
+    /* read into and write from caller-owned memory, without copying */
+    size_t read( char * const buffer, const size_t capacity );
+    void write( const char * const buffer, const size_t size );
+
+    /* for non-blocking fds: return false instead of blocking */
+    bool read_nonblocking( char * const buffer, const size_t capacity, size_t & bytes_read );
+    bool write_nonblocking( const char * const buffer, const size_t size, size_t & bytes_written );
+
     /* forbid copying FileDescriptor objects or assigning them */
     FileDescriptor( const FileDescriptor & other ) = delete;
     const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
@@ -111,28 +111,56 @@ bool Interfaces::address_in_use( const Address & addr ) const
     return false;
 }
 
-pair< Address, uint16_t > Interfaces::first_unassigned_address( uint16_t last_octet ) const
+pair< Address, uint16_t > Interfaces::first_unassigned_address( const uint16_t host ) const
 {
-    while ( last_octet <= 255 ) {
-        Address candidate = Address::cgnat( last_octet );
+    /* 100.64.0.1 and up (enough for many shells at once), skipping
+       the .0 address of each /24 */
+    for ( uint32_t candidate_host = host; candidate_host <= 0xffff; candidate_host++ ) {
+        if ( (candidate_host & 0xff) == 0 ) {
+            continue;
+        }
+
+        Address candidate = Address::cgnat( candidate_host );
         if ( !address_in_use( candidate ) ) {
             assert( candidate.port() == 0 );
-            return make_pair( candidate, last_octet );
+            return make_pair( candidate, candidate_host );
         }
-        last_octet++;
     }
 
     throw runtime_error( "Interfaces: could not find free interface address" );
 }
 
 std::pair< Address, Address > two_unassigned_addresses( const Address & avoid )
+{
+    return unassigned_address_pairs( 1, avoid ).front();
+}
+
+vector< pair< Address, Address > > unassigned_address_pairs( const unsigned int count, const Address & avoid )
 {
     Interfaces interfaces;
 
     interfaces.add_address( avoid );
 
-    auto one = interfaces.first_unassigned_address( 1 );
-    auto two = interfaces.first_unassigned_address( one.second + 1 );
+    /* one scan for all of them, so a later pair can't reuse an earlier
+       pair's ingress address (which is not ours to see once it has
+       moved to another namespace) */
+    vector< pair< Address, Address > > ret;
+    uint32_t next_host = 1;
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        if ( next_host > 0xffff ) {
+            throw runtime_error( "Interfaces: could not find free interface address" );
+        }
+        auto one = interfaces.first_unassigned_address( next_host );
+
+        if ( uint32_t( one.second ) + 1 > 0xffff ) {
+            throw runtime_error( "Interfaces: could not find free interface address" );
+        }
+        auto two = interfaces.first_unassigned_address( one.second + 1 );
+
+        ret.emplace_back( one.first, two.first );
+        next_host = uint32_t( two.second ) + 1;
+    }
 
-    return make_pair( one.first, two.first );
+    return ret;
 }
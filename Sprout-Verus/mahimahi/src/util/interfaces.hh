@@ -19,10 +19,14 @@ public:
     bool address_in_use( const Address & addr ) const;
     void add_address( const Address & addr );
 
-    /* find first unassigned address */
-    std::pair< Address, uint16_t > first_unassigned_address( const uint16_t last_octet ) const;
+    /* find first unassigned address, starting from Address::cgnat( host ) */
+    std::pair< Address, uint16_t > first_unassigned_address( const uint16_t host ) const;
 };
 
 std::pair< Address, Address > two_unassigned_addresses( const Address & avoid = Address() );
 
+/* as many (egress, ingress) pairs as asked for, none sharing an address */
+std::vector< std::pair< Address, Address > > unassigned_address_pairs( const unsigned int count,
+                                                                       const Address & avoid = Address() );
+
 #endif /* GET_ADDRESS_HH */
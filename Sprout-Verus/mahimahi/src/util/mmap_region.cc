@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "mmap_region.hh"
+#include "file_descriptor.hh"
+#include "exception.hh"
+
+using namespace std;
+
+MMapRegion::MMapRegion( const string & filename )
+    : addr_( nullptr ),
+      length_( 0 )
+{
+    FileDescriptor fd( SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) );
+
+    struct stat file_info;
+    SystemCall( "fstat " + filename, fstat( fd.fd_num(), &file_info ) );
+
+    length_ = file_info.st_size;
+
+    if ( length_ == 0 ) { /* mmap refuses zero-length mappings */
+        return;
+    }
+
+    void * const addr = mmap( nullptr, length_, PROT_READ, MAP_SHARED, fd.fd_num(), 0 );
+    if ( addr == MAP_FAILED ) {
+        throw unix_error( "mmap " + filename );
+    }
+
+    /* the mapping stays valid after the file descriptor is closed */
+    addr_ = static_cast<char *>( addr );
+}
+
+MMapRegion::~MMapRegion()
+{
+    if ( not addr_ ) {
+        return;
+    }
+
+    try {
+        SystemCall( "munmap", munmap( addr_, length_ ) );
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
+
+void MMapRegion::advise( const int advice ) const
+{
+    if ( addr_ ) {
+        SystemCall( "madvise", madvise( addr_, length_, advice ) );
+    }
+}
@@ -0,0 +1,31 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef MMAP_REGION_HH
+#define MMAP_REGION_HH
+
+#include <string>
+#include <cstddef>
+
+/* read-only, shared mapping of an entire file */
+class MMapRegion
+{
+private:
+    char * addr_;
+    size_t length_;
+
+public:
+    MMapRegion( const std::string & filename );
+    ~MMapRegion();
+
+    const char * data( void ) const { return addr_; }
+    size_t size( void ) const { return length_; }
+
+    /* hint the kernel about the expected access pattern (e.g. MADV_SEQUENTIAL) */
+    void advise( const int advice ) const;
+
+    /* forbid copying or assigning */
+    MMapRegion( const MMapRegion & other ) = delete;
+    MMapRegion & operator=( const MMapRegion & other ) = delete;
+};
+
+#endif /* MMAP_REGION_HH */
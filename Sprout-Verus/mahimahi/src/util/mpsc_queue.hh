@@ -0,0 +1,71 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef MPSC_QUEUE_HH
+#define MPSC_QUEUE_HH
+
+#include <atomic>
+#include <utility>
+
+/* Lock-free queue for many producer threads and one consumer thread
+   (after Vyukov's intrusive MPSC queue). push() is one atomic exchange
+   and never waits for other producers. pop() can briefly see the queue
+   as empty while a push is halfway done, so producers should wake the
+   consumer only after push() returns. */
+
+template <typename T>
+class MPSCQueue
+{
+private:
+    struct Node
+    {
+        std::atomic<Node *> next;
+        T value;
+
+        Node( T && s_value ) : next( nullptr ), value( std::move( s_value ) ) {}
+    };
+
+    std::atomic<Node *> head_; /* most recently pushed (producers) */
+    Node * tail_;              /* already consumed; its next is the oldest (consumer) */
+
+public:
+    MPSCQueue( void )
+        : head_( new Node( T() ) ),
+          tail_( head_.load() )
+    {}
+
+    ~MPSCQueue()
+    {
+        while ( tail_ ) {
+            Node * const next = tail_->next.load();
+            delete tail_;
+            tail_ = next;
+        }
+    }
+
+    void push( T && value )
+    {
+        Node * const node = new Node( std::move( value ) );
+        Node * const previous = head_.exchange( node, std::memory_order_acq_rel );
+        previous->next.store( node, std::memory_order_release );
+    }
+
+    /* consumer only */
+    bool pop( T & value )
+    {
+        Node * const next = tail_->next.load( std::memory_order_acquire );
+        if ( not next ) {
+            return false;
+        }
+
+        value = std::move( next->value );
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+    /* forbid copying or assigning */
+    MPSCQueue( const MPSCQueue & other ) = delete;
+    MPSCQueue & operator=( const MPSCQueue & other ) = delete;
+};
+
+#endif /* MPSC_QUEUE_HH */
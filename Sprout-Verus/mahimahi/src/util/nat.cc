@@ -33,9 +33,27 @@ NATRule::~NATRule()
     }
 }
 
+static unique_ptr< NATRule > mark_rule( const Address & ingress_addr )
+{
+    return unique_ptr< NATRule >( new NATRule( { "PREROUTING", "-s", ingress_addr.ip(), "-j", "CONNMARK",
+                                                 "--set-mark", to_string( getpid() ) } ) );
+}
+
+static vector< unique_ptr< NATRule > > mark_rules( const vector< Address > & ingress_addrs )
+{
+    vector< unique_ptr< NATRule > > ret;
+    for ( const auto & addr : ingress_addrs ) {
+        ret.emplace_back( mark_rule( addr ) );
+    }
+    return ret;
+}
+
 NAT::NAT( const Address & ingress_addr )
-: pre_( { "PREROUTING", "-s", ingress_addr.ip(), "-j", "CONNMARK",
-            "--set-mark", to_string( getpid() ) } ),
+    : NAT( vector< Address >( 1, ingress_addr ) )
+{}
+
+NAT::NAT( const vector< Address > & ingress_addrs )
+: pre_( mark_rules( ingress_addrs ) ),
   post_( { "POSTROUTING", "-j", "MASQUERADE", "-m", "connmark",
               "--mark", to_string( getpid() ) } )
 {}
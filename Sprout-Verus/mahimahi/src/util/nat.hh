@@ -6,6 +6,8 @@
 /* Network Address Translator */
 
 #include <string>
+#include <vector>
+#include <memory>
 
 #include "system_runner.hh"
 #include "address.hh"
@@ -31,10 +33,14 @@ public:
 class NAT
 {
 private:
-    NATRule pre_, post_;
+    std::vector< std::unique_ptr< NATRule > > pre_;
+    NATRule post_;
 
 public:
     NAT( const Address & ingress_addr );
+
+    /* one mark, and one rule to masquerade it, for many ingress addresses */
+    NAT( const std::vector< Address > & ingress_addrs );
 };
 
 class DNAT
@@ -33,6 +33,11 @@ void interface_ioctl( FileDescriptor & fd, const unsigned long request,
                       const string & name,
                       function<void( ifreq &ifr )> ifr_adjustment)
 {
+    /* strncpy would quietly cut it short (or leave it unterminated) */
+    if ( name.size() >= IFNAMSIZ ) {
+        throw runtime_error( "interface name too long: " + name );
+    }
+
     ifreq ifr;
     zero( ifr );
     strncpy( ifr.ifr_name, name.c_str(), IFNAMSIZ ); /* interface name */
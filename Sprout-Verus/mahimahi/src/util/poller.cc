@@ -1,17 +1,49 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <algorithm>
-#include <numeric>
+#include <cerrno>
+#include <sys/epoll.h>
+
 #include "poller.hh"
 #include "exception.hh"
+#include "config.h"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* maximum number of ready fds to collect per epoll_wait */
+static const int MAX_EPOLL_EVENTS = 64;
+
 void Poller::add_action( Poller::Action action )
 {
     actions_.push_back( action );
     pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+
+    /* group actions by fd */
+    auto interest = find_if( interests_.begin(), interests_.end(),
+                             [&] ( const Interest & x ) { return x.fd == action.fd.fd_num(); } );
+    if ( interest == interests_.end() ) {
+        interests_.push_back( { action.fd.fd_num(), {}, false, false, 0, false, 0, false } );
+        interest = interests_.end() - 1;
+    }
+
+    const size_t interest_index = interest - interests_.begin();
+    interest->action_indices.push_back( actions_.size() - 1 );
+    action_interest_.push_back( interest_index );
+
+    if ( action.when_interested and not interest->dynamic ) {
+        interest->dynamic = true;
+        dynamic_interests_.push_back( interest_index );
+    }
+
+    mark_stale( interest_index );
+
+    /* register the fd even if the events wanted are unchanged: the
+       number may belong to a new file, if the last one was closed */
+    if ( not interest->changed ) {
+        interest->changed = true;
+        changed_interests_.push_back( interest_index );
+    }
 }
 
 unsigned int Poller::Action::service_count( void ) const
@@ -19,29 +51,118 @@ unsigned int Poller::Action::service_count( void ) const
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
-Poller::Result Poller::poll( const int & timeout_ms )
+bool Poller::Action::interested( void ) const
 {
-    assert( pollfds_.size() == actions_.size() );
-
-    /* tell poll whether we care about each fd */
-    for ( unsigned int i = 0; i < actions_.size(); i++ ) {
-        assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-        pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-            ? actions_.at( i ).direction : 0;
-
-        /* don't poll in on fds that have had EOF */
-        if ( actions_.at( i ).direction == Direction::In
-             and actions_.at( i ).fd.eof() ) {
-            pollfds_.at( i ).events = 0;
+    /* don't poll in on fds that have had EOF */
+    if ( direction == Direction::In and fd.eof() ) {
+        return false;
+    }
+
+    return active and ( not when_interested or when_interested() );
+}
+
+void Poller::mark_stale( const size_t interest_index )
+{
+    Interest & interest = interests_.at( interest_index );
+    if ( not interest.dynamic and not interest.stale ) {
+        interest.stale = true;
+        stale_interests_.push_back( interest_index );
+    }
+}
+
+void Poller::recompute_interest( const size_t interest_index )
+{
+    Interest & interest = interests_.at( interest_index );
+
+    uint32_t events = 0;
+    for ( const auto & action_index : interest.action_indices ) {
+        const Action & action = actions_.at( action_index );
+        assert( pollfds_.at( action_index ).fd == action.fd.fd_num() );
+
+        pollfds_.at( action_index ).events = action.interested() ? action.direction : 0;
+
+        if ( pollfds_.at( action_index ).events & POLLIN ) {
+            events |= EPOLLIN;
+        }
+        if ( pollfds_.at( action_index ).events & POLLOUT ) {
+            events |= EPOLLOUT;
+        }
+    }
+
+    if ( (events != 0) != (interest.events != 0) ) {
+        if ( events ) {
+            interested_count_++;
+        } else {
+            interested_count_--;
         }
     }
+    interest.events = events;
+
+    if ( ( not interest.registered or events != interest.registered_events )
+         and not interest.changed ) {
+        interest.changed = true;
+        changed_interests_.push_back( interest_index );
+    }
+}
+
+bool Poller::update_interest( void )
+{
+    for ( const auto & interest_index : dynamic_interests_ ) {
+        recompute_interest( interest_index );
+    }
+
+    for ( const auto & interest_index : stale_interests_ ) {
+        interests_.at( interest_index ).stale = false;
+        recompute_interest( interest_index );
+    }
+    stale_interests_.clear();
+
+    return interested_count_ > 0;
+}
+
+Poller::Result Poller::run_callback( const size_t action_index )
+{
+    Action & action = actions_.at( action_index );
+
+    const auto count_before = action.service_count();
+    auto result = action.callback();
+
+    /* the callback may have cancelled the action or hit EOF */
+    mark_stale( action_interest_.at( action_index ) );
+
+    switch ( result.result ) {
+    case ResultType::Exit:
+        return Result( Result::Type::Exit, result.exit_status );
+    case ResultType::Cancel:
+        action.active = false;
+        break;
+    case ResultType::Continue:
+        break;
+    }
+
+    if ( count_before == action.service_count() ) {
+        throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+    }
+
+    return Result::Type::Success;
+}
 
-    /* Quit if no member in pollfds_ has a non-zero direction */
-    if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-                         [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+Poller::Result Poller::poll( const int & timeout_ms )
+{
+    /* Quit if no action is interested in any events */
+    if ( not update_interest() ) {
         return Result::Type::Exit;
     }
 
+#ifdef USE_EPOLL
+    return poll_with_epoll( timeout_ms );
+#else
+    return poll_with_poll( timeout_ms );
+#endif
+}
+
+Poller::Result Poller::poll_with_poll( const int & timeout_ms )
+{
     if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
         return Result::Type::Timeout;
     }
@@ -55,21 +176,101 @@ Poller::Result Poller::poll( const int & timeout_ms )
         if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
             /* we only want to call callback if revents includes
                the event we asked for */
-            const auto count_before = actions_.at( i ).service_count();
-            auto result = actions_.at( i ).callback();
-
-            switch ( result.result ) {
-            case ResultType::Exit:
-                return Result( Result::Type::Exit, result.exit_status );
-            case ResultType::Cancel:
-                actions_.at( i ).active = false;
-                break;
-            case ResultType::Continue:
-                break;
+            const auto result = run_callback( i );
+            if ( result.result == Result::Type::Exit ) {
+                return result;
+            }
+        }
+    }
+
+    return Result::Type::Success;
+}
+
+bool Poller::register_interest( Interest & interest, const size_t interest_index )
+{
+    epoll_event event;
+    event.events = interest.events;
+    event.data.u64 = interest_index;
+
+    if ( interest.registered ) {
+        if ( 0 == epoll_ctl( epoll_fd_->fd_num(), EPOLL_CTL_MOD, interest.fd, &event ) ) {
+            interest.registered_events = interest.events;
+            return true;
+        } else if ( errno != ENOENT and errno != EBADF ) {
+            throw unix_error( "epoll_ctl MOD" );
+        }
+
+        /* the fd was closed (which removed it from the epoll set), and
+           its number may have been reused: try to register it afresh */
+    }
+
+    if ( 0 == epoll_ctl( epoll_fd_->fd_num(), EPOLL_CTL_ADD, interest.fd, &event ) ) {
+        interest.registered = true;
+        interest.registered_events = interest.events;
+        return true;
+    } else if ( errno == EBADF ) {
+        return false; /* closed, as POLLNVAL would report */
+    } else {
+        throw unix_error( "epoll_ctl ADD" );
+    }
+}
+
+Poller::Result Poller::poll_with_epoll( const int & timeout_ms )
+{
+    /* created lazily, so that a Poller constructed before a fork
+       doesn't share its interest list with the child */
+    if ( not epoll_fd_ ) {
+        epoll_fd_.reset( new FileDescriptor( SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ) );
+
+        for ( unsigned int i = 0; i < interests_.size(); i++ ) {
+            if ( not interests_[ i ].changed ) {
+                interests_[ i ].changed = true;
+                changed_interests_.push_back( i );
             }
+        }
+    }
+
+    /* only tell the kernel about new fds and interest that has changed */
+    for ( const auto & interest_index : changed_interests_ ) {
+        Interest & interest = interests_.at( interest_index );
+        interest.changed = false;
+
+        if ( not register_interest( interest, interest_index ) ) {
+            changed_interests_.clear();
+            return Result::Type::Exit;
+        }
+    }
+    changed_interests_.clear();
+
+    epoll_event ready[ MAX_EPOLL_EVENTS ];
+
+    const int ready_count = SystemCall( "epoll_wait", epoll_wait( epoll_fd_->fd_num(), ready,
+                                                                  MAX_EPOLL_EVENTS, timeout_ms ) );
+    if ( ready_count == 0 ) {
+        return Result::Type::Timeout;
+    }
+
+    /* error conditions are reported even for fds with no events requested, as with poll */
+    for ( int i = 0; i < ready_count; i++ ) {
+        if ( ready[ i ].events & (EPOLLERR | EPOLLHUP) ) {
+            return Result::Type::Exit;
+        }
+    }
+
+    for ( int i = 0; i < ready_count; i++ ) {
+        const Interest & interest = interests_.at( ready[ i ].data.u64 );
+
+        for ( const auto & action_index : interest.action_indices ) {
+            const short wanted = pollfds_[ action_index ].events;
 
-            if ( count_before == actions_.at( i ).service_count() ) {
-                throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+            /* we only want to call callback if the fd is ready
+               for the event this action asked for */
+            if ( ( (wanted & POLLIN) and (ready[ i ].events & EPOLLIN) )
+                 or ( (wanted & POLLOUT) and (ready[ i ].events & EPOLLOUT) ) ) {
+                const auto result = run_callback( action_index );
+                if ( result.result == Result::Type::Exit ) {
+                    return result;
+                }
             }
         }
     }
@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <vector>
+#include <memory>
 #include <cassert>
 
 #include <poll.h>
@@ -32,20 +33,61 @@ public:
         std::function<bool(void)> when_interested;
         bool active;
 
+        /* without a when_interested predicate, the action is interested
+           until it is cancelled (or, reading, until EOF), so the Poller
+           only looks at it again after its callback runs */
         Action( FileDescriptor & s_fd,
                 const PollDirection & s_direction,
                 const CallbackType & s_callback,
-                const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+                const std::function<bool(void)> & s_when_interested = nullptr )
             : fd( s_fd ), direction( s_direction ), callback( s_callback ),
               when_interested( s_when_interested ), active( true ) {}
 
+        bool interested( void ) const;
+
         unsigned int service_count( void ) const;
     };
 
 private:
     std::vector< Action > actions_;
+
+    /* one per action: the fd and the events we want for it this round */
     std::vector< pollfd > pollfds_;
 
+    /* Actions on the same fd share an Interest. Each round, only the
+       interests that may have changed are recomputed: those with a
+       when_interested predicate, and those whose callbacks have run
+       since. With the epoll backend (unless configured with
+       --disable-epoll), an fd is registered when first seen, and
+       epoll_ctl is only called when the events wanted for it change. */
+    struct Interest
+    {
+        int fd;
+        std::vector< size_t > action_indices;
+        bool dynamic;           /* some action has a when_interested predicate */
+        bool stale;             /* in stale_interests_ */
+        uint32_t events;        /* epoll events wanted */
+        bool registered;
+        uint32_t registered_events;
+        bool changed;           /* in changed_interests_ */
+    };
+
+    std::vector< Interest > interests_;
+    std::vector< size_t > action_interest_; /* the interest of each action */
+    std::vector< size_t > dynamic_interests_, stale_interests_, changed_interests_;
+    size_t interested_count_; /* interests wanting any events */
+
+    std::unique_ptr< FileDescriptor > epoll_fd_;
+
+    void mark_stale( const size_t interest_index );
+    void recompute_interest( const size_t interest_index );
+
+    /* returns false if no action wants any events */
+    bool update_interest( void );
+
+    /* returns false if the fd has been closed */
+    bool register_interest( Interest & interest, const size_t interest_index );
+
 public:
     struct Result
     {
@@ -55,7 +97,17 @@ public:
             : result( s_result ), exit_status( s_status ) {}
     };
 
-    Poller() : actions_(), pollfds_() {}
+private:
+    /* returns Success unless the callback asked to exit */
+    Result run_callback( const size_t action_index );
+
+    Result poll_with_poll( const int & timeout_ms );
+    Result poll_with_epoll( const int & timeout_ms );
+
+public:
+    Poller() : actions_(), pollfds_(), interests_(), action_interest_(),
+               dynamic_interests_(), stale_interests_(), changed_interests_(),
+               interested_count_( 0 ), epoll_fd_() {}
     void add_action( Action action );
     Result poll( const int & timeout_ms );
 };
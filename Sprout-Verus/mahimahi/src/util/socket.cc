@@ -75,6 +75,30 @@ void Socket::connect( const Address & address )
                                       address.size() ) );
 }
 
+/* start connecting without blocking */
+bool Socket::connect_nonblocking( const Address & address )
+{
+    if ( ::connect( fd_num(), &address.to_sockaddr(), address.size() ) == 0 ) {
+        return true;
+    }
+
+    if ( errno != EINPROGRESS ) {
+        throw unix_error( "connect" );
+    }
+
+    return false;
+}
+
+/* find out how a non-blocking connect turned out */
+void Socket::finish_connect( void )
+{
+    int error = 0;
+    getsockopt( SOL_SOCKET, SO_ERROR, error );
+    if ( error ) {
+        throw unix_error( "connect", error );
+    }
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
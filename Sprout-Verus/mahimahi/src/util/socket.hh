@@ -37,6 +37,12 @@ public:
     /* connect socket to a specified peer address */
     void connect( const Address & address );
 
+    /* for non-blocking sockets: start connecting, returning false if the
+       connection is still in progress (then wait until the socket is
+       writable and call finish_connect, which throws if it failed) */
+    bool connect_nonblocking( const Address & address );
+    void finish_connect( void );
+
     /* accessors */
     Address local_address( void ) const;
     Address peer_address( void ) const;
@@ -0,0 +1,109 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef SPSC_RING_HH
+#define SPSC_RING_HH
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+/* Lock-free, fixed-size ring for one producer thread and one consumer
+   thread. Each side owns one index and only reads the other's, so a
+   push or pop is a couple of loads and one release store. The indices
+   are kept a cache line apart so the threads don't false-share. */
+
+template <typename T>
+class SPSCRing
+{
+private:
+    std::vector<T> slots_;
+    const size_t mask_;
+
+    std::atomic<size_t> head_; /* next to pop (consumer) */
+    char padding_[ 64 ];       /* keeps tail_ off head_'s cache line */
+    std::atomic<size_t> tail_; /* next to push (producer) */
+
+public:
+    /* capacity must be a power of two */
+    SPSCRing( const size_t capacity )
+        : slots_( capacity ),
+          mask_( capacity - 1 ),
+          head_( 0 ),
+          padding_(),
+          tail_( 0 )
+    {
+        if ( capacity == 0 or (capacity & mask_) ) {
+            throw std::runtime_error( "SPSCRing: capacity must be a power of two" );
+        }
+    }
+
+    /* producer only: returns false if the ring is full */
+    bool push( const T & value )
+    {
+        const size_t tail = tail_.load( std::memory_order_relaxed );
+        if ( tail - head_.load( std::memory_order_acquire ) == slots_.size() ) {
+            return false;
+        }
+
+        slots_[ tail & mask_ ] = value;
+        tail_.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    /* producer only: the next slot, to fill in place (saving a copy of
+       a large T), or null if the ring is full. Nothing is pushed until
+       publish(). */
+    T * claim( void )
+    {
+        const size_t tail = tail_.load( std::memory_order_relaxed );
+        if ( tail - head_.load( std::memory_order_acquire ) == slots_.size() ) {
+            return nullptr;
+        }
+
+        return &slots_[ tail & mask_ ];
+    }
+
+    /* producer only: push the slot from claim() */
+    void publish( void )
+    {
+        tail_.store( tail_.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    /* consumer only: returns false if the ring is empty */
+    bool pop( T & value )
+    {
+        const size_t head = head_.load( std::memory_order_relaxed );
+        if ( head == tail_.load( std::memory_order_acquire ) ) {
+            return false;
+        }
+
+        value = slots_[ head & mask_ ];
+        head_.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    /* consumer only: the slot at the head, to read in place, or null if
+       the ring is empty. It stays in the ring until release(). */
+    const T * front( void ) const
+    {
+        const size_t head = head_.load( std::memory_order_relaxed );
+        if ( head == tail_.load( std::memory_order_acquire ) ) {
+            return nullptr;
+        }
+
+        return &slots_[ head & mask_ ];
+    }
+
+    /* consumer only: pop the slot from front() */
+    void release( void )
+    {
+        head_.store( head_.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    /* forbid copying or assigning */
+    SPSCRing( const SPSCRing & other ) = delete;
+    SPSCRing & operator=( const SPSCRing & other ) = delete;
+};
+
+#endif /* SPSC_RING_HH */
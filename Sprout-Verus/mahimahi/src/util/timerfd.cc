@@ -0,0 +1,43 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/timerfd.h>
+
+#include "timerfd.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const uint64_t NS_PER_SECOND = 1000000000;
+
+TimerFD::TimerFD()
+    : fd_( SystemCall( "timerfd_create", timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) )
+{
+}
+
+void TimerFD::arm( const uint64_t ns_from_now )
+{
+    itimerspec setting;
+    setting.it_interval.tv_sec = setting.it_interval.tv_nsec = 0;
+    setting.it_value.tv_sec = ns_from_now / NS_PER_SECOND;
+    setting.it_value.tv_nsec = ns_from_now % NS_PER_SECOND;
+
+    SystemCall( "timerfd_settime", timerfd_settime( fd_.fd_num(), 0, &setting, nullptr ) );
+}
+
+uint64_t TimerFD::read_expirations( void )
+{
+    uint64_t expirations;
+    size_t bytes_read;
+
+    /* the timer may have been re-armed since it last fired */
+    if ( not fd_.read_nonblocking( reinterpret_cast<char *>( &expirations ),
+                                   sizeof( expirations ), bytes_read ) ) {
+        return 0;
+    }
+
+    if ( bytes_read != sizeof( expirations ) ) {
+        throw runtime_error( "timerfd read size mismatch" );
+    }
+
+    return expirations;
+}
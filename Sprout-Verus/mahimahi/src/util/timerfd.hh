@@ -0,0 +1,30 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TIMERFD_HH
+#define TIMERFD_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* wrapper class for a one-shot timer on the monotonic clock that
+   can be polled like any other file descriptor */
+
+class TimerFD
+{
+private:
+    FileDescriptor fd_;
+
+public:
+    TimerFD();
+
+    FileDescriptor & fd( void ) { return fd_; }
+
+    /* fire once, this many ns from now (0 disarms the timer) */
+    void arm( const uint64_t ns_from_now );
+
+    /* acknowledge the timer firing; returns number of expirations (0 if it hasn't) */
+    uint64_t read_expirations( void );
+};
+
+#endif /* TIMERFD_HH */
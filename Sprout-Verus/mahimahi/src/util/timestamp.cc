@@ -1,6 +1,9 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <ctime>
+#include <cassert>
+#include <vector>
+#include <utility>
 
 #include "timestamp.hh"
 #include "exception.hh"
@@ -8,12 +11,9 @@
 uint64_t raw_timestamp( void )
 {
     timespec ts;
-    SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ts ) );
+    SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &ts ) );
 
-    uint64_t millis = ts.tv_nsec / 1000000;
-    millis += uint64_t( ts.tv_sec ) * 1000;
-
-    return millis;
+    return uint64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
 }
 
 uint64_t initial_timestamp( void )
@@ -22,7 +22,49 @@ uint64_t initial_timestamp( void )
     return initial_value;
 }
 
+/* this thread's virtual clock, and what it was before each start
+   that is still running (on, time) */
+static thread_local bool virtual_time_on = false;
+static thread_local uint64_t virtual_time_ns = 0;
+static thread_local std::vector<std::pair<bool, uint64_t>> virtual_time_saved;
+
+size_t start_virtual_time( const uint64_t ns )
+{
+    virtual_time_saved.emplace_back( virtual_time_on, virtual_time_ns );
+    virtual_time_on = true;
+    virtual_time_ns = ns;
+
+    return virtual_time_saved.size();
+}
+
+void set_virtual_time( const uint64_t ns )
+{
+    assert( virtual_time_on );
+    virtual_time_ns = ns;
+}
+
+void stop_virtual_time( const size_t token )
+{
+    /* only the innermost start can be stopped */
+    assert( token == virtual_time_saved.size() );
+    assert( not virtual_time_saved.empty() );
+    virtual_time_on = virtual_time_saved.back().first;
+    virtual_time_ns = virtual_time_saved.back().second;
+    virtual_time_saved.pop_back();
+}
+
+uint64_t timestamp_ns( void )
+{
+    if ( virtual_time_on ) {
+        return virtual_time_ns;
+    }
+
+    /* read the initial value first, in case this is the first call */
+    const uint64_t initial = initial_timestamp();
+    return raw_timestamp() - initial;
+}
+
 uint64_t timestamp( void )
 {
-    return raw_timestamp() - initial_timestamp();
+    return timestamp_ns() / NS_PER_MS;
 }
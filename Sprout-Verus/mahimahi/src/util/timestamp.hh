@@ -4,8 +4,30 @@
 #define TIMESTAMP_HH
 
 #include <cstdint>
+#include <cstddef>
 
-uint64_t timestamp( void );
+static const uint64_t NS_PER_MS = 1000000;
+
+/* time since the first call, on the monotonic clock
+   (so it doesn't jump if the wall clock is changed) */
+uint64_t timestamp_ns( void );
+uint64_t timestamp( void ); /* ms */
+
+/* the monotonic clock (ns) at the first call */
 uint64_t initial_timestamp( void );
 
+/* Virtual time, for running queues as a discrete-event simulation
+   (see SimulatedPath): between start and stop, timestamp_ns() and
+   timestamp() on the calling thread report a clock that moves only
+   when set. Each thread has its own clock. Starts and stops nest: a
+   stop puts the clock back as it was before the matching start, so
+   several simulations can share a thread (in step) or run on threads
+   of their own. The stops must come in the reverse order of the
+   starts (e.g. SimulatedPaths on one thread are destroyed in the
+   reverse order of their creation, as locals are): start returns a
+   token, which its stop checks. */
+size_t start_virtual_time( const uint64_t ns );
+void set_virtual_time( const uint64_t ns );
+void stop_virtual_time( const size_t token );
+
 #endif /* TIMESTAMP_HH */
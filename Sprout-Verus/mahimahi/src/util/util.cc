@@ -18,6 +18,7 @@
 #include "util.hh"
 #include "exception.hh"
 #include "file_descriptor.hh"
+#include "ezio.hh"
 
 using namespace std;
 
@@ -161,8 +162,19 @@ vector< string > list_directory_contents( const string & dir )
     return ret;
 }
 
+static bool root_allowed = false;
+
+void allow_root( void )
+{
+    root_allowed = true;
+}
+
 void assert_not_root( void )
 {
+    if ( root_allowed ) {
+        return;
+    }
+
     if ( ( geteuid() == 0 ) or ( getegid() == 0 ) ) {
         throw runtime_error( "BUG: privileges not dropped in sensitive region" );
     }
@@ -205,3 +217,18 @@ string get_working_directory( void )
 
     return cwd_ptr.get();
 }
+
+unsigned int ferry_batch_size( void )
+{
+    const char * const batch = getenv( "MAHIMAHI_FERRY_BATCH" );
+    if ( not batch ) {
+        return 64;
+    }
+
+    const long int ret = myatoi( batch );
+    if ( ret <= 0 ) {
+        throw runtime_error( "MAHIMAHI_FERRY_BATCH must be positive" );
+    }
+
+    return ret;
+}
@@ -23,6 +23,10 @@ template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 std::string join( const std::vector< std::string > & command );
 std::string get_working_directory( void );
 
+/* most datagrams to read from a TUN device per wakeup, from
+   MAHIMAHI_FERRY_BATCH (1 gives the old one-packet-per-poll behavior) */
+unsigned int ferry_batch_size( void );
+
 class TemporarilyUnprivileged {
 private:
     const uid_t orig_euid;
@@ -35,4 +39,8 @@ public:
 
 void assert_not_root( void );
 
+/* for programs that are never installed setuid (e.g. mm-simulate):
+   they have no privileges to drop, so running as root is allowed */
+void allow_root( void );
+
 #endif /* UTIL_HH */